@@ -0,0 +1,89 @@
+#!/bin/sh
+# Times mgcc built at each of the given git revisions on a corpus.
+#
+#   bench/bench.sh [-l | -p | -t] [-n runs] [-c count] corpus revision...
+#
+# Each revision is built with -O2 in a temporary worktree. The corpus
+# comes from bench/gen.sh and the time is the best of the runs of the
+# whole compiler with its output thrown away. Builds that take -a are
+# given it, older ones printed the syntax tree without being asked.
+# With -l only the lexer is timed, with -p the lexer and parser without
+# printing anything and with -t the lexer and the symbol table, by
+# bench/lex.c, bench/parse.c or bench/scope.c linked against the
+# revision's objects.
+#
+#   bench/bench.sh -l idents HEAD^ HEAD
+
+runs=5
+count=
+driver=
+while getopts lptn:c: opt; do
+	case $opt in
+		l) driver=lex ;;
+		p) driver=parse ;;
+		t) driver=scope ;;
+		n) runs=$OPTARG ;;
+		c) count=$OPTARG ;;
+		*) exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+if [ $# -lt 2 ]; then
+	echo "usage: $0 [-l | -p | -t] [-n runs] [-c count] corpus revision..." >&2
+	exit 1
+fi
+corpus=$1
+shift
+
+here=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d "${TMPDIR:-/tmp}/mgcc-bench.XXXXXX")
+trap 'for w in "$work"/rev*; do [ -d "$w" ] && git -C "$here" worktree remove --force "$w"; done; rm -rf "$work"' EXIT
+
+"$here/gen.sh" "$corpus" $count > "$work/input.c" || exit 1
+size=$(wc -c < "$work/input.c")
+echo "$corpus: $size bytes, best of $runs"
+
+i=0
+for rev in "$@"; do
+	i=$((i + 1))
+	tree="$work/rev$i"
+	git -C "$here" worktree add --detach -q "$tree" "$rev" || exit 1
+	make -C "$tree" -s FLAGS="-c -O2 -pthread" LDFLAGS="-pthread" > /dev/null 2>&1 || { echo "$rev: build failed"; exit 1; }
+	mgcc="$tree/build/mgcc"
+
+	flags=
+	if [ -n "$driver" ]; then
+		mgcc="$tree/build/$driver"
+		objects=$(ls "$tree"/build/*.o | grep -v '/main\.o$')
+		# Copied in so it includes the revision's own headers
+		mkdir -p "$tree/bench"
+		cp "$here/$driver.c" "$tree/bench/$driver.c"
+		cc -O2 -pthread "$tree/bench/$driver.c" $objects -o "$mgcc" || { echo "$rev: $driver driver failed to build"; exit 1; }
+	elif "$mgcc" 2>/dev/null | grep -q -- "-a "; then
+		flags=-a
+	fi
+
+	"$mgcc" $flags "$work/input.c" > /dev/null 2>&1
+	if [ $? -ge 128 ]; then
+		echo "$rev: crashed"
+		continue
+	fi
+	if "$mgcc" $flags "$work/input.c" 2>&1 | grep -q "error:"; then
+		echo "$rev: warning, the corpus doesn't compile cleanly"
+	fi
+
+	best=
+	r=0
+	while [ $r -lt "$runs" ]; do
+		start=$(date +%s%N)
+		"$mgcc" $flags "$work/input.c" > /dev/null 2>&1
+		end=$(date +%s%N)
+		t=$(((end - start) / 1000000))
+		if [ -z "$best" ] || [ "$t" -lt "$best" ]; then
+			best=$t
+		fi
+		r=$((r + 1))
+	done
+	echo "$rev: $best ms, $((size / 1000 / (best > 0 ? best : 1))) MB/s"
+done
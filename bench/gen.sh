@@ -0,0 +1,227 @@
+#!/bin/sh
+# Generates a benchmark corpus on stdout.
+#
+#   bench/gen.sh corpus [count]
+#
+# count scales the corpus, each one's default gives a file of a few MB.
+# The chains are instead one function holding a single chain of count
+# elements, a million by default, for checking with bench/stress.sh that
+# deep input parses in bounded stack space. The output depends only on
+# the arguments so runs can be compared.
+
+usage() {
+	echo "usage: $0 corpus [count]" >&2
+	echo "corpora: idents ops exprs blocks" >&2
+	echo "chains: sum assign elseif unary postfix pointer decls cases" >&2
+	exit 1
+}
+
+[ $# -ge 1 ] || usage
+corpus=$1
+count=$2
+
+case $corpus in
+	# Functions full of declarations and short statements, mostly identifiers and keywords
+	idents)
+		awk -v n="${count:-20000}" '
+		function name(   len, s, i) {
+			len = 1 + int(rand() * 12)
+			s = substr(first, 1 + int(rand() * length(first)), 1)
+			for(i = 1; i < len; i++) {
+				s = s substr(rest, 1 + int(rand() * length(rest)), 1)
+			}
+			return s in keyword ? name() : s
+		}
+		BEGIN {
+			srand(1)
+			split("auto break case char const continue default do double else enum extern float for goto if int long register return short signed sizeof static struct switch typedef union unsigned void volatile while", k, " ")
+			for(i in k) {
+				keyword[k[i]] = 1
+			}
+			first = "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+			rest = first "0123456789"
+			for(f = 0; f < n; f++) {
+				a = name(); b = name(); c = name(); d = name()
+				printf("int %s%d(int %s, char %s) {\n", name(), f, a, b)
+				printf("\tint %s;\n\tchar %s;\n", c, d)
+				printf("\t%s = %s;\n", c, a)
+				printf("\tif(%s) return %s; else %s = %s;\n", c, b, d, b)
+				printf("\twhile(%s) %s = %s;\n", d, c, a)
+				printf("\tdo %s = %s; while(%s);\n", d, a, c)
+				printf("\treturn %s;\n}\n", c)
+			}
+		}'
+	;;
+
+	# Expressions packed with operators of one, two and three characters
+	ops)
+		awk -v n="${count:-20000}" '
+		function operand() {
+			return v[1 + int(rand() * 3)]
+		}
+		BEGIN {
+			srand(1)
+			split("+ - * / % << >> < > <= >= == != & | ^ && ||", binary, " ")
+			split("= += -= *= /= %= <<= >>= &= |= ^=", assign, " ")
+			split("a b c", v, " ")
+			for(f = 0; f < n; f++) {
+				printf("int op%d(int a, int b) {\n\tint c;\n", f)
+				for(s = 0; s < 4; s++) {
+					printf("\tc %s %s", assign[1 + int(rand() * 11)], operand())
+					for(i = 0; i < 6; i++) {
+						printf(" %s %s", binary[1 + int(rand() * 18)], operand())
+					}
+					printf(";\n")
+				}
+				printf("\tc = a++ + ++b - --a - b-- + !a - ~b;\n")
+				printf("\treturn c;\n}\n")
+			}
+		}'
+	;;
+
+	# Random expressions four levels deep, every binary operator at every level
+	exprs)
+		awk -v n="${count:-20000}" '
+		function expr(d,   r) {
+			r = rand()
+			if(d == 0 || r < 0.15) {
+				return r < 0.05 ? int(rand() * 100) : v[1 + int(rand() * 3)]
+			}
+			if(r < 0.25) {
+				return "(" expr(d - 1) ")"
+			}
+			if(r < 0.3) {
+				return "-" expr(d - 1)
+			}
+			return expr(d - 1) " " binary[1 + int(rand() * 18)] " " expr(d - 1)
+		}
+		BEGIN {
+			srand(1)
+			split("+ - * / % << >> < > <= >= == != & | ^ && ||", binary, " ")
+			split("a b c", v, " ")
+			for(f = 0; f < n; f++) {
+				printf("int ex%d(int a, int b, int c) {\n\tint x;\n", f)
+				for(s = 0; s < 4; s++) {
+					printf("\tx = %s;\n", expr(4))
+				}
+				printf("\treturn x;\n}\n")
+			}
+		}'
+	;;
+
+	# Functions of small nested blocks, each declaring a local, for scope entry
+	# and exit. The blocks are under ifs, older parsers took no bare block in
+	# a statement list.
+	blocks)
+		awk -v n="${count:-20000}" 'BEGIN {
+			for(f = 0; f < n; f++) {
+				printf("int bl%d(int a) {\n\tint x;\n\tx = a;\n", f)
+				for(b = 0; b < 4; b++) {
+					printf("\tif(x) { int a; int b; x = a + b; if(x) { int c; int d; x = c + d; if(x) { int e; x = x + e; } } }\n")
+				}
+				printf("\treturn x;\n}\n")
+			}
+		}'
+	;;
+
+	# a + a + ... + a
+	sum)
+		awk -v n="${count:-1000000}" 'BEGIN {
+			printf("int f(int a) {\n\treturn a")
+			for(i = 1; i < n; i++) {
+				printf(" + a")
+			}
+			printf(";\n}\n")
+		}'
+	;;
+
+	# a = b = ... = a, right associative
+	assign)
+		awk -v n="${count:-1000000}" 'BEGIN {
+			printf("int f(int a, int b) {\n\t")
+			for(i = 1; i < n; i++) {
+				printf(i % 2 ? "a = " : "b = ")
+			}
+			printf("a;\n\treturn b;\n}\n")
+		}'
+	;;
+
+	# if(a == 0) ... else if(a == 1) ...
+	elseif)
+		awk -v n="${count:-1000000}" 'BEGIN {
+			printf("int f(int a) {\n\tint b;\n\tb = 0;\n\tif(a == 0) b = 1;\n")
+			for(i = 1; i < n; i++) {
+				printf("\telse if(a == %d) b = %d;\n", i % 30000, i % 7)
+			}
+			printf("\treturn b;\n}\n")
+		}'
+	;;
+
+	# !-~(int)!-~(int)...a, prefix operators and casts
+	unary)
+		awk -v n="${count:-1000000}" 'BEGIN {
+			split("! - ~ (int)", op, " ")
+			printf("int f(int a) {\n\treturn ")
+			for(i = 0; i < n; i++) {
+				printf("%s", op[1 + i % 4])
+			}
+			printf("a;\n}\n")
+		}'
+	;;
+
+	# a[0][0]...[0], on a pointer of as many levels
+	postfix)
+		awk -v n="${count:-1000000}" 'BEGIN {
+			printf("int f(int ")
+			for(i = 0; i < n; i++) {
+				printf("*")
+			}
+			printf("a) {\n\treturn a")
+			for(i = 0; i < n; i++) {
+				printf("[0]")
+			}
+			printf(";\n}\n")
+		}'
+	;;
+
+	# int *(*(*...a[1])[1])..., alternating pointer and array declarators
+	pointer)
+		awk -v n="${count:-1000000}" 'BEGIN {
+			printf("int f(void) {\n\tint ")
+			for(i = 0; i < n; i++) {
+				printf("*(")
+			}
+			printf("a")
+			for(i = 0; i < n; i++) {
+				printf(")[1]")
+			}
+			printf(";\n\treturn 0;\n}\n")
+		}'
+	;;
+
+	# int a0; int a1; ... in one block
+	decls)
+		awk -v n="${count:-1000000}" 'BEGIN {
+			printf("int f(void) {\n")
+			for(i = 0; i < n; i++) {
+				printf("\tint a%d;\n", i)
+			}
+			printf("\treturn 0;\n}\n")
+		}'
+	;;
+
+	# case 0: case 1: ... labelling a single statement
+	cases)
+		awk -v n="${count:-1000000}" 'BEGIN {
+			printf("int f(int a) {\n\tswitch(a) {\n\t")
+			for(i = 0; i < n; i++) {
+				printf("case %d: ", i)
+			}
+			printf("\n\t\treturn 1;\n\t}\n\treturn 0;\n}\n")
+		}'
+	;;
+
+	*)
+		usage
+	;;
+esac
@@ -0,0 +1,15 @@
+/*
+ * Lexes a file and nothing else, for timing the lexer on its own. It
+ * only uses init_lex and lex_translation_unit, which every revision has,
+ * and is linked against a revision's objects by bench.sh -l.
+ */
+#include "../inc/lex.h"
+
+int main(int argc, char **argv) {
+	if(argc != 2) {
+		return -1;
+	}
+	init_lex(argv[1]);
+	lex_translation_unit();
+	return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * Lexes and parses a file without printing anything, for timing the
+ * parser. Revisions differ in what has to be set up first, those that
+ * only some have are weak and called when they are there. Linked against
+ * a revision's objects by bench.sh -p.
+ */
+#include "../inc/lex.h"
+#include "../inc/node.h"
+#include "../inc/table.h"
+#include "../inc/decl.h"
+
+void init_node_pool(void) __attribute__((weak));
+void init_types(void) __attribute__((weak));
+
+int main(int argc, char **argv) {
+	if(argc != 2) {
+		return -1;
+	}
+	init_lex(argv[1]);
+	init_symbol_table();
+	if(init_node_pool) {
+		init_node_pool();
+	}
+	if(init_types) {
+		init_types();
+	}
+	lex_translation_unit();
+	parse_translation_unit();
+	return 0;
+}
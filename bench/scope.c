@@ -0,0 +1,50 @@
+/*
+ * Replays the scopes and names of a file against the symbol table, for
+ * timing it apart from the parser, which older revisions didn't have
+ * declare anything. '{' and '}' enter and leave a scope, an identifier
+ * after int is declared and any other is looked up. Linked against a
+ * revision's objects by bench.sh -t.
+ */
+#include "../inc/lex.h"
+#include "../inc/node.h"
+#include "../inc/table.h"
+
+int main(int argc, char **argv) {
+	if(argc != 2) {
+		return -1;
+	}
+	init_lex(argv[1]);
+	init_symbol_table();
+	lex_translation_unit();
+
+	token_type prev = END;
+	for(token_type t; (t = get_current_type()) != END; consume_token()) {
+		switch(t) {
+			case LBRACE:
+				enter_scope();
+			break;
+
+			case RBRACE:
+				exit_scope();
+			break;
+
+			case IDENTIFIER:
+				if(prev == INT) {
+/* Symbols were given their type once there were types */
+#ifdef TYPE_H
+					add_symbol(DECLARATOR_NODE, INT, current_token_ident(), NULL, NULL);
+#else
+					add_symbol(DECLARATOR_NODE, INT, current_token_ident(), NULL);
+#endif
+				} else {
+					get_symbol(DECLARATOR_NODE, INT, current_token_ident());
+				}
+			break;
+
+			default:
+			break;
+		}
+		prev = t;
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Checks that each chain corpus of bench/gen.sh is parsed without
+# overflowing a small stack.
+#
+#   bench/stress.sh [-c count] [-s stack KB] [compiler]
+#
+# Each chain is count elements long, 1000000 by default, and run with the
+# stack limited to 256KB unless -s says otherwise. Without a compiler
+# bench/parse.c is linked against the objects in build/, run make first,
+# and only lexes and parses. A compiler given is run on each chain as it
+# is, so it shouldn't print the syntax tree, whose output grows with the
+# square of the depth.
+#
+#   bench/stress.sh -c 2000000
+
+count=1000000
+stack=256
+while getopts c:s: opt; do
+	case $opt in
+		c) count=$OPTARG ;;
+		s) stack=$OPTARG ;;
+		*) exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+here=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d "${TMPDIR:-/tmp}/mgcc-stress.XXXXXX")
+trap 'rm -rf "$work"' EXIT
+
+if [ $# -ge 1 ]; then
+	run=$1
+else
+	run="$work/parse"
+	objects=$(ls "$here"/../build/*.o | grep -v '/main\.o$')
+	cc -O2 -pthread "$here/parse.c" $objects -o "$run" || exit 1
+fi
+
+echo "$count elements, ${stack}KB stack"
+failed=0
+for chain in sum assign elseif unary postfix pointer decls cases; do
+	"$here/gen.sh" $chain "$count" > "$work/input.c" || exit 1
+	start=$(date +%s%N)
+	(ulimit -s "$stack" && exec "$run" "$work/input.c") > /dev/null 2> "$work/err"
+	status=$?
+	end=$(date +%s%N)
+	if [ $status -ge 128 ]; then
+		echo "$chain: crashed"
+		failed=1
+	elif [ $status -ne 0 ] || grep -q "error:" "$work/err"; then
+		echo "$chain: errors"
+		head -n 3 "$work/err"
+		failed=1
+	else
+		echo "$chain: ok, $(((end - start) / 1000000)) ms"
+	fi
+done
+exit $failed
@@ -0,0 +1,44 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Bump pointer allocator. Memory handed out by an arena is zeroed and
+ * lives until the whole arena is released, there is no way to free a
+ * single allocation.
+ *
+ * A reserved arena is one contiguous range of address space that is
+ * committed a chunk at a time, so offsets from its base stay valid for
+ * as long as the arena does. Child arenas take their chunks from a
+ * reserved parent, so each thread can allocate without locking while
+ * everything still lands in the one range.
+ */
+typedef struct arena_chunk arena_chunk;
+
+typedef struct {
+	size_t count;    /* Number of allocations */
+	size_t used;     /* Bytes handed out, including alignment padding */
+	size_t reserved; /* Bytes obtained from the system */
+} arena_stats;
+
+typedef struct arena {
+	arena_chunk *chunks;
+	struct arena *parent; /* Reserved arena that chunks are taken from */
+	char *base;  /* Start of the reservation, NULL for a chunked arena */
+	char *limit; /* End of the reservation */
+	char *ptr;
+	char *end;
+	size_t chunk_size;
+	arena_stats stats;
+} arena;
+
+void arena_init(arena *a, size_t chunk_size);
+void arena_init_reserved(arena *a, size_t chunk_size, size_t reserve);
+void arena_init_child(arena *a, arena *parent);
+void arena_detach_child(arena *a);
+void *arena_alloc(arena *a, size_t size);
+void arena_release(arena *a);
+arena_stats arena_get_stats(arena *a);
+
+#endif /* ARENA_H */
@@ -0,0 +1,55 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "triple.h"
+
+/*
+ * A function's basic blocks. A block is a run of triples that starts at
+ * the function's entry, at a label or after a jump, branch or return, so
+ * the blocks cover the code in order and block 0 is the entry.
+ *
+ * Edges are kept in two flat arrays, each block owning a slice of the
+ * predecessors and of the successors. Only blocks reachable from the entry
+ * are put in reverse postorder and given a dominator.
+ */
+typedef uint32_t block_ref;
+
+#define NO_BLOCK UINT32_MAX
+
+typedef struct {
+	triple_ref start;
+	triple_ref end;      /* One past its last triple */
+	uint32_t pred;       /* Its slice of the predecessors */
+	uint32_t pred_count;
+	uint32_t succ;       /* Its slice of the successors, the branch target before the fall through */
+	uint32_t succ_count;
+	uint32_t rpo;        /* Position in reverse postorder, NO_BLOCK if unreachable */
+	block_ref idom;      /* Immediate dominator, NO_BLOCK for the entry and unreachable blocks */
+	uint32_t child;      /* Its slice of the dominator tree's children */
+	uint32_t child_count;
+	uint32_t dom_pre;    /* Preorder number in the dominator tree */
+	uint32_t dom_size;   /* Blocks in its dominator subtree, itself included */
+} basic_block;
+
+/* Arrays are kept between builds so a cfg can be reused for every function */
+typedef struct {
+	ir_func *f;
+	basic_block *blocks;
+	uint32_t count;
+	block_ref *block_of; /* Block of each triple */
+	block_ref *preds;
+	block_ref *succs;
+	block_ref *children;
+	block_ref *order;    /* Reachable blocks in reverse postorder */
+	uint32_t order_count;
+	uint32_t block_cap;
+	uint32_t triple_cap;
+	uint32_t *work;      /* Scratch for the builder */
+} cfg;
+
+void build_cfg(cfg *g, ir_func *f);
+void release_cfg(cfg *g);
+bool dominates(cfg *g, block_ref a, block_ref b);
+void print_cfg(cfg *g);
+
+#endif /* CFG_H */
@@ -11,5 +11,21 @@ void print_type_specifier(token_type s);
 bool is_declaration(token_type t);
 node *parse_translation_unit(void);
 token_type get_decl_type(node *d);
+char *get_decl_identifier(node *d);
+node *declarator_identifier(node *d);
+node *function_definition(node *d);
 node *parse_decl_initializers(void); 
+void finish_decl_thread(void);
+
+/* A function body waiting to be parsed */
+typedef struct {
+	node *def;    /* The FUNC_DEF_NODE it belongs to */
+	size_t start; /* Index of the first token after the '{' */
+	size_t end;   /* Index of the matching '}' */
+} deferred_body;
+
+void defer_function_bodies(bool defer);
+deferred_body *get_deferred_bodies(size_t *count);
+void parse_deferred_body(deferred_body *b);
+node *get_function_body(node *def);
 #endif /* DECL_H */
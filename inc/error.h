@@ -4,9 +4,31 @@
 
 #ifndef MGG_8_ERROR_H
 #define MGG_8_ERROR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* A diagnostic held back while parsing on several threads */
+typedef struct {
+	size_t pos;  /* Index of the token it was reported at */
+	int rank;    /* Orders diagnostics reported at the same token */
+	size_t seq;
+	char *msg;
+} diagnostic;
+
+typedef struct {
+	diagnostic *diags;
+	size_t count;
+	size_t cap;
+	int rank;
+} diag_buffer;
+
 bool has_error_occurred(void);
 void error (char *err_str);
 void file_error(char *err_str);
 void debug(char *debug_str);
 void warn(char *warn_str);
+void set_diagnostic_buffer(diag_buffer *b);
+void set_diagnostic_line(int line);
+void flush_diagnostics(diag_buffer *bufs, size_t n);
 #endif //MGG_8_ERROR_H
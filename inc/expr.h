@@ -5,8 +5,10 @@
 
 node *parse_expr(void);
 node *primary_expr(void);
+node *identifier_node(void);
 node *constant_expr(void);
 node *assignment_expr(node *prev);
-node *cast_expr(node *prev);
+node *cast_expr(void);
+void finish_expr_thread(void);
 
 #endif /* EXPR_H */
@@ -5,6 +5,9 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+/* Number of zero bytes guaranteed to follow the end of the input buffer */
+#define INPUT_PADDING 64
+
 void set_input_fname(char *n);
 char *get_input_fname(void);
 void set_output_fname(char *n);
@@ -12,6 +15,7 @@ char *get_output_fname(void);
 void write_output_file(uint8_t *bin, int size);
 FILE *open_input_file(char *fname);
 char *read_input_file(FILE *f);
+char *map_input_file(char *fname, size_t *size);
 long get_file_size(FILE *fp);
 void file_error(char *err_str);
 
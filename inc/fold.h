@@ -0,0 +1,23 @@
+#ifndef FOLD_H
+#define FOLD_H
+
+#include "node.h"
+
+/*
+ * Integer constant folding with the target's arithmetic. int is 16 bits
+ * and long is 32, both wrap around. An INTEGER_CONSTANT_NODE's is_unsigned
+ * and is_long give its C type, and val holds its value in that type.
+ *
+ * The fold functions are handed operands that are already folded and
+ * return the folded result, reusing an operand's node, or NULL if the
+ * operation can't be folded.
+ */
+bool is_constant(node *n);
+bool fits_int(node *n);
+void set_integer_constant(node *n, uint32_t val, bool is_unsigned, bool is_long, bool decimal);
+node *fold_identifier(node *n);
+node *fold_unary(operation o, node *operand);
+node *fold_cast(node *a_decl, node *operand);
+node *fold_binary(operation o, node *l, node *r);
+
+#endif /* FOLD_H */
@@ -0,0 +1,14 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Interned strings are stored once and never freed, so two interned
+ * strings are equal exactly when their pointers are equal.
+ * They must not be modified.
+ */
+char *intern(const char *s, size_t len);
+
+#endif /* INTERN_H */
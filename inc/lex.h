@@ -7,10 +7,10 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #define MAX_STRING_LITERAL_LEN 512
-#define EXPECT_TOKEN(t) (get_current_token()->type == (t))
-#define NEW_TOKEN calloc(1, sizeof(token))
+#define EXPECT_TOKEN(t) (get_current_type() == (t))
 
 typedef int token_type;
 typedef int operation;
@@ -71,33 +71,41 @@ enum {
   UNKNOWN
 };
 
-#define NUM_KEYWORDS 31
-static const char *keywords[NUM_KEYWORDS] = {
-	"auto", "register", "static", "extern", "typedef",
-	"void", "char", "short", "int", "long", "float", "double", "signed", "unsigned",
-	"struct", "union", "enum",
-	"const", "volatile",
-	"switch", "case", "default",
-	"if", "else",
-	"while", "do", "for",
-	"goto", "continue", "break", "return"
-};
-
 #define MAX_TOK_LEN 32
 
+/* Tokens held when streaming, must be a power of two larger than the parser's lookahead */
+#define TOKEN_RING_SIZE 4
+
 typedef struct source_position source_pos;
 struct source_position {
   int line;
   int col;
 };
 
+/* Value worked out by the lexer, interpreted by the type of the token */
+/* Flags describing a decoded INTEGER_CONST */
+#define INT_CONST_UNSIGNED 0x1
+#define INT_CONST_LONG 0x2
+#define INT_CONST_BAD_SUFFIX 0x4
+#define INT_CONST_BAD_DIGIT 0x8
+#define INT_CONST_OVERFLOW 0x10 /* Doesn't fit in 32 bits */
+#define INT_CONST_DECIMAL 0x20
+
+typedef union {
+  char *ident; /* Interned spelling of an IDENTIFIER */
+  struct {
+    uint32_t val;
+    uint8_t flags;
+  } integer; /* Value and suffix of an INTEGER_CONST */
+} token_attr;
+
 typedef struct token_struct token;
 struct token_struct {
   token_type type;
-  void *attr; /* Is interpreted by the type of the token */
+  token_attr attr;
+  uint32_t offset; /* Spelling of the token as a slice of the source buffer */
+  uint32_t len;
   int line;
-  bool prefix;
-  token *next;
 };
 
 typedef struct {
@@ -107,12 +115,23 @@ typedef struct {
 
 int get_line(void);
 void init_lex(char *input_file);
-token *lex_token(void);
-token *lex_translation_unit(void);
+void lex_token(token *t);
+size_t lex_translation_unit(void);
+void lex_stream(void);
 void print_token_type(token_type t);
 void consume_token(void);
-token *get_current_token(void); 
-token *peek_next_token(void);
-token *peek_2nd_token(void);
+token_type get_current_type(void);
+token_type peek_next_type(void);
+token_type peek_2nd_type(void);
+int get_current_line(void);
+token get_current_token(void);
+const char *token_start(token *t);
+char *token_str(token *t);
+char *current_token_str(void);
+size_t decode_string(const char *s, size_t len, char *out);
+char *current_token_ident(void);
+size_t get_token_index(void);
+void set_token_range(size_t start, size_t end);
+size_t skip_braced_tokens(void);
 
 #endif //MGG_8_LEX_H
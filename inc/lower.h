@@ -0,0 +1,14 @@
+#ifndef LOWER_H
+#define LOWER_H
+
+#include "node.h"
+#include "triple.h"
+
+/*
+ * Lowers every function definition in a translation unit to triples. The
+ * tree must have parsed without errors, bodies that were deferred are
+ * parsed as they are reached.
+ */
+ir_module *lower_translation_unit(node *unit);
+
+#endif /* LOWER_H */
@@ -13,6 +13,7 @@
 #include "lex.h"
 #include "token.h"
 #include "error.h"
+#include "arena.h"
 
 
 /* AST node types */
@@ -63,8 +64,16 @@ typedef token_type operation;
 typedef token_type type_specifier;
 typedef int node_type;
 
+/*
+ * Nodes live in a single contiguous pool and refer to each other by their
+ * offset into it in units of NODE_ALIGN bytes. A ref of 0 is NULL.
+ */
+typedef uint32_t node_ref;
+#define NODE_ALIGN 8
+#define NODE_ALIGN_SHIFT 3
 
 typedef struct _node node;
+struct _symbol;
 typedef struct _node_stack node_stack;
 typedef struct _node_queue node_queue;
 
@@ -79,10 +88,15 @@ struct _node_queue {
 	size_t count;
 };
 
+/*
+ * Only the header and the union member used by a node's type are allocated,
+ * see node_size in node.c. A node may only change type to one that uses
+ * the same member.
+ */
 struct _node {
-  node_type type;
-  node *next;
-  node *sym_tab_next; /* Used in the symbol table */
+  uint8_t type;
+  uint32_t line : 24; /* Line of the token the node was made at, fits beside the type */
+  node_ref next;
   union {
 	  /*
 	   * Contains:
@@ -91,49 +105,44 @@ struct _node {
 	   *	identifiers	
 	   */
 	  struct constant_node {
-		char *tok_str;
 		int val;
 	  	bool is_unsigned;
 		bool is_long;
+		char *tok_str; /* Interned for identifiers */
+		struct _symbol *sym; /* What an identifier refers to, NULL for members and labels */
 	  } constant;
 	
 	  struct expression_node {
 		operation o;
-		node *lval;
-		node *rval;
+		node_ref lval;
+		node_ref rval;
 	  } expression;
 
-	  struct identifier_node {
-		  bool ptr;
-		  token *tok;
-		  /* Symbol table entry */
-	  } identifier;
- 		
 	  struct unary_node {
 		  operation o;
-		  node *rval;
+		  node_ref rval;
 	  } unary;
 
 	  struct postfix_node {
 		  operation o;
-		  node *lval;
-		  node *params; /* Used for array/struct access and function calls */
+		  node_ref lval;
+		  node_ref params; /* Used for array/struct access and function calls */
 	  } postfix;
  	
 	  struct cast_node {
 		token_type specifier;
-		node *a_decl;
-		node *expr;
+		node_ref a_decl;
+		node_ref expr;
 	  } cast;
 
 	  struct initializer_list_node {
-		node *head;
-		node *tail;
+		node_ref head;
+		node_ref tail;
 		int count;
 	  } init_list;
 
 	  struct declaration_node {
-		node *specifier;
+		node_ref specifier;
 		/*
 		 * Can be:
 		 * 	init declarator
@@ -141,67 +150,88 @@ struct _node {
 		 * 	union declarator
 		 * 	enum declarator
 		 */	
-		node *declarator;
-	  	node *initialiser;
-//	  	node *stmt;
+		node_ref declarator;
+	  	node_ref initialiser;
 	  } declaration;
 
 	  struct declaration_spec_node {
 		token_type s_type;
+		bool has_signedness; /* signed or unsigned was given, which isn't supported */
 	  } declaration_spec;
 
 	  struct declarator_node {
 		bool is_pointer;
-		node *direct_declarator;
+		node_ref direct_declarator;
 	  } declarator;
 
 	  /* 
 	   * Can be either array or function
 	   */
 	  struct direct_declarator_node {
-		node *direct;
-		node *params;
-	  	node *stmt; // used for function definitions
+		node_ref direct;
+		node_ref params;
+	  	node_ref stmt; // used for function definitions
+		uint32_t body; /* Deferred body of a definition plus one, 0 if there isn't one */
 	  } direct_declarator;
 
 	  /* Handles the composite types of enum, struct and union */
 	  struct composite_declarator_node {
 		char *identifier;
-		node *decl_list;
+		node_ref decl_list;
+		node_ref tag_def; /* Node that declared the tag in its scope */
 	  } comp_declarator;
 	
 	  struct struct_declarator_node {
-		node *decl;
-		node *expr;
+		node_ref decl;
+		node_ref expr;
 	  } struct_declarator;
 	  /* 
 	   * Common statement node, used for statements with only an expression and a statement
 	   */
 	  struct statement_node {
-		  node *expr; /* Expression/Declaration list */
-		  node *stmt; /* Statement list */
+		  node_ref expr; /* Expression/Declaration list */
+		  node_ref stmt; /* Statement list */
 	  } statement;
   	 
 	  /*
 	   * if statements differ from the common statement format hence it's own node.
 	   */
 	  struct if_statement_node {
-		node *expr;
-		node *i_stmt; /* if statement */
-		node *e_stmt; /* else statement */
+		node_ref expr;
+		node_ref i_stmt; /* if statement */
+		node_ref e_stmt; /* else statement */
 	  } if_statement;
   	 
 	  /* for is another special case from the common */
 	  struct for_statement_node {
-		node *expr_1;
-		node *expr_2;
-		node *expr_3;
-		node *stmt;
+		node_ref expr_1;
+		node_ref expr_2;
+		node_ref expr_3;
+		node_ref stmt;
 	  } for_statement;
   };
 };
 
+extern char *node_pool_base;
+
+static inline node *node_at(node_ref r) {
+  return r == 0 ? NULL : (node *)(node_pool_base + ((size_t)r << NODE_ALIGN_SHIFT));
+}
+
+static inline node_ref ref_of(node *n) {
+  return n == NULL ? 0 : (node_ref)(((char *)n - node_pool_base) >> NODE_ALIGN_SHIFT);
+}
+
+#define NODE(r) node_at(r)
+#define REF(n) ref_of(n)
+
+void init_node_pool(void);
+void init_node_thread(void);
+void finish_node_thread(void);
 node *new_node(node_type type);
+void *new_node_data(size_t size);
+arena_stats node_stats(void);
+void release_nodes(void);
 
 node_stack *node_stack_init(size_t size);
 node *pop_node(node_stack *s);
@@ -0,0 +1,8 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "node.h"
+
+node *parse_translation_unit_parallel(int jobs);
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,17 @@
+#ifndef SCCP_H
+#define SCCP_H
+
+#include "triple.h"
+#include "cfg.h"
+
+/*
+ * Sparse conditional constant propagation over a function in SSA form, g
+ * being its current cfg. Values found to be constant replace their uses,
+ * branches on constants become jumps or go, and blocks that can never run
+ * are emptied, leaving them unreachable. Jumps are then taken straight
+ * through blocks that only jump on. Phis keep an operand for each edge
+ * that can still be taken. g is rebuilt for the new code.
+ */
+void propagate_constants(ir_func *f, cfg *g);
+
+#endif /* SCCP_H */
@@ -0,0 +1,22 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "triple.h"
+#include "cfg.h"
+
+/*
+ * Puts a function into SSA form. Scalar variables that are neither global
+ * nor have their address taken stop being variables: each get is replaced
+ * by the value that reaches it and each set goes, with phis where values
+ * meet. Unreachable blocks are dropped. g is rebuilt for the new code.
+ */
+void enter_ssa(ir_module *m, ir_func *f, cfg *g);
+
+/*
+ * Takes a function out of SSA form, g must be its current cfg. Each phi
+ * becomes a variable set at the end of its predecessors and read where the
+ * phi was. Unreachable blocks are dropped. g is rebuilt for the new code.
+ */
+void leave_ssa(ir_module *m, ir_func *f, cfg *g);
+
+#endif /* SSA_H */
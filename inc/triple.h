@@ -1,42 +1,184 @@
 #ifndef TRIPLE_H
 #define TRIPLE_H
 
-#include "lex.h"
+#include "table.h"
+#include "arena.h"
+#include <stdio.h>
 #include <stdint.h>
 
-typedef int arg_type;
-
-/* Other arguments use the token type definitions such as constant or identifier */
-enum {
-	TRIPLE
-};
-
-/* Arguments can either be references to nodes or other triples. */
-typedef struct _argument argument;
-typedef struct _triple triple;
-typedef struct _triple_list t_list;
-
-struct _argument {
-	arg_type a_type;	
-	union {
-		node *n_arg;
-		triple *t_arg;
-	};
-};
-
-struct _triple {
-	size_t id;
-	token_type op;
-	argument arg_1;
-	argument arg_2;
-	triple *next;
-};
-
-struct _triple_list {
-	size_t count;
-	triple *head;
-	triple *tail;
-};
+/*
+ * Each function's code is one dense array of triples. A triple is named
+ * by its index in the array and its operands are 32 bit words, so passes
+ * walk the code linearly, keep per triple information in plain arrays
+ * indexed the same way and the whole function can be written out as is.
+ *
+ * An operand is one of:
+ * 	OPERAND_TRIPLE	the value computed by the triple at that index
+ * 	OPERAND_IMM	an integer, held in the target's representation
+ * 	OPERAND_VAR	an index into the function's variable table
+ *
+ * Jumps name the IR_LABEL triple they go to.
+ *
+ * In SSA form each block starts with its phis. A phi's operands are the
+ * immediate count of them followed by one operand per reachable
+ * predecessor of its block, in the order the cfg lists the predecessors.
+ */
+typedef uint32_t triple_ref;
 
+#define NO_TRIPLE UINT32_MAX
+
+typedef enum {
+	OPERAND_NONE,
+	OPERAND_TRIPLE,
+	OPERAND_IMM,
+	OPERAND_VAR
+} operand_kind;
+
+typedef enum {
+	IR_NOP,     /* Deleted, ignored by every pass */
+	IR_LABEL,
+	IR_JUMP,    /* goto a */
+	IR_BRANCH,  /* if a != 0 goto b */
+	IR_BRANCHZ, /* if a == 0 goto b */
+	IR_RET,     /* Return a if it isn't OPERAND_NONE */
+
+	IR_PARAM,   /* Value of parameter number a */
+	IR_GET,     /* Value of variable a */
+	IR_SET,     /* Variable a = b */
+	IR_ADDR,    /* Address of variable a */
+	IR_LOAD,    /* *a */
+	IR_STORE,   /* *a = b */
+	IR_ARG,     /* Passes a to the next IR_CALL */
+	IR_CALL,    /* Calls a with the last b IR_ARGs */
+	IR_COPY,    /* a */
+	IR_CONV,    /* a converted from size b to the triple's size */
+	IR_PHI,     /* Merges variable a, its operands are at b in the function's phi operands */
+	IR_STRING,  /* Address of the module's string literal a */
+
+	IR_NEG,
+	IR_COM,     /* ~a */
+	IR_ADD,
+	IR_SUB,
+	IR_MUL,
+	IR_DIV,
+	IR_MOD,
+	IR_SHL,
+	IR_SHR,
+	IR_AND,
+	IR_OR,
+	IR_XOR,
+	IR_EQ,
+	IR_NE,
+	IR_LT,
+	IR_LE,
+	IR_GT,
+	IR_GE,
+
+	IR_OP_COUNT
+} ir_op;
+
+#define IR_UNSIGNED 1 /* Division, right shifts, comparisons and widening are unsigned */
+
+/*
+ * size is the bytes in the result or in the value moved, 0 if there is
+ * none. A comparison's size is that of its operands, its result is an int.
+ */
+typedef struct {
+	uint8_t op;
+	uint8_t a_kind : 4;
+	uint8_t b_kind : 4;
+	uint8_t size;
+	uint8_t flags;
+	uint32_t a;
+	uint32_t b;
+} triple;
+
+/* Passed to emit, the kind and the word that gets stored */
+typedef struct {
+	operand_kind kind;
+	uint32_t val;
+} operand;
+
+#define VAR_GLOBAL 1
+#define VAR_PARAM 2
+#define VAR_ADDRESSED 4 /* Its address is taken, so it must stay in memory */
+
+typedef struct {
+	char *ident;  /* Interned, NULL for a temporary */
+	symbol *sym;  /* NULL for a temporary or IR that was read back in */
+	uint32_t flags;
+	uint16_t size;
+} ir_var;
+
+typedef struct {
+	char *ident;
+	symbol *sym;
+	triple *code;
+	uint32_t count;
+	ir_var *vars;
+	uint32_t var_count;
+	operand *phi_args;
+	uint32_t phi_count;
+} ir_func;
+
+/* A string literal with its escape sequences decoded, the null isn't included */
+typedef struct {
+	char *bytes;
+	uint32_t len;
+} ir_string;
+
+typedef enum {
+	INIT_ZERO,     /* No initializer */
+	INIT_CONSTANT, /* The integer val, held like an immediate */
+	INIT_STRING,   /* The address of string literal val */
+	INIT_CHARS     /* A char array holding string literal val, zero filled */
+} init_kind;
+
+/* A global variable, functions refer to it through a VAR_GLOBAL variable of the same name */
+typedef struct {
+	char *ident; /* Interned */
+	uint32_t size;
+	uint32_t init;
+	uint32_t val;
+} ir_global;
+
+/* A translation unit's functions, globals and string literals, allocated from its own arena */
+typedef struct {
+	arena pool;
+	ir_func **funcs;
+	uint32_t count;
+	uint32_t cap;
+	ir_global *globals;
+	uint32_t global_count;
+	uint32_t global_cap;
+	uint32_t *global_hash; /* Index + 1 of the global with an identifier, 0 if empty */
+	uint32_t global_hash_size;
+	ir_string *strings;
+	uint32_t string_count;
+	uint32_t string_cap;
+} ir_module;
+
+operand no_operand(void);
+operand triple_operand(triple_ref t);
+operand imm_operand(uint32_t val);
+operand var_operand(uint32_t var);
+
+ir_module *new_ir_module(void);
+void release_ir_module(ir_module *m);
+void begin_function(symbol *s);
+uint32_t function_var(symbol *s, uint32_t flags);
+uint32_t temp_var(uint16_t size);
+ir_var *get_var(uint32_t var);
+uint32_t add_ir_string(ir_module *m, const char *spelling, size_t len);
+ir_global *find_ir_global(ir_module *m, char *ident);
+ir_global *add_ir_global(ir_module *m, ir_global g);
+triple_ref emit(ir_op op, uint8_t size, uint8_t flags, operand a, operand b);
+triple_ref next_triple(void);
+triple *get_triple(triple_ref t);
+ir_func *end_function(ir_module *m);
+void print_ir_function(ir_func *f);
+void print_ir_module(ir_module *m);
+void write_ir_module(ir_module *m, FILE *out);
+ir_module *read_ir_module(FILE *in);
 
 #endif /* TRIPLE_H */
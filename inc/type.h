@@ -0,0 +1,65 @@
+#ifndef TYPE_H
+#define TYPE_H
+
+#include "node.h"
+
+/*
+ * Types are hash-consed: every distinct type exists exactly once, so two
+ * types are the same exactly when their pointers are equal. They are never
+ * freed and must not be modified, apart from a struct or union being
+ * completed when its definition is seen.
+ *
+ * Sizes are for the 16 bit target: char is 1 byte, int and pointers are 2
+ * and long is 4.
+ */
+typedef enum {
+	TYPE_VOID,
+	TYPE_CHAR,
+	TYPE_INT,
+	TYPE_LONG,
+	TYPE_POINTER,
+	TYPE_ARRAY,
+	TYPE_FUNCTION,
+	TYPE_STRUCT,
+	TYPE_UNION
+} type_kind;
+
+#define TYPE_COMPLETE 1      /* Size and layout are known */
+#define TYPE_UNPROTOTYPED 2  /* Function declared with () */
+
+typedef struct _type type;
+typedef struct _member member;
+
+struct _type {
+	uint8_t kind;
+	uint8_t flags;
+	uint8_t align;
+	uint16_t size;
+	uint32_t count;   /* Array length (0 if unknown), parameters or members */
+	uint32_t hash;
+	type *base;       /* Pointed to type, element type or return type */
+	type **params;    /* Parameter types of a function */
+	member *members;  /* Members of a struct or union, in declaration order */
+	char *tag;        /* Interned, NULL for an untagged struct or union */
+	node_ref def;     /* Node declaring the tag of a struct or union, or its definition if untagged */
+};
+
+struct _member {
+	char *ident; /* Interned */
+	type *type;
+	uint16_t offset;
+};
+
+void init_types(void);
+type *basic_type(token_type t);
+type *pointer_to(type *base);
+type *array_of(type *elem, uint32_t count);
+type *function_of(type *ret, type **params, uint32_t count, bool prototyped);
+type *specifier_type(node *spec);
+type *declarator_type(type *base, node *d);
+type *declaration_type(node *d);
+type *parameter_type(node *p);
+member *find_member(type *t, char *ident);
+void print_type(type *t);
+
+#endif /* TYPE_H */
@@ -0,0 +1,133 @@
+#include "../inc/arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#define ARENA_ALIGN sizeof(void *)
+#define ALIGN_UP(n, a) (((n) + (a) - 1) & ~((a) - 1))
+#define ARENA_PAGE 4096
+
+struct arena_chunk {
+	arena_chunk *next;
+	uintptr_t pad; /* Keeps the data after the header aligned */
+};
+
+void arena_init(arena *a, size_t chunk_size) {
+	a->chunks = NULL;
+	a->parent = NULL;
+	a->base = NULL;
+	a->limit = NULL;
+	a->ptr = NULL;
+	a->end = NULL;
+	a->chunk_size = chunk_size;
+	a->stats = (arena_stats){ 0 };
+}
+
+/* Reserves the address space up front, nothing is committed until it is used */
+void arena_init_reserved(arena *a, size_t chunk_size, size_t reserve) {
+	arena_init(a, ALIGN_UP(chunk_size, ARENA_PAGE));
+	reserve = ALIGN_UP(reserve, ARENA_PAGE);
+
+	char *p = mmap(NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(p == MAP_FAILED) {
+		fprintf(stderr, "mgcc: unable to reserve %zu bytes\n", reserve);
+		exit(-1);
+	}
+	a->base = p;
+	a->limit = p + reserve;
+	a->ptr = p;
+	a->end = p;
+}
+
+/*
+ * A child of a reserved arena, the parent must outlive it. Only the child
+ * may allocate once it exists, the parent just hands out chunks.
+ */
+void arena_init_child(arena *a, arena *parent) {
+	arena_init(a, parent->chunk_size);
+	a->parent = parent;
+}
+
+/* Adds the child's counts to its parent, the memory stays with the parent */
+void arena_detach_child(arena *a) {
+	arena *p = a->parent;
+	__atomic_fetch_add(&p->stats.count, a->stats.count, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&p->stats.used, a->stats.used, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&p->stats.reserved, a->stats.reserved, __ATOMIC_RELAXED);
+	arena_init_child(a, p);
+}
+
+/* Chunks come from calloc and are never reused, so every allocation starts zeroed */
+static void new_chunk(arena *a, size_t size) {
+	arena_chunk *c = calloc(1, sizeof(arena_chunk) + size);
+	c->next = a->chunks;
+	a->chunks = c;
+	a->ptr = (char *)(c + 1);
+	a->end = a->ptr + size;
+	a->stats.reserved += size;
+}
+
+/* Commits the next part of a reservation, fresh anonymous pages are already zero */
+static void commit_chunk(arena *a, size_t size) {
+	size = ALIGN_UP(size > a->chunk_size ? size : a->chunk_size, ARENA_PAGE);
+	if(size > (size_t)(a->limit - a->end)) {
+		fprintf(stderr, "mgcc: arena reservation exhausted\n");
+		exit(-1);
+	}
+	mprotect(a->end, size, PROT_READ | PROT_WRITE);
+	a->end += size;
+	a->stats.reserved += size;
+}
+
+/* Takes the next chunk of the parent's reservation, any threads may do this at once */
+static void take_chunk(arena *a, size_t size) {
+	arena *p = a->parent;
+	size = ALIGN_UP(size > a->chunk_size ? size : a->chunk_size, ARENA_PAGE);
+	char *c = __atomic_fetch_add(&p->end, size, __ATOMIC_RELAXED);
+	if(c + size > p->limit) {
+		fprintf(stderr, "mgcc: arena reservation exhausted\n");
+		exit(-1);
+	}
+	mprotect(c, size, PROT_READ | PROT_WRITE);
+	a->ptr = c;
+	a->end = c + size;
+	a->stats.reserved += size;
+}
+
+void *arena_alloc(arena *a, size_t size) {
+	size = ALIGN_UP(size, ARENA_ALIGN);
+	if((size_t)(a->end - a->ptr) < size) {
+		if(a->parent != NULL) {
+			take_chunk(a, size);
+		} else if(a->base != NULL) {
+			commit_chunk(a, size - (a->end - a->ptr));
+		} else {
+			/* Anything bigger than a chunk gets a chunk of its own */
+			new_chunk(a, size > a->chunk_size ? size : a->chunk_size);
+		}
+	}
+	void *p = a->ptr;
+	a->ptr += size;
+	a->stats.count++;
+	a->stats.used += size;
+	return p;
+}
+
+/* Frees everything at once, all pointers into the arena become invalid. Children must not be released. */
+void arena_release(arena *a) {
+	if(a->base != NULL) {
+		munmap(a->base, a->limit - a->base);
+	}
+	arena_chunk *c = a->chunks;
+	while(c != NULL) {
+		arena_chunk *next = c->next;
+		free(c);
+		c = next;
+	}
+	arena_init(a, a->chunk_size);
+}
+
+arena_stats arena_get_stats(arena *a) {
+	return a->stats;
+}
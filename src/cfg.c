@@ -0,0 +1,369 @@
+#include "../inc/cfg.h"
+#include <stdlib.h>
+
+/* The builder's scratch arrays, each with an entry per block */
+enum {
+	DFS_STACK,
+	DFS_VISITED,
+	VERTEX,      /* Block with each preorder number */
+	PARENT,      /* Preorder number of the depth first tree parent */
+	PRE,         /* Preorder number of each block */
+	SEMI,
+	LABEL,
+	ANCESTOR,
+	BUCKET,
+	BUCKET_NEXT,
+	PATH,
+	SCRATCH_ARRAYS
+};
+
+static uint32_t *scratch(cfg *g, int i) {
+	return g->work + (size_t)i * g->block_cap;
+}
+
+static bool ends_block(uint8_t op) {
+	return op == IR_JUMP || op == IR_BRANCH || op == IR_BRANCHZ || op == IR_RET;
+}
+
+/* The arrays only ever grow, a cfg reused for a smaller function keeps them */
+static void reserve_blocks(cfg *g, uint32_t count) {
+	if(count <= g->block_cap) {
+		return;
+	}
+	g->block_cap = count;
+	g->blocks = realloc(g->blocks, count * sizeof(basic_block));
+	g->preds = realloc(g->preds, 2 * count * sizeof(block_ref));
+	g->succs = realloc(g->succs, 2 * count * sizeof(block_ref));
+	g->children = realloc(g->children, count * sizeof(block_ref));
+	g->order = realloc(g->order, count * sizeof(block_ref));
+	g->work = realloc(g->work, SCRATCH_ARRAYS * count * sizeof(uint32_t));
+}
+
+static void reserve_triples(cfg *g, uint32_t count) {
+	if(count <= g->triple_cap) {
+		return;
+	}
+	g->triple_cap = count;
+	g->block_of = realloc(g->block_of, count * sizeof(block_ref));
+}
+
+/* A block's last triple that hasn't been deleted, or its first if they all have */
+static triple *last_triple(cfg *g, basic_block *b) {
+	triple_ref t = b->end - 1;
+	while(t > b->start && g->f->code[t].op == IR_NOP) {
+		t--;
+	}
+	return &g->f->code[t];
+}
+
+static void find_blocks(cfg *g) {
+	ir_func *f = g->f;
+	reserve_triples(g, f->count);
+
+	uint32_t count = 0;
+	for(triple_ref t = 0; t < f->count; t++) {
+		if(t == 0 || f->code[t].op == IR_LABEL || ends_block(f->code[t - 1].op)) {
+			count++;
+		}
+		g->block_of[t] = count - 1;
+	}
+
+	reserve_blocks(g, count);
+	g->count = count;
+	for(triple_ref t = 0; t < f->count; t++) {
+		basic_block *b = &g->blocks[g->block_of[t]];
+		if(t == 0 || g->block_of[t - 1] != g->block_of[t]) {
+			*b = (basic_block){ .start = t, .rpo = NO_BLOCK, .idom = NO_BLOCK };
+		}
+		b->end = t + 1;
+	}
+}
+
+/* A block has at most two successors, so they go straight into place */
+static void find_edges(cfg *g) {
+	uint32_t s = 0;
+	for(block_ref i = 0; i < g->count; i++) {
+		basic_block *b = &g->blocks[i];
+		triple *t = last_triple(g, b);
+		bool falls_through = i + 1 < g->count;
+		b->succ = s;
+		switch(t->op) {
+			case IR_JUMP:
+				g->succs[s++] = g->block_of[t->a];
+			break;
+
+			case IR_BRANCH:
+			case IR_BRANCHZ:
+				g->succs[s++] = g->block_of[t->b];
+				if(falls_through && g->block_of[t->b] != i + 1) {
+					g->succs[s++] = i + 1;
+				}
+			break;
+
+			case IR_RET:
+			break;
+
+			default:
+				if(falls_through) {
+					g->succs[s++] = i + 1;
+				}
+			break;
+		}
+		b->succ_count = s - b->succ;
+		for(uint32_t j = b->succ; j < s; j++) {
+			g->blocks[g->succs[j]].pred_count++;
+		}
+	}
+
+	uint32_t p = 0;
+	for(block_ref i = 0; i < g->count; i++) {
+		g->blocks[i].pred = p;
+		scratch(g, DFS_STACK)[i] = p;
+		p += g->blocks[i].pred_count;
+	}
+	for(block_ref i = 0; i < g->count; i++) {
+		basic_block *b = &g->blocks[i];
+		for(uint32_t j = b->succ; j < b->succ + b->succ_count; j++) {
+			g->preds[scratch(g, DFS_STACK)[g->succs[j]]++] = i;
+		}
+	}
+}
+
+/*
+ * Depth first from the entry with an explicit stack of blocks, each with
+ * the number of its successors already visited. Blocks are numbered in
+ * preorder as they are reached, for the dominators, and put in order as
+ * they are finished, the order being reversed at the end.
+ */
+static void number_blocks(cfg *g) {
+	uint32_t *stack = scratch(g, DFS_STACK);
+	uint32_t *visited = scratch(g, DFS_VISITED);
+	uint32_t *vertex = scratch(g, VERTEX);
+	uint32_t *parent = scratch(g, PARENT);
+	uint32_t *pre = scratch(g, PRE);
+	uint32_t sp = 0;
+	uint32_t n = 0;
+	g->order_count = 0;
+	if(g->count == 0) {
+		return;
+	}
+
+	stack[sp] = 0;
+	visited[sp++] = 0;
+	g->blocks[0].rpo = 0;
+	pre[0] = n;
+	parent[n] = 0;
+	vertex[n++] = 0;
+	while(sp > 0) {
+		basic_block *b = &g->blocks[stack[sp - 1]];
+		if(visited[sp - 1] == b->succ_count) {
+			g->order[g->order_count++] = stack[--sp];
+			continue;
+		}
+		block_ref s = g->succs[b->succ + visited[sp - 1]++];
+		if(g->blocks[s].rpo == NO_BLOCK) {
+			g->blocks[s].rpo = 0;
+			pre[s] = n;
+			parent[n] = pre[stack[sp - 1]];
+			vertex[n++] = s;
+			stack[sp] = s;
+			visited[sp++] = 0;
+		}
+	}
+
+	for(uint32_t i = 0, j = g->order_count - 1; i < j; i++, j--) {
+		block_ref t = g->order[i];
+		g->order[i] = g->order[j];
+		g->order[j] = t;
+	}
+	for(uint32_t i = 0; i < g->order_count; i++) {
+		g->blocks[g->order[i]].rpo = i;
+	}
+}
+
+/*
+ * The vertex with the least semidominator on the forest path up from v,
+ * compressing the path on the way. The path is walked with a stack since
+ * it can be as long as the function.
+ */
+static uint32_t eval(cfg *g, uint32_t v) {
+	uint32_t *ancestor = scratch(g, ANCESTOR);
+	uint32_t *label = scratch(g, LABEL);
+	uint32_t *semi = scratch(g, SEMI);
+	uint32_t *path = scratch(g, PATH);
+	if(ancestor[v] == NO_BLOCK) {
+		return v;
+	}
+
+	uint32_t sp = 0;
+	for(uint32_t x = v; ancestor[ancestor[x]] != NO_BLOCK; x = ancestor[x]) {
+		path[sp++] = x;
+	}
+	while(sp > 0) {
+		uint32_t x = path[--sp];
+		if(semi[label[ancestor[x]]] < semi[label[x]]) {
+			label[x] = label[ancestor[x]];
+		}
+		ancestor[x] = ancestor[ancestor[x]];
+	}
+	return label[v];
+}
+
+/*
+ * Lengauer and Tarjan's algorithm with path compression, worked in
+ * preorder numbers. Unlike the iterative algorithms it doesn't go
+ * quadratic when a block with many predecessors ends a long chain, as
+ * after a long else if.
+ */
+static void find_dominators(cfg *g) {
+	uint32_t *vertex = scratch(g, VERTEX);
+	uint32_t *parent = scratch(g, PARENT);
+	uint32_t *pre = scratch(g, PRE);
+	uint32_t *semi = scratch(g, SEMI);
+	uint32_t *label = scratch(g, LABEL);
+	uint32_t *ancestor = scratch(g, ANCESTOR);
+	uint32_t *bucket = scratch(g, BUCKET);
+	uint32_t *bucket_next = scratch(g, BUCKET_NEXT);
+	uint32_t *idom = scratch(g, DFS_STACK);
+	uint32_t n = g->order_count;
+	if(n == 0) {
+		return;
+	}
+
+	for(uint32_t i = 0; i < n; i++) {
+		semi[i] = i;
+		label[i] = i;
+		ancestor[i] = NO_BLOCK;
+		bucket[i] = NO_BLOCK;
+	}
+
+	for(uint32_t w = n - 1; w > 0; w--) {
+		basic_block *b = &g->blocks[vertex[w]];
+		for(uint32_t j = b->pred; j < b->pred + b->pred_count; j++) {
+			if(g->blocks[g->preds[j]].rpo == NO_BLOCK) {
+				continue;
+			}
+			uint32_t u = eval(g, pre[g->preds[j]]);
+			if(semi[u] < semi[w]) {
+				semi[w] = semi[u];
+			}
+		}
+		bucket_next[w] = bucket[semi[w]];
+		bucket[semi[w]] = w;
+		ancestor[w] = parent[w];
+
+		for(uint32_t v = bucket[parent[w]]; v != NO_BLOCK; v = bucket_next[v]) {
+			uint32_t u = eval(g, v);
+			idom[v] = semi[u] < semi[v] ? u : parent[w];
+		}
+		bucket[parent[w]] = NO_BLOCK;
+	}
+
+	for(uint32_t w = 1; w < n; w++) {
+		if(idom[w] != semi[w]) {
+			idom[w] = idom[idom[w]];
+		}
+		g->blocks[vertex[w]].idom = vertex[idom[w]];
+	}
+}
+
+/* Children are listed in reverse postorder and numbered in preorder, so dominance is an interval test */
+static void build_dominator_tree(cfg *g) {
+	for(uint32_t i = 0; i < g->order_count; i++) {
+		basic_block *b = &g->blocks[g->order[i]];
+		b->child_count = 0;
+		b->dom_size = 1;
+		if(b->idom != NO_BLOCK) {
+			g->blocks[b->idom].child_count++;
+		}
+	}
+	uint32_t c = 0;
+	for(uint32_t i = 0; i < g->order_count; i++) {
+		basic_block *b = &g->blocks[g->order[i]];
+		b->child = c;
+		scratch(g, DFS_STACK)[g->order[i]] = c;
+		c += b->child_count;
+	}
+	for(uint32_t i = 1; i < g->order_count; i++) {
+		g->children[scratch(g, DFS_STACK)[g->blocks[g->order[i]].idom]++] = g->order[i];
+	}
+
+	uint32_t *stack = scratch(g, DFS_STACK);
+	uint32_t *preorder = scratch(g, DFS_VISITED);
+	uint32_t sp = 0;
+	uint32_t n = 0;
+	if(g->order_count > 0) {
+		stack[sp++] = 0;
+	}
+	while(sp > 0) {
+		block_ref i = stack[--sp];
+		basic_block *b = &g->blocks[i];
+		b->dom_pre = n;
+		preorder[n++] = i;
+		for(uint32_t j = b->child + b->child_count; j > b->child; j--) {
+			stack[sp++] = g->children[j - 1];
+		}
+	}
+	while(n > 1) {
+		basic_block *b = &g->blocks[preorder[--n]];
+		g->blocks[b->idom].dom_size += b->dom_size;
+	}
+}
+
+/* Everything but the dominators is linear in the size of the function */
+void build_cfg(cfg *g, ir_func *f) {
+	g->f = f;
+	find_blocks(g);
+	find_edges(g);
+	number_blocks(g);
+	find_dominators(g);
+	build_dominator_tree(g);
+}
+
+void release_cfg(cfg *g) {
+	free(g->blocks);
+	free(g->block_of);
+	free(g->preds);
+	free(g->succs);
+	free(g->children);
+	free(g->order);
+	free(g->work);
+	*g = (cfg){ 0 };
+}
+
+/* Every block dominates itself, unreachable blocks dominate and are dominated by nothing */
+bool dominates(cfg *g, block_ref a, block_ref b) {
+	basic_block *x = &g->blocks[a];
+	basic_block *y = &g->blocks[b];
+	if(x->rpo == NO_BLOCK || y->rpo == NO_BLOCK) {
+		return false;
+	}
+	return x->dom_pre <= y->dom_pre && y->dom_pre < x->dom_pre + x->dom_size;
+}
+
+void print_cfg(cfg *g) {
+	printf("cfg %s\n", g->f->ident);
+	for(block_ref i = 0; i < g->count; i++) {
+		basic_block *b = &g->blocks[i];
+		printf("\tb%u %u-%u", i, b->start, b->end - 1);
+		if(b->rpo == NO_BLOCK) {
+			printf(" unreachable");
+		}
+		if(b->idom != NO_BLOCK) {
+			printf(" idom b%u", b->idom);
+		}
+		if(b->pred_count > 0) {
+			printf(" <-");
+			for(uint32_t j = b->pred; j < b->pred + b->pred_count; j++) {
+				printf(" b%u", g->preds[j]);
+			}
+		}
+		if(b->succ_count > 0) {
+			printf(" ->");
+			for(uint32_t j = b->succ; j < b->succ + b->succ_count; j++) {
+				printf(" b%u", g->succs[j]);
+			}
+		}
+		printf("\n");
+	}
+}
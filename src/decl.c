@@ -4,19 +4,76 @@
 #include "../inc/stmt.h"
 #include "../inc/expr.h"
 #include "../inc/table.h"
+#include "../inc/type.h"
+#include "../inc/fold.h"
 #include "../inc/decl.h"
 #include <stdio.h>
 #include <stdlib.h>
 
 node *parse_struct_union(token_type s_or_u);
+static node *parse_function_body(node *def);
+
+/* Set while parsing struct and union members, which are not ordinary identifiers */
+static _Thread_local int member_depth;
+
+/* Function bodies skipped by the top level pass, only ever set on the thread doing it */
+static _Thread_local bool deferring_bodies;
+static deferred_body *deferred;
+static size_t deferred_count;
+static size_t deferred_cap;
+
+/*
+ * While set, a function definition's body is only brace matched and its
+ * token range recorded, leaving the FUNC_DEF_NODE without a statement.
+ */
+void defer_function_bodies(bool defer) {
+	deferring_bodies = defer;
+}
+
+deferred_body *get_deferred_bodies(size_t *count) {
+	*count = deferred_count;
+	return deferred;
+}
+
+static void defer_body(node *def) {
+	if(deferred_count == deferred_cap) {
+		deferred_cap = deferred_cap == 0 ? 64 : deferred_cap * 2;
+		deferred = realloc(deferred, deferred_cap * sizeof(deferred_body));
+	}
+	deferred_body *b = &deferred[deferred_count++];
+	b->def = def;
+	b->start = get_token_index();
+	b->end = skip_braced_tokens();
+	def->direct_declarator.body = deferred_count;
+}
+
+/* Parses a deferred body exactly as it would have been parsed in place, on any thread */
+void parse_deferred_body(deferred_body *b) {
+	set_token_range(b->start, b->end);
+	b->def->direct_declarator.stmt = REF(parse_function_body(b->def));
+	b->def->direct_declarator.body = 0;
+}
+
+/*
+ * Body of a function definition, parsing it first if it was deferred.
+ * Diagnostics from the body are reported now rather than in source order.
+ */
+node *get_function_body(node *def) {
+	if(def->direct_declarator.body != 0) {
+		size_t saved = get_token_index();
+		parse_deferred_body(&deferred[def->direct_declarator.body - 1]);
+		set_token_range(saved, SIZE_MAX);
+	}
+	return NODE(def->direct_declarator.stmt);
+}
 
 token_type get_decl_type(node *d) {
-	if(d->declaration.specifier->type == STRUCT_DECL_NODE) {
+	if(NODE(d->declaration.specifier)->type == STRUCT_DECL_NODE) {
 		return STRUCT;
-	} else if(d->declaration.specifier->type == UNION_DECL_NODE) {
+	} else if(NODE(d->declaration.specifier)->type == UNION_DECL_NODE) {
 		return UNION;
 	} else {
-		return d->declaration.specifier->declaration_spec.s_type;
+		return NODE(d->declaration.specifier)->declaration_spec.s_type;
 	}
 }
 
@@ -26,7 +83,7 @@ token_type get_decl_type(node *d) {
  * 	void char int
  */
 token_type parse_type_specifier(void) {
-	token_type t = get_current_token()->type;
+	token_type t = get_current_type();
 //	print_token_type(t);
 	consume_token();	
 	switch(t) {
@@ -69,6 +126,27 @@ bool is_declaration(token_type t) {
 	}
 }
 
+node *parse_decl_specifiers(void);
+
+/*
+ * signed and unsigned aren't supported yet. They are reported and the
+ * specifier is marked, so nothing is folded as if it were signed. On its
+ * own either one means int.
+ */
+static node *parse_signedness(void) {
+	error("type-specifier not supported");
+	consume_token();
+	node *s = parse_decl_specifiers();
+	if(s == NULL) {
+		s = new_node(DECLARATION_SPEC_NODE);
+		s->declaration_spec.s_type = INT;
+	}
+	if(s->type == DECLARATION_SPEC_NODE) {
+		s->declaration_spec.has_signedness = true;
+	}
+	return s;
+}
+
 /*
  * (Only supports this for now)
  * declaration-specifiers:
@@ -78,7 +156,7 @@ bool is_declaration(token_type t) {
 /* TODO: WIP 18/8 */
 node *parse_decl_specifiers(void) {
 	node *s = NULL; 
-	token_type t = get_current_token()->type;
+	token_type t = get_current_type();
 	switch(t) {
 		case AUTO:
 		case REGISTER:
@@ -99,12 +177,14 @@ node *parse_decl_specifiers(void) {
 		case LONG:
 		case FLOAT:
 		case DOUBLE:
-		case SIGNED:
-		case UNSIGNED:
 			error("type-specifier not supported");
 			consume_token();
 			return parse_decl_specifiers();
 
+		case SIGNED:
+		case UNSIGNED:
+			return parse_signedness();
+
 		case STRUCT:
 		case UNION:
 			consume_token();
@@ -116,7 +196,7 @@ node *parse_decl_specifiers(void) {
 		case VOID:
 		case CHAR:
 			s = new_node(DECLARATION_SPEC_NODE);
-			s->declaration_spec.s_type = get_current_token()->type;
+			s->declaration_spec.s_type = get_current_type();
 			consume_token();
 			return s;
 
@@ -177,29 +257,29 @@ void print_type_specifier(token_type s) {
 void print_decl(node *d) {
 	switch(d->type) {
 		case DECLARATION_NODE:
-			print_decl(d->declaration.declarator);
+			print_decl(NODE(d->declaration.declarator));
 			print_type_specifier(get_decl_type(d));
 			printf("\n");
 			return;
 
 		case DECLARATOR_NODE:
-			print_decl(d->declarator.direct_declarator);
+			print_decl(NODE(d->declarator.direct_declarator));
 			if(d->declarator.is_pointer == true) {
 				printf("pointer to ");
 			}
 		break;
 
 		case IDENTIFIER_NODE:
-			printf("declare %s as ", (char *)d->identifier.tok->attr);
+			printf("declare %s as ", d->constant.tok_str);
 			return;
 
 		case ARRAY_DECL_NODE:
-			print_decl(d->direct_declarator.direct);
+			print_decl(NODE(d->direct_declarator.direct));
 			printf("array of ");
 			return;
 
 		case FUNC_DECL_NODE:
-			print_decl(d->direct_declarator.direct);
+			print_decl(NODE(d->direct_declarator.direct));
 			printf("function returning ");
 			return;
 
@@ -212,20 +292,20 @@ void print_decl(node *d) {
 char *get_decl_identifier(node *d) {
 	switch(d->type) {
 		case DECLARATION_NODE:
-			return get_decl_identifier(d->declaration.declarator);
+			return get_decl_identifier(NODE(d->declaration.declarator));
 			
 		
 		case DECLARATOR_NODE:
-			return get_decl_identifier(d->declarator.direct_declarator);
+			return get_decl_identifier(NODE(d->declarator.direct_declarator));
 
 		case ARRAY_DECL_NODE:
 		case FUNC_DECL_NODE:
 		case FUNC_DEF_NODE:
-			return get_decl_identifier(d->direct_declarator.direct);
+			return get_decl_identifier(NODE(d->direct_declarator.direct));
 			
 
 		case IDENTIFIER_NODE:
-			return (char *)d->identifier.tok->attr;
+			return d->constant.tok_str;
 
 		default:
 			error("Unknown node in declaration.");
@@ -245,14 +325,147 @@ node *parse_parameter_list(void) {
 		} else {
 			consume_token();
 		}
-		tail->next = parse_abstract_declaration();
-		tail = tail->next;
+		tail->next = REF(parse_abstract_declaration());
+		tail = NODE(tail->next);
 	}
 	return head;
 }
 
-//token_type get_decl_type(node *decl) {
-//}
+/* constant-expression of an array declarator, which must be positive */
+static node *parse_array_size(void) {
+	node *n = constant_expr();
+	if(is_constant(n) && (n->constant.is_unsigned ? n->constant.val == 0 : n->constant.val <= 0)) {
+		error("size of array must be positive");
+	}
+	return n;
+}
+
+/* The identifier node a declarator declares, NULL for an abstract declarator */
+node *declarator_identifier(node *d) {
+	while(d != NULL) {
+		switch(d->type) {
+			case DECLARATOR_NODE:
+				d = NODE(d->declarator.direct_declarator);
+			break;
+
+			case ARRAY_DECL_NODE:
+			case FUNC_DECL_NODE:
+			case FUNC_DEF_NODE:
+				d = NODE(d->direct_declarator.direct);
+			break;
+
+			case IDENTIFIER_NODE:
+				return d;
+
+			default:
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+/* The node of a declarator that defines a function, NULL if it isn't a definition */
+node *function_definition(node *d) {
+	while(d != NULL) {
+		switch(d->type) {
+			case DECLARATOR_NODE:
+				d = NODE(d->declarator.direct_declarator);
+			break;
+
+			case ARRAY_DECL_NODE:
+			case FUNC_DECL_NODE:
+				d = NODE(d->direct_declarator.direct);
+			break;
+
+			case FUNC_DEF_NODE:
+				return d;
+
+			default:
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+/* Adds the identifier a declaration declares to the current scope and points it at the symbol */
+static void declare(node *d, type *t) {
+	node *decl = NODE(d->declaration.declarator);
+	node *id = declarator_identifier(decl);
+	if(id != NULL) {
+		token_type s = d->declaration.specifier != 0 ? get_decl_type(d) : INT;
+		id->constant.sym = add_symbol(decl->type, s, id->constant.tok_str, decl, t);
+	}
+}
+
+/* The parameters are declared in a scope of their own around the body */
+static node *parse_function_body(node *def) {
+	enter_scope();
+	for(node *p = NODE(def->direct_declarator.params); p != NULL; p = NODE(p->next)) {
+		declare(p, parameter_type(p));
+	}
+	node *body = parse_compound_statement();
+	exit_scope();
+	return body;
+}
+
+/*
+ * A declarator in parentheses or after a run of '*' is parsed before the
+ * parenthesis or run it is in can be finished, so those wait here. A run
+ * of pointers is given the declarator parsed after it once that ends,
+ * and a parenthesis waits for its ')'. Declarators nested in parameter
+ * lists push above the ones waiting on them.
+ */
+typedef struct {
+	node *head; /* First of a run of pointers, NULL for a parenthesis */
+	node *tail; /* Last of the run, whose direct declarator is pending */
+} declarator_frame;
+
+static _Thread_local declarator_frame *frames;
+static _Thread_local size_t frame_count;
+static _Thread_local size_t frame_cap;
+
+static void push_frame(node *head, node *tail) {
+	if(frame_count == frame_cap) {
+		frame_cap = frame_cap == 0 ? 64 : frame_cap * 2;
+		frames = realloc(frames, frame_cap * sizeof(declarator_frame));
+	}
+	frames[frame_count].head = head;
+	frames[frame_count].tail = tail;
+	frame_count++;
+}
+
+/* Frees the thread's declarator stack, it must be empty */
+void finish_decl_thread(void) {
+	free(frames);
+	frames = NULL;
+	frame_cap = 0;
+}
+
+/* Pushes a run of '*', the current token being the first, which nests to the right */
+static void push_pointers(void) {
+	node *head = new_node(DECLARATOR_NODE);
+	head->declarator.is_pointer = true;
+	consume_token();
+	node *tail = head;
+	while(EXPECT_TOKEN(ASTERISK)) {
+		node *p = new_node(DECLARATOR_NODE);
+		p->declarator.is_pointer = true;
+		consume_token();
+		tail->declarator.direct_declarator = REF(p);
+		tail = p;
+	}
+	push_frame(head, tail);
+}
+
+/* Gives the runs of pointers waiting above base the declarator d, returns the outermost */
+static node *pop_pointers(size_t base, node *d) {
+	while(frame_count > base && frames[frame_count - 1].head != NULL) {
+		declarator_frame *f = &frames[--frame_count];
+		f->tail->declarator.direct_declarator = REF(d);
+		d = f->head;
+	}
+	return d;
+}
 
 /*
  * declarator:
@@ -266,64 +479,73 @@ node *parse_parameter_list(void) {
  * 	Focus on implementing stuff thats actually useful
  */
 node *parse_declarator(node *prev) {
+	size_t base = frame_count;
 	node *d;
 	debug("parse_declarator()");
 
-	switch(get_current_token()->type) {
-		case ASTERISK:
-			d = new_node(DECLARATOR_NODE);
-			d->declarator.is_pointer = true;
-			consume_token();
-			d->declarator.direct_declarator = parse_declarator(NULL);
-		break;	
-		
-		case IDENTIFIER:
-			d = new_node(IDENTIFIER_NODE);
-			d->constant.tok_str = (char *)get_current_token()->attr;
-			consume_token();	
-		break;	
+	/* Each suffix wraps the declarator parsed so far */
+	for(;;) {
+		switch(get_current_type()) {
+			case ASTERISK:
+				push_pointers();
+				prev = NULL;
+			continue;
+			
+			case IDENTIFIER:
+				d = new_node(IDENTIFIER_NODE);
+				d->constant.tok_str = current_token_ident();
+				consume_token();	
+			break;	
 
-		case LPAREN:
-			consume_token();
-			if(prev == NULL) {
-				d = parse_declarator(NULL);
-			    consume_token();	
-			} else {
-				d = new_node(FUNC_DECL_NODE);
-				d->direct_declarator.direct = prev;
-				d->direct_declarator.params = parse_parameter_list();
-				consume_token(); /* rparen */
-				if(EXPECT_TOKEN(LBRACE)) {
-					d->type = FUNC_DEF_NODE;
-					consume_token();
-					d->direct_declarator.stmt = parse_compound_statement();
+			case LPAREN:
+				consume_token();
+				if(prev == NULL) {
+					push_frame(NULL, NULL);
+					continue;
+				} else {
+					d = new_node(FUNC_DECL_NODE);
+					d->direct_declarator.direct = REF(prev);
+					d->direct_declarator.params = REF(parse_parameter_list());
+					consume_token(); /* rparen */
+					/* The body is parsed once the function has been declared */
+					if(EXPECT_TOKEN(LBRACE)) {
+						d->type = FUNC_DEF_NODE;
+					}
 				}
-			}
-		break;
+			break;
 
-		case LBRACK:
-			consume_token();
-			if(prev == NULL) {
-				error("Expected identifier before '[' token.");
-				return NULL;
-			} else {
-				d = new_node(ARRAY_DECL_NODE);
-				d->direct_declarator.direct = prev;
-				d->direct_declarator.params = constant_expr(); /* [x] */
-				consume_token(); /* ] */
-			}
-		break;
+			case LBRACK:
+				consume_token();
+				if(prev == NULL) {
+					error("Expected identifier before '[' token.");
+					frame_count = base;
+					return NULL;
+				} else {
+					d = new_node(ARRAY_DECL_NODE);
+					d->direct_declarator.direct = REF(prev);
+					d->direct_declarator.params = REF(parse_array_size()); /* [x] */
+					consume_token(); /* ] */
+				}
+			break;
 
-		default:
-			return prev;
+			/* The end of a parenthesised declarator or of the whole one */
+			default:
+				prev = pop_pointers(base, prev);
+				if(frame_count == base) {
+					return prev;
+				}
+				frame_count--;
+				consume_token(); /* rparen */
+			continue;
+		}
+		prev = d;
 	}
-	return parse_declarator(d);
 }
 
 node *parse_initializer_list(node *prev) {
 	debug("parse_initializer_list()");
 	node *il = new_node(INITIALIZER_LIST_NODE);
-	il->init_list.head = parse_decl_initializers();//assignment_expr(NULL);
+	il->init_list.head = REF(parse_decl_initializers());//assignment_expr(NULL);
 	il->init_list.tail = il->init_list.head;
 	il->init_list.count++;
 
@@ -334,8 +556,8 @@ node *parse_initializer_list(node *prev) {
 		} else {
 			consume_token();
 		}
-		il->init_list.tail->next = parse_decl_initializers();
-		il->init_list.tail = il->init_list.tail->next;
+		NODE(il->init_list.tail)->next = REF(parse_decl_initializers());
+		il->init_list.tail = NODE(il->init_list.tail)->next;
 		il->init_list.count++;
 	}
 	return il;
@@ -343,7 +565,7 @@ node *parse_initializer_list(node *prev) {
 
 node *parse_decl_initializers(void) {
 	debug("parse_initializers()");
-	if(get_current_token()->type == LBRACE) { /* { */
+	if(get_current_type() == LBRACE) { /* { */
 		consume_token(); /* { */
 	//	printf("consume {\n");
 		node *i = parse_initializer_list(NULL);
@@ -352,13 +574,52 @@ node *parse_decl_initializers(void) {
 		return i;
 	} else {
 		//printf("parse_decl_initializers()\n");
-	//	print_token_type(get_current_token()->type);
+	//	print_token_type(get_current_type());
 		return assignment_expr(NULL);
 	}
 }
 
+/*
+ * enumerator:
+ * 	identifier
+ * 	identifier = constant-expression
+ *
+ * Without a value an enumerator is one more than the last, next holds
+ * what that would be.
+ */
+static node *parse_enumerator(int32_t *next) {
+	if(!EXPECT_TOKEN(IDENTIFIER)) {
+		error("expected identifier");
+		return parse_expr();
+	}
+	node *id = identifier_node();
+	node *e = id;
+	if(EXPECT_TOKEN(ASSIGN)) {
+		e = new_node(ASSIGNMENT_EXPR_NODE);
+		e->expression.o = ASSIGN;
+		consume_token();
+		e->expression.lval = REF(id);
+		node *val = constant_expr();
+		e->expression.rval = REF(val);
+		if(is_constant(val)) {
+			*next = fits_int(val) ? val->constant.val : INT16_MAX + 1;
+		}
+	}
+	if(*next > INT16_MAX) {
+		error("enumerator value is out of range");
+		*next = 0;
+	}
+
+	/* Enumeration constants are ordinary identifiers */
+	id->constant.sym = add_symbol(ENUM_DECL_NODE, INT, id->constant.tok_str, e, basic_type(INT));
+	id->constant.sym->value = *next;
+	(*next)++;
+	return e;
+}
+
 node *parse_enumerator_list(void) {
-	node *head = parse_expr();
+	int32_t next = 0;
+	node *head = parse_enumerator(&next);
 	node *tail = head;
 
 	while(!EXPECT_TOKEN(RBRACE)) {
@@ -367,28 +628,27 @@ node *parse_enumerator_list(void) {
 		} else {
 			consume_token();
 			/* Handles the case of the final enumerator having a comma. */
-			if(get_current_token()->type == RBRACE) {
+			if(get_current_type() == RBRACE) {
 				break;
 			}
 		}
-		tail->next = parse_expr();
-		tail = tail->next;
+		tail->next = REF(parse_enumerator(&next));
+		tail = NODE(tail->next);
 	}
 	return head;
 }
 
 node *parse_enum(void) {
 	node *e = new_node(ENUM_DECL_NODE);	
-	//print_token_type(get_current_token()->type);	
-	if(get_current_token()->type == IDENTIFIER) {
-		e->comp_declarator.identifier = (char *)get_current_token()->attr;
-	//	printf("%s\n", (char *)get_current_token()->attr);
+	//print_token_type(get_current_type());	
+	if(get_current_type() == IDENTIFIER) {
+		e->comp_declarator.identifier = current_token_ident();
 		consume_token();
 	}
 
-	if(get_current_token()->type == LBRACE) {
+	if(get_current_type() == LBRACE) {
 		consume_token();
-		e->comp_declarator.decl_list = parse_enumerator_list();
+		e->comp_declarator.decl_list = REF(parse_enumerator_list());
 		if(!EXPECT_TOKEN(RBRACE)) {
 			error("expected }");
 		} else {
@@ -402,7 +662,7 @@ node *parse_enum(void) {
 
 node *parse_specifier_qualifier_list(void) {
 	node *s = NULL;
-	token_type t = get_current_token()->type;
+	token_type t = get_current_type();
 	switch(t) {
 		case AUTO:
 		case REGISTER:
@@ -423,12 +683,14 @@ node *parse_specifier_qualifier_list(void) {
 		case LONG:
 		case FLOAT:
 		case DOUBLE:
-		case SIGNED:
-		case UNSIGNED:
 			error("type-specifier not supported");
 			consume_token();
 			return parse_decl_specifiers();
 
+		case SIGNED:
+		case UNSIGNED:
+			return parse_signedness();
+
 		case STRUCT:
 		case UNION:
 			consume_token();
@@ -440,7 +702,7 @@ node *parse_specifier_qualifier_list(void) {
 		case VOID:
 		case CHAR:
 			s = new_node(DECLARATION_SPEC_NODE);
-			s->declaration_spec.s_type = get_current_token()->type;
+			s->declaration_spec.s_type = get_current_type();
 			consume_token();
 			return s;
 
@@ -452,17 +714,17 @@ node *parse_specifier_qualifier_list(void) {
 
 node *parse_struct_decl(void) {
 	node *s;
-	if(get_current_token()->type == STRUCT || get_current_token()->type == UNION || get_current_token()->type == ENUM) {
+	if(get_current_type() == STRUCT || get_current_type() == UNION || get_current_type() == ENUM) {
 		s = parse_declaration();
 	} else {
 		s = new_node(DECLARATION_NODE);
-		s->declaration.specifier = parse_specifier_qualifier_list();
+		s->declaration.specifier = REF(parse_specifier_qualifier_list());
 		//if(get_decl_type(s) == STRUCT || get_decl_type(s) == UNION) {
 		//	s->declaration.declarator = parse_declaration();//parse_struct_union(get_decl_type(s));	
 		//} else
 		/*
 		if(get_decl_type(s) == ENUM) {
-			s->declaration.declarator = parse_enum();
+			s->declaration.declarator = REF(parse_enum());
 			if(!EXPECT_TOKEN(SEMI_COLON)) {
 				error("expected ';' at end of declaration");
 				consume_token();
@@ -471,11 +733,11 @@ node *parse_struct_decl(void) {
 			}
 			*/
 		//} else {
-			s->declaration.declarator = parse_declarator(NULL);
-			if(get_current_token()->type == COLON) {
+			s->declaration.declarator = REF(parse_declarator(NULL));
+			if(get_current_type() == COLON) {
 				consume_token();
 				s->type = BITFIELD_DECL_NODE;
-				s->declaration.initialiser = parse_expr();
+				s->declaration.initialiser = REF(parse_expr());
 			}
 		
 			if(!EXPECT_TOKEN(SEMI_COLON)) {
@@ -492,16 +754,42 @@ node *parse_struct_decl(void) {
 }
 
 node *parse_struct_decl_list(void) {
+	member_depth++;
 	node *head = parse_struct_decl();
 	node *tail = head;
 	
-	while(!EXPECT_TOKEN(RBRACE)) {
-		tail->next = parse_struct_decl();
-		tail = tail->next;
+	while(!EXPECT_TOKEN(RBRACE) && !EXPECT_TOKEN(END)) {
+		tail->next = REF(parse_struct_decl());
+		tail = NODE(tail->next);
 	}
+	member_depth--;
 	return head;
 }
 
+/*
+ * A tag names the type declared by the innermost visible declaration of
+ * it, whose node keys the type. A definition, or a declaration with
+ * nothing else, declares a new type unless the tag is already declared
+ * in the current scope.
+ */
+static void declare_tag(node *su) {
+	char *tag = su->comp_declarator.identifier;
+	bool defines = EXPECT_TOKEN(LBRACE);
+	symbol *s = lookup_tag(tag, defines || EXPECT_TOKEN(SEMI_COLON));
+	if(s == NULL) {
+		su->comp_declarator.tag_def = REF(su);
+		s = add_symbol(su->type, su->type == STRUCT_DECL_NODE ? STRUCT : UNION, tag, NULL, specifier_type(su));
+	} else if(s->n_type != su->type) {
+		error("use of tag with the wrong kind of type");
+	} else if(defines && s->params != NULL) {
+		error("redefinition of struct or union");
+	}
+	su->comp_declarator.tag_def = s->ty->def;
+	if(defines) {
+		s->params = su;
+	}
+}
+
 node *parse_struct_union(token_type s_or_u) {
 	node *su;
 	if(s_or_u == STRUCT) {
@@ -510,15 +798,16 @@ node *parse_struct_union(token_type s_or_u) {
 		su = new_node(UNION_DECL_NODE);
 	}
 
-	if(get_current_token()->type == IDENTIFIER) {
-		su->comp_declarator.identifier = (char *)get_current_token()->attr;
+	if(get_current_type() == IDENTIFIER) {
+		su->comp_declarator.identifier = current_token_ident();
 		consume_token();
+		declare_tag(su);
 	}
 
-	//print_token_type(get_current_token()->type);
-	if(get_current_token()->type == LBRACE) {
+	//print_token_type(get_current_type());
+	if(get_current_type() == LBRACE) {
 		consume_token();
-		su->comp_declarator.decl_list = parse_struct_decl_list();
+		su->comp_declarator.decl_list = REF(parse_struct_decl_list());
 		if(!EXPECT_TOKEN(RBRACE)) {
 			error("expected }");
 		} else {
@@ -535,18 +824,18 @@ node *parse_struct_union(token_type s_or_u) {
  */
 node *parse_declaration(void) {
 	debug("parse_declaration()");
-	if(get_current_token()->type == END) {
+	if(get_current_type() == END) {
 		return NULL;
 	}
 	node *d = new_node(DECLARATION_NODE);
-	d->declaration.specifier = parse_decl_specifiers();
-	//print_token_type(get_current_token()->type);
+	d->declaration.specifier = REF(parse_decl_specifiers());
+	//print_token_type(get_current_type());
 	
 	//print_node_type(d->declaration.specifier->type);
 	
 	switch(get_decl_type(d)) {
 		case ENUM:
-			d->declaration.declarator = parse_enum();
+			d->declaration.declarator = REF(parse_enum());
 			
 			if(!EXPECT_TOKEN(SEMI_COLON)) {
 				error("expected ';' at end of declaration");
@@ -558,7 +847,7 @@ node *parse_declaration(void) {
 		/*
 		case STRUCT:
 		case UNION:
-			d->declaration.declarator = parse_struct_union(get_decl_type(d));
+			d->declaration.declarator = REF(parse_struct_union(get_decl_type(d)));
 			if(!EXPECT_TOKEN(SEMI_COLON)) {
 				error("expected ';' at end of declaration");
 			} else {
@@ -568,14 +857,31 @@ node *parse_declaration(void) {
 		*/
 
 		default:
-			d->declaration.declarator = parse_declarator(NULL);
-			if(d->declaration.declarator != NULL) {
-				if(get_current_token()->type == ASSIGN) {
+			d->declaration.declarator = REF(parse_declarator(NULL));
+			/* An identifier is in scope from the end of its declarator */
+			type *t = declaration_type(d);
+			if(member_depth == 0) {
+				declare(d, t);
+			}
+
+			node *def = function_definition(NODE(d->declaration.declarator));
+			if(def != NULL && EXPECT_TOKEN(LBRACE)) {
+				consume_token();
+				if(deferring_bodies) {
+					defer_body(def);
+				} else {
+					def->direct_declarator.stmt = REF(parse_function_body(def));
+				}
+				break;
+			}
+
+			if(d->declaration.declarator != 0) {
+				if(get_current_type() == ASSIGN) {
 					/* parse initializer */
 					consume_token();
-					d->declaration.initialiser = parse_decl_initializers();
+					d->declaration.initialiser = REF(parse_decl_initializers());
 				} 
-			} else {
+			} else if(get_decl_type(d) != STRUCT && get_decl_type(d) != UNION) { /* those may be declared on their own */
 				/* Does this handle branch actually handle abstract decls? */
 				/* UPDATE:
 				 * It does! However this needs to be it's own function
@@ -586,7 +892,7 @@ node *parse_declaration(void) {
 
 			if(!EXPECT_TOKEN(SEMI_COLON)) {
 				if((!EXPECT_TOKEN(COMMA) && !EXPECT_TOKEN(LBRACE))) {
-					if(d->declaration.declarator->type != FUNC_DEF_NODE) {
+					if(d->declaration.declarator == 0 || NODE(d->declaration.declarator)->type != FUNC_DEF_NODE) {
 						error("expected ';' at end of declaration");
 					}
 				} /* otherwise leave it as it's part of a list or function definition */	
@@ -597,8 +903,6 @@ node *parse_declaration(void) {
 	}
 
 
-	/* TODO: dont allow multiple definitions */
-//	add_symbol(d->declaration.declarator->type, get_decl_type(d), get_decl_identifier(d), d->declaration.declarator);
 	return d;
 }
 
@@ -618,50 +922,59 @@ node *parse_abstract_declarator(node *prev);
  * 	direct-abstract-declarator[opt] ( parameter-type-list )
  */
  node *parse_abstract_declarator(node *prev) {
+	size_t base = frame_count;
 	node *d;
 	debug("parse_abstract_declarator()");
-	switch(get_current_token()->type) {
-		case ASTERISK:
-			d = new_node(DECLARATOR_NODE);
-			d->declarator.is_pointer = true;
-			consume_token();
-			d->declarator.direct_declarator = parse_abstract_declarator(NULL);
-		break;	
-		
-		case IDENTIFIER:
-			d = new_node(IDENTIFIER_NODE);
-			d->identifier.tok = get_current_token();
-			consume_token();	
-		break;	
 
-		case LPAREN:
-			consume_token();
-			if(prev == NULL) {
-				d = parse_abstract_declarator(NULL);
-			} else {
+	/* Each suffix wraps the declarator parsed so far, as in parse_declarator */
+	for(;;) {
+		switch(get_current_type()) {
+			case ASTERISK:
+				push_pointers();
+				prev = NULL;
+			continue;
+			
+			case IDENTIFIER:
+				d = new_node(IDENTIFIER_NODE);
+				d->constant.tok_str = current_token_ident();
+				consume_token();	
+			break;	
+
+			case LPAREN:
+				consume_token();
+				if(prev == NULL) {
+					push_frame(NULL, NULL);
+					continue;
+				}
 				d = new_node(FUNC_DECL_NODE);
-				d->direct_declarator.direct = prev;
-				d->direct_declarator.params = parse_parameter_list();
-			}
-			consume_token(); /* rparen */
-		break;
+				d->direct_declarator.direct = REF(prev);
+				d->direct_declarator.params = REF(parse_parameter_list());
+				consume_token(); /* rparen */
+			break;
 
-		case LBRACK:
-			consume_token();
-			d = new_node(ARRAY_DECL_NODE);
-			d->direct_declarator.direct = prev;
-			d->direct_declarator.params = constant_expr(); /* [x] */
-			if(!EXPECT_TOKEN(RBRACK)) {
-				error("expected ']' at end of statement");
-			} else {
-				consume_token(); /* ] */
-			}
-		break;
+			case LBRACK:
+				consume_token();
+				d = new_node(ARRAY_DECL_NODE);
+				d->direct_declarator.direct = REF(prev);
+				d->direct_declarator.params = REF(parse_array_size()); /* [x] */
+				if(!EXPECT_TOKEN(RBRACK)) {
+					error("expected ']' at end of statement");
+				} else {
+					consume_token(); /* ] */
+				}
+			break;
 
-		default:
-			return prev;
+			default:
+				prev = pop_pointers(base, prev);
+				if(frame_count == base) {
+					return prev;
+				}
+				frame_count--;
+				consume_token(); /* rparen */
+			continue;
+		}
+		prev = d;
 	}
-	return parse_abstract_declarator(d);
 }
 
 
@@ -672,23 +985,23 @@ node *parse_abstract_declarator(node *prev);
 node *parse_abstract_declaration(void) {
 	debug("parse_abstract_declaration()");
 	node *d = new_node(DECLARATION_NODE);
-	d->declaration.specifier = parse_decl_specifiers();
+	d->declaration.specifier = REF(parse_decl_specifiers());
 	/* This could be NULL, but that doesn't matter because this is an abstract decl */
-	//print_token_type(get_current_token()->type);
-	d->declaration.declarator = parse_abstract_declarator(NULL);
+	//print_token_type(get_current_type());
+	d->declaration.declarator = REF(parse_abstract_declarator(NULL));
 	return d;
 }
 
 
 
 node *parse_translation_unit(void) {
-	if(get_current_token()->type != END) {
+	if(get_current_type() != END) {
 		node *head = parse_declaration();
 		node *tail = head;
 
 		while(!EXPECT_TOKEN(END)) {
-			tail->next = parse_declaration();
-			tail = tail->next;
+			tail->next = REF(parse_declaration());
+			tail = NODE(tail->next);
 		}
 
 		return head;
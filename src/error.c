@@ -3,30 +3,58 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include "../inc/lex.h"
+#include "../inc/error.h"
 
-#define PRINT_ERROR   printf("\033[1;31merror: ");printf("\033[0m")
-#define PRINT_DEBUG   printf("\033[1;34mmgcc-debug: ");printf("\033[0m")
-#define PRINT_WARNING printf("\033[1;33mwarning: ");printf("\033[0m")
+#define ERROR_PREFIX   "\033[1;31merror: \033[0m"
+#define DEBUG_PREFIX   "\033[1;34mmgcc-debug: \033[0m"
+#define WARNING_PREFIX "\033[1;33mwarning: \033[0m"
+
+#define PRINT_ERROR   printf(ERROR_PREFIX)
 
 bool error_occurred = false;
 bool show_debug = false;
 
+/* When set, diagnostics from this thread are held back instead of printed */
+static _Thread_local diag_buffer *diag_target;
+/* When set, diagnostics from this thread are reported at this line rather than the current token's */
+static _Thread_local int diag_line;
+
 bool has_error_occurred(void) {
-	return error_occurred;
+	return __atomic_load_n(&error_occurred, __ATOMIC_RELAXED);
+}
+
+static void report(char *prefix, char *str) {
+	int line = diag_line != 0 ? diag_line : get_current_line();
+	if(diag_target == NULL) {
+		printf("%sline %d: %s\n", prefix, line, str);
+		return;
+	}
+
+	diag_buffer *b = diag_target;
+	if(b->count == b->cap) {
+		b->cap = b->cap == 0 ? 16 : b->cap * 2;
+		b->diags = realloc(b->diags, b->cap * sizeof(diagnostic));
+	}
+	diagnostic *d = &b->diags[b->count++];
+	d->pos = get_token_index();
+	d->rank = b->rank;
+	/* asprintf isn't standard, size the message first */
+	int len = snprintf(NULL, 0, "%sline %d: %s\n", prefix, line, str);
+	d->msg = malloc(len + 1);
+	snprintf(d->msg, len + 1, "%sline %d: %s\n", prefix, line, str);
 }
 
 void error (char *err_str) {
-  PRINT_ERROR;
-  printf("line %d: %s\n", get_current_token()->line, err_str);
-  //print_token_type(peek_next_token()->type);
-  error_occurred = true;
+  report(ERROR_PREFIX, err_str);
+  //print_token_type(peek_next_type());
+  __atomic_store_n(&error_occurred, true, __ATOMIC_RELAXED);
 };
 
 void warn(char *warn_str) {
-  PRINT_WARNING;
-  printf("line %d: %s\n", get_current_token()->line, warn_str);
+  report(WARNING_PREFIX, warn_str);
 }
 
 void file_error(char *err_str) {
@@ -38,8 +66,56 @@ void file_error(char *err_str) {
 
 void debug(char *debug_str) {
 	if(show_debug == true) {
-		PRINT_DEBUG;
-		printf("line %d: %s\n", get_current_token()->line, debug_str);
+		report(DEBUG_PREFIX, debug_str);
 	}
 }
 
+void set_diagnostic_buffer(diag_buffer *b) {
+	diag_target = b;
+}
+
+/* Passes run after parsing report at the node they are working on, 0 goes back to the current token */
+void set_diagnostic_line(int line) {
+	diag_line = line;
+}
+
+/* Source order, then lower rank first for the same token, then the order they were reported in */
+static int compare_diagnostics(const void *a, const void *b) {
+	const diagnostic *x = a;
+	const diagnostic *y = b;
+	if(x->pos != y->pos) {
+		return x->pos < y->pos ? -1 : 1;
+	}
+	if(x->rank != y->rank) {
+		return x->rank < y->rank ? -1 : 1;
+	}
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+/* Prints the diagnostics held in all of the buffers in source order and empties them */
+void flush_diagnostics(diag_buffer *bufs, size_t n) {
+	size_t total = 0;
+	for(size_t i = 0; i < n; i++) {
+		total += bufs[i].count;
+	}
+
+	diagnostic *all = malloc((total + 1) * sizeof(diagnostic));
+	size_t k = 0;
+	for(size_t i = 0; i < n; i++) {
+		for(size_t j = 0; j < bufs[i].count; j++) {
+			all[k] = bufs[i].diags[j];
+			all[k].seq = k;
+			k++;
+		}
+		free(bufs[i].diags);
+		bufs[i].diags = NULL;
+		bufs[i].count = bufs[i].cap = 0;
+	}
+
+	qsort(all, total, sizeof(diagnostic), compare_diagnostics);
+	for(size_t i = 0; i < total; i++) {
+		fputs(all[i].msg, stdout);
+		free(all[i].msg);
+	}
+	free(all);
+}
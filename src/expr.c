@@ -4,97 +4,61 @@
 #include "../inc/stmt.h"
 #include "../inc/expr.h"
 #include "../inc/decl.h"
+#include "../inc/table.h"
+#include "../inc/type.h"
+#include "../inc/fold.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-int hex_str_to_int(char *str) {
-  return strtoul(str, NULL, 16);
-}
-
-int dec_str_to_int(char *str) {
-  return strtol(str, NULL, 10);
-}
+node *parse_integer_constant(void) {
+	node *n = new_node(INTEGER_CONSTANT_NODE);
+	token t = get_current_token();
+	consume_token(); /* Eat the token */
 
-int oct_str_to_int(char *str) {
-	return strtol(str, NULL, 8);
-}
+	/* The lexer has already decoded the value and suffix */
+	uint8_t flags = t.attr.integer.flags;
+	set_integer_constant(n, t.attr.integer.val, flags & INT_CONST_UNSIGNED, flags & INT_CONST_LONG, flags & INT_CONST_DECIMAL);
 
-int constant_str_to_int(char *str) {
-	int val;
-	if(str[0] == '0') {
-		/* Could be a hex or an octal constant. */
-		if(str[1] == 'x') {
-			val = hex_str_to_int(str);
-		} else {
-			val = oct_str_to_int(str);
-		}
-	} else {
-		val = dec_str_to_int(str);
+	if(flags & INT_CONST_BAD_DIGIT) {
+		error("invalid digit in integer constant");
 	}
-	return val;
-}
-
-void parse_suffix(node *c, char *s) {
-	if(!strcmp(s, "u")) {
-		c->constant.is_unsigned = true;
-	} else if(!strcmp(s, "l")) {
-		c->constant.is_long = true;
-	} else if(!strcmp(s, "U")) {
-		c->constant.is_unsigned = true;
-	} else if(!strcmp(s, "L")) {
-		c->constant.is_long = true;
-	} else if(!strcmp(s, "ul")) { 
-		c->constant.is_unsigned = true;
-		c->constant.is_long = true;
-	} else if(!strcmp(s, "lu")) { 
-		c->constant.is_unsigned = true;
-		c->constant.is_long = true;
-	} else if(!strcmp(s, "UL")) { 
-		c->constant.is_unsigned = true;
-		c->constant.is_long = true;
-	} else if(!strcmp(s, "LU")) { 
-		c->constant.is_unsigned = true;
-		c->constant.is_long = true;
-	} else if(!strcmp(s, "Ul")) { 
-		c->constant.is_unsigned = true;
-		c->constant.is_long = true;
-	} else if(!strcmp(s, "Lu")) { 
-		c->constant.is_unsigned = true;
-		c->constant.is_long = true;
-	} else if(!strcmp(s, "uL")) { 
-		c->constant.is_unsigned = true;
-		c->constant.is_long = true;
-	} else if(!strcmp(s, "lU")) { 
-		c->constant.is_unsigned = true;
-		c->constant.is_long = true;
-	} else {
+	if(flags & INT_CONST_BAD_SUFFIX) {
 		error("invalid suffix on integer constant");
 	}
+	if(flags & INT_CONST_OVERFLOW) {
+		error("integer constant is too large");
+	}
+	return n;
 }
 
-node *parse_integer_constant(void) {
-	node *n = new_node(INTEGER_CONSTANT_NODE);
-	n->constant.tok_str = (char *)get_current_token()->attr;
-	consume_token(); /* Eat the token */
-	n->constant.val = constant_str_to_int(n->constant.tok_str);
-	
-	char *ptr = n->constant.tok_str;
-	
-	while(*ptr) {
-		if(*ptr == 'u' || *ptr == 'U' || *ptr == 'l' || *ptr == 'L') {
-			parse_suffix(n, ptr);
-			break;
+/* An identifier that is not looked up, for members and labels */
+node *identifier_node(void) {
+	node *n = new_node(IDENTIFIER_NODE);
+	n->constant.tok_str = current_token_ident();
+	consume_token();
+	return n;
+}
+
+/* Points an identifier at its declaration. Calling an undeclared function declares it. */
+static void resolve_identifier(node *n) {
+	symbol *s = lookup_symbol(n->constant.tok_str);
+	if(s == NULL) {
+		if(get_current_type() == LPAREN) {
+			warn("implicit declaration of function");
+			s = add_symbol(FUNC_DECL_NODE, INT, n->constant.tok_str, NULL, function_of(basic_type(INT), NULL, 0, false));
 		} else {
-			ptr++;
+			error("undeclared identifier");
 		}
 	}
-	return n;
+	n->constant.sym = s;
 }
 
 node *parse_character_constant(void) {
 	node *n = new_node(CHAR_CONSTANT_NODE);
-	char *c = (char *)get_current_token()->attr;
+	token t = get_current_token();
+	const char *c = token_start(&t);
+	size_t len = t.len;
 	char *err = NULL;
 	int val = 0;
 	consume_token();
@@ -113,19 +77,19 @@ node *parse_character_constant(void) {
 					val = 255; /* set it to the max safe value */
 				}
 				/* octal number: \ooo */
-				if(strlen(c) > 4 || *err != '\0') {
+				if(len > 4 || err != &c[len]) {
 					error("multi-character character constant");
 				}
 			break;
 
 			case 'x':
-				if(c[2] == '\0') {
+				if(len == 2) {
 					error("\\x used with no following hex digits");
 				} else {
 					val = strtol(&c[2], &err, 16);
 					//printf("val = %d\n", val);	
 					/* hex number: \xhh */
-					if(strlen(c) > 4 || *err != '\0') {
+					if(len > 4 || err != &c[len]) {
 						error("multi-character character constant");
 					}
 				}
@@ -180,7 +144,7 @@ node *parse_character_constant(void) {
 			break;
 		}
 	} else {
-		if(strlen(c) > 1) {
+		if(len > 1) {
 			error("multi-character character constant");
 		} else {
 			val = c[0];
@@ -200,8 +164,8 @@ node *parse_character_constant(void) {
  */ 
 node *primary_expr(void) {
 	node *n = NULL;
-	//print_token_type(get_current_token()->type);
-	switch(get_current_token()->type) {
+	//print_token_type(get_current_type());
+	switch(get_current_type()) {
 		case INTEGER_CONST:
 			n = parse_integer_constant();	
 		break;
@@ -211,12 +175,15 @@ node *primary_expr(void) {
 			consume_token();
 			n = new_node(STRING_LITERAL_NODE);
 		
-			if(get_current_token()->type == STRING_LITERAL) {
-				n->constant.tok_str = (char *)get_current_token()->attr;
+			/* The spelling lives as long as the node */
+			if(get_current_type() == STRING_LITERAL) {
+				token t = get_current_token();
+				n->constant.tok_str = new_node_data(t.len + 1);
+				memcpy(n->constant.tok_str, token_start(&t), t.len);
 				consume_token();
 			}
 			
-			if(get_current_token()->type == QUOTE) {
+			if(get_current_type() == QUOTE) {
 				consume_token();
 			} else {
 				error("Missing terminating \" character");
@@ -226,10 +193,10 @@ node *primary_expr(void) {
 		/* character constants */
 		case APOSTROPHE:
 			consume_token();
-			if(get_current_token()->type == CHAR_CONST) {
+			if(get_current_type() == CHAR_CONST) {
 				n = parse_character_constant();
 
-				if(get_current_token()->type != APOSTROPHE) {
+				if(get_current_type() != APOSTROPHE) {
 					error("Missing terminating \' character");
 				} else {
 					consume_token();
@@ -240,15 +207,15 @@ node *primary_expr(void) {
 		break;
 
 		case IDENTIFIER:
-			n = new_node(IDENTIFIER_NODE);
-			n->constant.tok_str = (char *)get_current_token()->attr;
-			consume_token();	
+			n = identifier_node();
+			resolve_identifier(n);
+			fold_identifier(n);
 		break;
 		
 		case LPAREN:
 			consume_token();
 			n = parse_expr();
-			if(get_current_token()->type != RPAREN) {
+			if(get_current_type() != RPAREN) {
 				error("Mismatched parenthesis within expression.");
 			} else {
 				consume_token();
@@ -275,10 +242,10 @@ if(prev == NULL) {
 		prev = assignment_expr(NULL);
 	}
 
-	if(get_current_token()->type == COMMA) {
+	if(get_current_type() == COMMA) {
 		consume_token();
 		node *e = assignment_expr(NULL);
-		prev->next = e;
+		prev->next = REF(e);
 		return parse_argument_expr_list(e);
 	} else {
 		return prev;
@@ -294,8 +261,8 @@ if(prev == NULL) {
 		} else {
 			consume_token();
 		}
-		tail->next = assignment_expr(NULL);
-		tail = tail->next;
+		tail->next = REF(assignment_expr(NULL));
+		tail = NODE(tail->next);
 	}
 	return head;
 }
@@ -314,78 +281,146 @@ node *postfix_expr(node *prev) {
 	if(prev == NULL) {
 		prev = primary_expr();
 	}
-	node *n;
-	switch(get_current_token()->type) {
-		case INCREMENT:
-		case DECREMENT:
-			n = new_node(POSTFIX_EXPR_NODE);
-			n->postfix.o = get_current_token()->type;
-			consume_token();
-			/* 
-			 * Grammar states that the lval is a postfix expression and the previous value will always be a postfix expression. 
-			 * A primary expression is also a postfix expression 
-			 */
-			n->postfix.lval = prev;
-		break;
 
-		/* Array access */
-		case LBRACK:
-			consume_token();
-			n = new_node(ARRAY_ACCESS_NODE);
-			n->postfix.lval = prev;
+	/* Each suffix wraps everything parsed so far */
+	for(;;) {
+		node *n;
+		switch(get_current_type()) {
+			case INCREMENT:
+			case DECREMENT:
+				n = new_node(POSTFIX_EXPR_NODE);
+				n->postfix.o = get_current_type();
+				consume_token();
+				/* 
+				 * Grammar states that the lval is a postfix expression and the previous value will always be a postfix expression. 
+				 * A primary expression is also a postfix expression 
+				 */
+				n->postfix.lval = REF(prev);
+			break;
 
-			if(get_current_token()->type == RBRACK) {
+			/* Array access */
+			case LBRACK:
 				consume_token();
-				error("Expected expression before ']' token.");
-			} else {
-				n->postfix.params = parse_expr();
-				if(get_current_token()->type != RBRACK) {
-					error("Expected ']'");
-					return n;
-				} else {
+				n = new_node(ARRAY_ACCESS_NODE);
+				n->postfix.lval = REF(prev);
+
+				if(get_current_type() == RBRACK) {
 					consume_token();
+					error("Expected expression before ']' token.");
+				} else {
+					n->postfix.params = REF(parse_expr());
+					if(get_current_type() != RBRACK) {
+						error("Expected ']'");
+						return n;
+					} else {
+						consume_token();
+					}
 				}
-			}
-		break;
+			break;
 
-		/* Function call */
-		case LPAREN:
-			consume_token();
-			n = new_node(FUNCTION_CALL_NODE);
-			n->postfix.lval = prev;
+			/* Function call */
+			case LPAREN:
+				consume_token();
+				n = new_node(FUNCTION_CALL_NODE);
+				n->postfix.lval = REF(prev);
+
+				if(get_current_type() == RPAREN) {
+					consume_token();
+				} else {
+					n->postfix.params = REF(parse_argument_expr_list(NULL));
+					if(get_current_type() != RPAREN) {
+						error("Expected ')'");
+						return n;
+					} else {
+						consume_token();
+					}
+				}
+			break;
 
-			if(get_current_token()->type == RPAREN) {
+			/* If the current token is not valid postfix just return the previous node */
+			case DOT:
+			case ARROW:
+				n = new_node(STRUCT_ACCESS_NODE);
+				n->postfix.o = get_current_type();
+				n->postfix.lval = REF(prev);
 				consume_token();
-			} else {
-				n->postfix.params = parse_argument_expr_list(NULL);
-				if(get_current_token()->type != RPAREN) {
-					error("Expected ')'");
-					return n;
+				if(!EXPECT_TOKEN(IDENTIFIER)) {
+					error("expected identifier");
 				} else {
-					consume_token();
+					n->postfix.params = REF(identifier_node());
 				}
-			}
-		break;
+			break;
 
-		/* If the current token is not valid postfix just return the previous node */
-		case DOT:
-		case ARROW:
-			n = new_node(STRUCT_ACCESS_NODE);
-			n->postfix.o = get_current_token()->type;
-			n->postfix.lval = prev;
-			consume_token();
-			if(!EXPECT_TOKEN(IDENTIFIER)) {
-				error("expected identifier");
-			} else {
-				n->postfix.params = primary_expr();
-			}
-		break;
+			default:
+				return prev;
+		}
+		prev = n;
+	}
+}
 
-		default:
-			return prev;
+/*
+ * Prefix operators and casts are read before their operand, so they wait
+ * here until it has been parsed and are then applied innermost first,
+ * folding as they go. Operands with prefixes of their own push above the
+ * ones waiting on them.
+ */
+typedef struct {
+	operation o;
+	node_ref a_decl; /* Type name of a cast, 0 for a unary operator */
+} prefix;
+
+static _Thread_local prefix *prefixes;
+static _Thread_local size_t prefix_count;
+static _Thread_local size_t prefix_cap;
+
+static void push_prefix(operation o, node *a_decl) {
+	if(prefix_count == prefix_cap) {
+		prefix_cap = prefix_cap == 0 ? 64 : prefix_cap * 2;
+		prefixes = realloc(prefixes, prefix_cap * sizeof(prefix));
+	}
+	prefixes[prefix_count].o = o;
+	prefixes[prefix_count].a_decl = REF(a_decl);
+	prefix_count++;
+}
+
+/* Frees the thread's prefix stack, it must be empty */
+void finish_expr_thread(void) {
+	free(prefixes);
+	prefixes = NULL;
+	prefix_cap = 0;
+}
+
+/* Applies the prefixes pushed since base to the operand */
+static node *apply_prefixes(size_t base, node *operand) {
+	while(prefix_count > base) {
+		prefix p = prefixes[--prefix_count];
+		node *n;
+		if(p.a_decl != 0) {
+			if((n = fold_cast(NODE(p.a_decl), operand)) == NULL) {
+				n = new_node(CAST_EXPR_NODE);
+				n->cast.a_decl = p.a_decl;
+				n->cast.expr = REF(operand);
+			}
+		} else if((n = fold_unary(p.o, operand)) == NULL) {
+			n = new_node(UNARY_EXPR_NODE);
+			n->unary.o = p.o;
+			n->unary.rval = REF(operand);
+		}
+		operand = n;
 	}
+	return operand;
+}
 
-	return postfix_expr(n);
+/* ( type-name ), the current token being the parenthesis */
+static void push_cast(void) {
+	consume_token();
+	push_prefix(0, parse_abstract_declaration());
+
+	if(!EXPECT_TOKEN(RPAREN)) {
+		error("expected ')' before expression");
+	} else {
+		consume_token();
+	}
 }
 
 /*
@@ -401,27 +436,36 @@ node *postfix_expr(node *prev) {
  * 	sizeof ( type-name )
  */ 
 node *unary_expr(void) {
-	node *n;
-	switch(get_current_token()->type) {
-		case INCREMENT:
-		case DECREMENT:
-		case AMPER:
-		case ASTERISK:
-		case ADD:
-		case SUB:
-		case TILDE:
-		case NOT:
-			n = new_node(UNARY_EXPR_NODE);
-			n->unary.o = get_current_token()->type;
-			consume_token();
-			n->unary.rval = unary_expr();
-		break;
+	size_t base = prefix_count;
+
+	for(;;) {
+		switch(get_current_type()) {
+			case INCREMENT:
+			case DECREMENT:
+			case AMPER:
+			case ASTERISK:
+			case ADD:
+			case SUB:
+			case TILDE:
+			case NOT:
+				push_prefix(get_current_type(), NULL);
+				consume_token();
+			break;
 
-		default:
-			n = postfix_expr(NULL);
-		break;
+			/* unary-operator cast-expression, ++ and -- only take a unary-expression */
+			case LPAREN:
+				if(prefix_count > base && prefixes[prefix_count - 1].o != INCREMENT
+						&& prefixes[prefix_count - 1].o != DECREMENT
+						&& is_declaration(peek_next_type())) {
+					push_cast();
+					break;
+				}
+				return apply_prefixes(base, postfix_expr(NULL));
+
+			default:
+				return apply_prefixes(base, postfix_expr(NULL));
+		}
 	}
-	return n;
 }
 
 /*
@@ -429,264 +473,70 @@ node *unary_expr(void) {
  * 	unary-expression
  * 	( type-name ) cast-expression
  */
+node *cast_expr(void) {
+	size_t base = prefix_count;
 
-node *cast_expr(node *prev) {
-	if(!EXPECT_TOKEN(LPAREN)) {
-		if(prev == NULL) {
-			return unary_expr();
-		} else {
-			return prev;
-		}
-	} else {
-		if(is_declaration(peek_next_token()->type)) {
-			consume_token();
-			node *c = new_node(CAST_EXPR_NODE);
-			c->cast.a_decl = parse_abstract_declaration();
-			
-			if(!EXPECT_TOKEN(RPAREN)) {
-				error("expected ')' before expression");
-			} else {
-				consume_token();
-			}
-
-			c->cast.expr = cast_expr(NULL);
-			return cast_expr(c);
-		} else {
-			return unary_expr();
-		}	
+	while(EXPECT_TOKEN(LPAREN) && is_declaration(peek_next_type())) {
+		push_cast();
 	}
+	return apply_prefixes(base, unary_expr());
 }
 
 
 /*
+ * Binding power of each binary operator, higher binds tighter. Anything
+ * that is not a binary operator is 0 and ends the expression.
+ */
+static const uint8_t binary_prec[UNKNOWN + 1] = {
+	[ASTERISK] = 10, [DIVIDE] = 10, [MOD] = 10,
+	[ADD] = 9, [SUB] = 9,
+	[LSHIFT] = 8, [RSHIFT] = 8,
+	[GREATER] = 7, [GTEQ] = 7, [LESS] = 7, [LTEQ] = 7,
+	[EQUAL] = 6, [NOTEQ] = 6,
+	[AMPER] = 5,
+	[CARET] = 4,
+	[PIPE] = 3,
+	[LOGAND] = 2,
+	[LOGOR] = 1,
+};
+
+/*
+ * Parses the binary operators binding at least as tightly as min_prec by
+ * precedence climbing. All of them are left associative, so the right
+ * operand only takes operators that bind strictly tighter.
+ *
  * multiplicative-expression:
  * 	cast-expression
  * 	multiplicative-expression * cast-expression
  * 	multiplicative-expression / cast-expression
  * 	multiplicative-expression % cast-expression
- */ 
-node *multiplicative_expr(node *prev) {
-	if(prev == NULL) {
-		prev = cast_expr(NULL);
-	}
-
-	if(get_current_token()->type == DIVIDE || get_current_token()->type == ASTERISK || get_current_token()->type == MOD) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
-		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = cast_expr(NULL);
-		return multiplicative_expr(e);
-	} else {
-		return prev;
-	}
-}
-
-/*
+ *
  * additive-expression:
  * 	multiplicative-expression
  * 	additive-expression + multiplicative-expression
  * 	additive-expression - multiplicative-expression
+ *
+ * and so on through shift, relational, equality, AND, exclusive-OR,
+ * inclusive-OR, logical-AND and logical-OR expressions.
  */
-node *additive_expr(node *prev) {
-	if(prev == NULL) {
-		prev = multiplicative_expr(NULL);
-	}
-
-	//printf("additive_expr(): ");
-	//print_token_type(get_current_token()->type);
-	if (get_current_token()->type == ADD || get_current_token()->type == SUB) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
-		consume_token();
-		e->expression.lval = prev; 
-		e->expression.rval = multiplicative_expr(NULL);
-		return additive_expr(e); 
-	} else {
-		return prev;
-	}
-}
-
-/*
- * shift-expression:
- * 	additive-expression
- * 	shift-expression << additive-expression
- * 	shift-expression >> additive-expression
- */
-node *shift_expr(node *prev) {
-	if(prev == NULL) {
-		prev = additive_expr(NULL);
-	}
-
-	if (get_current_token()->type == LSHIFT || get_current_token()->type == RSHIFT) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
-		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = additive_expr(NULL);
-		return shift_expr(e);
-	} else {
-		return prev;
-	}
-}
-
-/*
- * relational-expression
- * 	shift-expression
- * 	relational-expression < shift-expression
- * 	relational-expression > shift-expression
- * 	relational-expression <= shift-expression
- * 	relational-expression >= shift-expression
- */
-node *relational_expr(node *prev) {
-	if(prev == NULL) {
-		prev = shift_expr(NULL);
-	}
-
-	if (get_current_token()->type == GREATER || get_current_token()->type == GTEQ
-		|| get_current_token()->type == LESS || get_current_token()->type == LTEQ) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
-		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = shift_expr(NULL);
-		return relational_expr(e);
-	} else {
-		return prev;
-	}
-}
-
-/*
- * equality-expression:
- * 	relational-expression
- * 	equality-expression == relational-expression
- * 	equality-expression != relational-expression
- */
-node *equality_expr(node *prev) {
-	if(prev == NULL) {
-		prev = relational_expr(NULL);
-	}
-
-	if (get_current_token()->type == EQUAL || get_current_token()->type == NOTEQ) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
-		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = relational_expr(NULL);
-		return equality_expr(e);
-	} else {
-		return prev;
-	}
-}
-
-/*
- * AND-expression:
- * 	equality-expression
- * 	AND-expression & equality-expression
- */
-node *and_expr(node *prev) {
-	if(prev == NULL) {
-		prev = equality_expr(NULL);
-	}
-
-	if (get_current_token()->type == AMPER) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
-		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = equality_expr(NULL);
-		return and_expr(e);
-	} else {
-		return prev;
-	}
-}
-
-/*
- * exclusive-OR-expression:
- * 	AND-expression
- * 	exclusive-OR-expression ^ AND-expression
- */
-node *xor_expr(node *prev) {
-	if(prev == NULL) {
-		prev = and_expr(NULL);
-	}
-
-	if (get_current_token()->type == CARET) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
-		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = and_expr(NULL);
-		return xor_expr(e);
-	} else {
-		return prev;
-	}
-}
-
-/*
- * inclusive-OR-expression:
- * 	exclusive-OR-expression
- * 	inclusive-OR-expression | exclusive-OR-expression
- */
-node *or_expr(node *prev) {
-	if(prev == NULL) {
-		prev = xor_expr(NULL);
-	}
-
-	if (get_current_token()->type == PIPE) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
-		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = xor_expr(NULL);
-		return or_expr(e);
-	} else {
-		return prev;
-	}
-}
-
-/*
- * logical-AND-expression:
- * 	inclusive-OR-expression
- * 	logical-AND-expression && inclusive-OR-expression
- */
-node *logand_expr(node *prev) {
-	if(prev == NULL) {
-		prev = or_expr(NULL);
-	}
-
-	if (get_current_token()->type == LOGAND) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
-		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = or_expr(NULL);
-		return logand_expr(e);
-	} else {
-		return prev;
-	}
-}
-
-/*
- * logical-OR-expression:
- * 	logical-AND-expression
- * 	logical-OR-expression || logical-AND-expression
- */
-node *logor_expr(node *prev) {
-	if(prev == NULL) {
-		prev = logand_expr(NULL);
-	}
+node *binary_expr(int min_prec) {
+	node *lhs = cast_expr();
+	int prec;
 
-	if (get_current_token()->type == LOGOR) {
-		node *e = new_node(BINARY_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
+	while((prec = binary_prec[get_current_type()]) >= min_prec) {
+		operation o = get_current_type();
 		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = logand_expr(NULL);
-		return logor_expr(e);
-	} else {
-		return prev;
+		node *rhs = binary_expr(prec + 1);
+		node *e = fold_binary(o, lhs, rhs);
+		if(e == NULL) {
+			e = new_node(BINARY_EXPR_NODE);
+			e->expression.o = o;
+			e->expression.lval = REF(lhs);
+			e->expression.rval = REF(rhs);
+		}
+		lhs = e;
 	}
+	return lhs;
 }
 
 /*
@@ -696,15 +546,20 @@ node *logor_expr(node *prev) {
  */
 node *conditional_expr(void) {
 	/* Ternary operation not yet implemented. */
-	return logor_expr(NULL);
+	return binary_expr(1);
 }
 
+/* Folded as it is parsed, so anything left that isn't a constant never will be */
 node *constant_expr(void) {
-	return conditional_expr();
+	node *n = conditional_expr();
+	if(n != NULL && !is_constant(n)) {
+		error("expression is not an integer constant");
+	}
+	return n;
 }
 
-bool is_assignment_operator(token *t) {
-	switch(t->type) {
+bool is_assignment_operator(token_type t) {
+	switch(t) {
 		case ASSIGN:
 		case ADD_ASSIGN:
 		case SUB_ASSIGN:
@@ -733,18 +588,29 @@ node *assignment_expr(node *prev) {
 		prev = conditional_expr();
 	}
 
-	//printf("assignment_expr(): ");
-	//print_token_type(get_current_token()->type);
-	if(is_assignment_operator(get_current_token()) == true) {
+	/*
+	 * Assignment is right associative so every operand but the last is an lval
+	 * waiting for its rval. Until that is known the pending assignments are
+	 * chained through their rval, most recent first.
+	 */
+	node *pending = NULL;
+	while(is_assignment_operator(get_current_type())) {
 		node *e = new_node(ASSIGNMENT_EXPR_NODE);
-		e->expression.o = get_current_token()->type;
+		e->expression.o = get_current_type();
 		consume_token();
-		e->expression.lval = prev;
-		e->expression.rval = assignment_expr(NULL);
-		return assignment_expr(e);
-	} else {
-		return prev;
+		e->expression.lval = REF(prev);
+		e->expression.rval = REF(pending);
+		pending = e;
+		prev = conditional_expr();
+	}
+
+	while(pending != NULL) {
+		node *e = pending;
+		pending = NODE(e->expression.rval);
+		e->expression.rval = REF(prev);
+		prev = e;
 	}
+	return prev;
 }
 
 node *parse_expr(void) {
@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../inc/files.h"
 
 char *input_fname;
@@ -47,18 +51,88 @@ FILE *open_input_file(char *fname) {
   return ifp;
 }
 
+/* Reads the whole stream, growing the buffer as needed so pipes work too. */
 char *read_input_file(FILE *f) {
-  long input_fsize = get_file_size(f);
-  char *ipbuf = (char *)malloc(input_fsize);
-  size_t fs = fread(ipbuf, sizeof(char), input_fsize, f);
-  fclose(f);
+  size_t cap = 4096;
+  size_t len = 0;
+  char *ipbuf = (char *)malloc(cap + INPUT_PADDING);
+  size_t fs;
+
+  while((fs = fread(&ipbuf[len], sizeof(char), cap - len, f)) > 0) {
+    len += fs;
+    if(len == cap) {
+      cap *= 2;
+      ipbuf = realloc(ipbuf, cap + INPUT_PADDING);
+    }
+  }
 
-  if(fs != input_fsize) {
-   	file_error("Input file read error."); 
-	free(ipbuf);
+  if(ferror(f)) {
+    file_error("Input file read error.");
+    fclose(f);
+    free(ipbuf);
     exit(0);
   }
+  fclose(f);
 
-  ipbuf[input_fsize] = '\0';
+  memset(&ipbuf[len], 0, INPUT_PADDING);
   return ipbuf;
 }
+
+/*
+ * Maps the input file straight into memory so the lexer can read it without a copy.
+ * The file is mapped over an anonymous reservation one page larger than the file,
+ * so there is always at least a page of zeroes after the last byte. The first of
+ * those zeroes is the '\0' sentinel the lexer stops on and the rest makes it safe
+ * to read a little past the end of the input.
+ *
+ * Falls back to read_input_file() for anything that can't be mapped (pipes etc).
+ */
+char *map_input_file(char *fname, size_t *size) {
+  int fd = open(fname, O_RDONLY);
+  struct stat st;
+
+  if(fd < 0) {
+    file_error("Input file open error.");
+    return NULL;
+  }
+
+  if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    FILE *ifp = open_input_file(fname);
+    if(ifp == NULL) {
+      return NULL;
+    }
+    char *buf = read_input_file(ifp);
+    *size = strlen(buf);
+    return buf;
+  }
+
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t fsize = st.st_size;
+  size_t len = ((fsize + page - 1) & ~(page - 1)) + page;
+
+  char *buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(buf == MAP_FAILED) {
+    close(fd);
+    file_error("Input file map error.");
+    return NULL;
+  }
+
+  if(fsize > 0) {
+    int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE; /* fault the whole file in up front */
+#endif
+    if(mmap(buf, fsize, PROT_READ, flags, fd, 0) == MAP_FAILED) {
+      munmap(buf, len);
+      close(fd);
+      file_error("Input file map error.");
+      return NULL;
+    }
+    madvise(buf, fsize, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  *size = fsize;
+  return buf;
+}
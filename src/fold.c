@@ -0,0 +1,219 @@
+#include "../inc/fold.h"
+#include "../inc/node.h"
+#include "../inc/table.h"
+#include "../inc/type.h"
+#include "../inc/error.h"
+
+#define INT_BITS 16
+#define LONG_BITS 32
+
+bool is_constant(node *n) {
+	return n != NULL && (n->type == INTEGER_CONSTANT_NODE || n->type == CHAR_CONSTANT_NODE);
+}
+
+/* Character constants have type int, so are never unsigned or long */
+static int64_t value_of(node *n) {
+	if(n->constant.is_long) {
+		return n->constant.is_unsigned ? (int64_t)(uint32_t)n->constant.val : (int64_t)(int32_t)n->constant.val;
+	}
+	return n->constant.is_unsigned ? (int64_t)(uint16_t)n->constant.val : (int64_t)(int16_t)n->constant.val;
+}
+
+/* The value converted to the type, wrapping around like the target */
+static int64_t convert(uint64_t v, bool is_unsigned, bool is_long) {
+	if(is_long) {
+		return is_unsigned ? (int64_t)(uint32_t)v : (int64_t)(int32_t)(uint32_t)v;
+	}
+	return is_unsigned ? (int64_t)(uint16_t)v : (int64_t)(int16_t)(uint16_t)v;
+}
+
+/* Makes n an integer constant holding v converted to the type */
+static node *set_value(node *n, uint64_t v, bool is_unsigned, bool is_long) {
+	n->type = INTEGER_CONSTANT_NODE;
+	n->constant.val = (int)convert(v, is_unsigned, is_long);
+	n->constant.is_unsigned = is_unsigned;
+	n->constant.is_long = is_long;
+	n->constant.tok_str = NULL;
+	n->constant.sym = NULL;
+	return n;
+}
+
+bool fits_int(node *n) {
+	int64_t v = value_of(n);
+	return v >= INT16_MIN && v <= INT16_MAX;
+}
+
+/*
+ * An integer constant's type is the first that can hold it of:
+ * 	decimal		int, long, unsigned long
+ * 	octal or hex	int, unsigned int, long, unsigned long
+ * 	u suffix	unsigned int, unsigned long
+ * 	l suffix	long, unsigned long
+ * 	ul suffix	unsigned long
+ */
+void set_integer_constant(node *n, uint32_t val, bool is_unsigned, bool is_long, bool decimal) {
+	if(!is_long && !is_unsigned && val <= INT16_MAX) {
+		set_value(n, val, false, false);
+	} else if(!is_long && (is_unsigned || !decimal) && val <= UINT16_MAX) {
+		set_value(n, val, true, false);
+	} else if(!is_unsigned && val <= INT32_MAX) {
+		set_value(n, val, false, true);
+	} else {
+		set_value(n, val, true, true);
+	}
+}
+
+/* Enumeration constants are replaced by their value */
+node *fold_identifier(node *n) {
+	symbol *s = n->constant.sym;
+	if(s == NULL || s->n_type != ENUM_DECL_NODE) {
+		return NULL;
+	}
+	return set_value(n, s->value, false, false);
+}
+
+node *fold_unary(operation o, node *operand) {
+	if(!is_constant(operand)) {
+		return NULL;
+	}
+	int64_t v = value_of(operand);
+	bool is_unsigned = operand->constant.is_unsigned;
+	bool is_long = operand->constant.is_long;
+
+	switch(o) {
+		case ADD:
+			return set_value(operand, v, is_unsigned, is_long);
+		case SUB:
+			return set_value(operand, -(uint64_t)v, is_unsigned, is_long);
+		case TILDE:
+			return set_value(operand, ~(uint64_t)v, is_unsigned, is_long);
+		case NOT:
+			return set_value(operand, v == 0, false, false);
+		default:
+			return NULL;
+	}
+}
+
+/*
+ * Only casts to integer types are folded, plain char is signed on the
+ * target. Types have no signedness yet, so a cast that names signed or
+ * unsigned is left alone rather than folded as a signed one.
+ */
+node *fold_cast(node *a_decl, node *operand) {
+	node *spec = NODE(a_decl->declaration.specifier);
+	if(!is_constant(operand) || (spec != NULL && spec->type == DECLARATION_SPEC_NODE && spec->declaration_spec.has_signedness)) {
+		return NULL;
+	}
+	int64_t v = value_of(operand);
+
+	switch(declaration_type(a_decl)->kind) {
+		case TYPE_CHAR:
+			return set_value(operand, (int8_t)v, false, false);
+		case TYPE_INT:
+			return set_value(operand, v, false, false);
+		case TYPE_LONG:
+			return set_value(operand, v, false, true);
+		default:
+			return NULL;
+	}
+}
+
+node *fold_binary(operation o, node *l, node *r) {
+	if(!is_constant(l)) {
+		return NULL;
+	}
+	int64_t a = value_of(l);
+
+	/* The right operand is never evaluated when the left decides the result */
+	if(o == LOGAND && a == 0) {
+		return set_value(l, 0, false, false);
+	} else if(o == LOGOR && a != 0) {
+		return set_value(l, 1, false, false);
+	}
+
+	if(!is_constant(r)) {
+		return NULL;
+	}
+	int64_t b = value_of(r);
+	bool is_unsigned = l->constant.is_unsigned;
+	bool is_long = l->constant.is_long;
+
+	switch(o) {
+		case LOGAND:
+		case LOGOR:
+			return set_value(l, b != 0, false, false);
+
+		/* A shift has the type of its left operand */
+		case LSHIFT:
+		case RSHIFT:
+			if(b < 0 || b >= (is_long ? LONG_BITS : INT_BITS)) {
+				warn("shift count is out of range");
+				return NULL;
+			}
+			return set_value(l, o == LSHIFT ? (uint64_t)a << b : (uint64_t)(a >> b), is_unsigned, is_long);
+
+		default:
+		break;
+	}
+
+	/*
+	 * Usual arithmetic conversions. long holds every unsigned int, so
+	 * mixing the two gives long.
+	 */
+	is_long = l->constant.is_long || r->constant.is_long;
+	if(is_long) {
+		is_unsigned = (l->constant.is_long && l->constant.is_unsigned) || (r->constant.is_long && r->constant.is_unsigned);
+	} else {
+		is_unsigned = l->constant.is_unsigned || r->constant.is_unsigned;
+	}
+	a = convert(a, is_unsigned, is_long);
+	b = convert(b, is_unsigned, is_long);
+
+	uint64_t v;
+	switch(o) {
+		case ASTERISK:
+			v = (uint64_t)a * (uint64_t)b;
+		break;
+		case DIVIDE:
+		case MOD:
+			if(b == 0) {
+				warn("division by zero");
+				return NULL;
+			}
+			v = o == DIVIDE ? a / b : a % b;
+		break;
+		case ADD:
+			v = (uint64_t)a + (uint64_t)b;
+		break;
+		case SUB:
+			v = (uint64_t)a - (uint64_t)b;
+		break;
+		case AMPER:
+			v = a & b;
+		break;
+		case CARET:
+			v = a ^ b;
+		break;
+		case PIPE:
+			v = a | b;
+		break;
+
+		/* Comparisons give an int */
+		case LESS:
+			return set_value(l, a < b, false, false);
+		case GREATER:
+			return set_value(l, a > b, false, false);
+		case LTEQ:
+			return set_value(l, a <= b, false, false);
+		case GTEQ:
+			return set_value(l, a >= b, false, false);
+		case EQUAL:
+			return set_value(l, a == b, false, false);
+		case NOTEQ:
+			return set_value(l, a != b, false, false);
+
+		default:
+			return NULL;
+	}
+	return set_value(l, v, is_unsigned, is_long);
+}
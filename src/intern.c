@@ -0,0 +1,87 @@
+#include "../inc/intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_INITIAL_SIZE 1024 /* Must be a power of two */
+#define STRING_POOL_CHUNK 65536
+
+/* Open addressing table of every distinct string seen so far */
+typedef struct {
+	char *str;
+	uint32_t hash;
+	uint32_t len;
+} intern_entry;
+
+static intern_entry *table;
+static size_t table_size;
+static size_t table_count;
+
+/* Interned strings are packed into large chunks rather than allocated one by one */
+static char *pool;
+static size_t pool_left;
+
+/* FNV-1a */
+static uint32_t intern_hash(const char *s, size_t len) {
+	uint32_t h = 2166136261u;
+	for(size_t i = 0; i < len; i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static char *pool_copy(const char *s, size_t len) {
+	if(len + 1 > pool_left) {
+		size_t size = len + 1 > STRING_POOL_CHUNK ? len + 1 : STRING_POOL_CHUNK;
+		pool = malloc(size);
+		pool_left = size;
+	}
+	char *str = pool;
+	memcpy(str, s, len);
+	str[len] = '\0';
+	pool += len + 1;
+	pool_left -= len + 1;
+	return str;
+}
+
+static void grow_table(void) {
+	intern_entry *old = table;
+	size_t old_size = table_size;
+
+	table_size = old_size == 0 ? INTERN_INITIAL_SIZE : old_size * 2;
+	table = calloc(table_size, sizeof(intern_entry));
+
+	for(size_t i = 0; i < old_size; i++) {
+		if(old[i].str != NULL) {
+			size_t j = old[i].hash & (table_size - 1);
+			while(table[j].str != NULL) {
+				j = (j + 1) & (table_size - 1);
+			}
+			table[j] = old[i];
+		}
+	}
+	free(old);
+}
+
+char *intern(const char *s, size_t len) {
+	/* Keep the load factor at or below one half */
+	if((table_count + 1) * 2 > table_size) {
+		grow_table();
+	}
+
+	uint32_t h = intern_hash(s, len);
+	size_t i = h & (table_size - 1);
+
+	while(table[i].str != NULL) {
+		if(table[i].hash == h && table[i].len == len && !memcmp(table[i].str, s, len)) {
+			return table[i].str;
+		}
+		i = (i + 1) & (table_size - 1);
+	}
+
+	table[i].str = pool_copy(s, len);
+	table[i].hash = h;
+	table[i].len = len;
+	table_count++;
+	return table[i].str;
+}
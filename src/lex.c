@@ -8,15 +8,65 @@
 #include <stdlib.h>
 #include "../inc/lex.h"
 #include "../inc/error.h"
+#include "../inc/intern.h"
 
 #define READ_LEX_HEAD *source_ptr
 #define CONSUME_CHAR(n) source_ptr+=(n)
 
-token_type prev_type;
-
 static int line = 1;
-static char *source;
+static char *source; /* Points directly into the mapped input file */
 static char *source_ptr;
+static size_t source_len;
+
+/*
+ * Character classes for the table driven lexer. Each punctuator character
+ * has a class of its own so the DFA below can tell them apart.
+ */
+enum {
+  CC_OTHER = 0,
+  CC_NUL,
+  CC_SPACE,
+  CC_NEWLINE,
+  CC_DIGIT, /* CC_DIGIT and CC_ALPHA must stay next to each other */
+  CC_ALPHA,
+  CC_QUOTE,
+  CC_APOSTROPHE,
+  CC_LBRACK, CC_RBRACK, CC_LBRACE, CC_RBRACE, CC_LPAREN, CC_RPAREN,
+  CC_DOT, CC_COMMA, CC_SEMI_COLON, CC_COLON, CC_TILDE, CC_QMARK,
+  CC_PLUS, CC_MINUS, CC_STAR, CC_SLASH, CC_PERCENT,
+  CC_LESS, CC_GREATER, CC_EQUAL, CC_NOT, CC_AMPER, CC_PIPE, CC_CARET,
+  NUM_CHAR_CLASSES
+};
+
+#define IS_IDENTIFIER_CLASS(c) ((unsigned)((c) - CC_DIGIT) <= (CC_ALPHA - CC_DIGIT))
+
+static const uint8_t char_class[256] = {
+  ['\0'] = CC_NUL,
+  [' '] = CC_SPACE, ['\t'] = CC_SPACE,
+  ['\n'] = CC_NEWLINE,
+  ['0'] = CC_DIGIT, ['1'] = CC_DIGIT, ['2'] = CC_DIGIT, ['3'] = CC_DIGIT, ['4'] = CC_DIGIT,
+  ['5'] = CC_DIGIT, ['6'] = CC_DIGIT, ['7'] = CC_DIGIT, ['8'] = CC_DIGIT, ['9'] = CC_DIGIT,
+  ['a'] = CC_ALPHA, ['b'] = CC_ALPHA, ['c'] = CC_ALPHA, ['d'] = CC_ALPHA, ['e'] = CC_ALPHA,
+  ['f'] = CC_ALPHA, ['g'] = CC_ALPHA, ['h'] = CC_ALPHA, ['i'] = CC_ALPHA, ['j'] = CC_ALPHA,
+  ['k'] = CC_ALPHA, ['l'] = CC_ALPHA, ['m'] = CC_ALPHA, ['n'] = CC_ALPHA, ['o'] = CC_ALPHA,
+  ['p'] = CC_ALPHA, ['q'] = CC_ALPHA, ['r'] = CC_ALPHA, ['s'] = CC_ALPHA, ['t'] = CC_ALPHA,
+  ['u'] = CC_ALPHA, ['v'] = CC_ALPHA, ['w'] = CC_ALPHA, ['x'] = CC_ALPHA, ['y'] = CC_ALPHA,
+  ['z'] = CC_ALPHA,
+  ['A'] = CC_ALPHA, ['B'] = CC_ALPHA, ['C'] = CC_ALPHA, ['D'] = CC_ALPHA, ['E'] = CC_ALPHA,
+  ['F'] = CC_ALPHA, ['G'] = CC_ALPHA, ['H'] = CC_ALPHA, ['I'] = CC_ALPHA, ['J'] = CC_ALPHA,
+  ['K'] = CC_ALPHA, ['L'] = CC_ALPHA, ['M'] = CC_ALPHA, ['N'] = CC_ALPHA, ['O'] = CC_ALPHA,
+  ['P'] = CC_ALPHA, ['Q'] = CC_ALPHA, ['R'] = CC_ALPHA, ['S'] = CC_ALPHA, ['T'] = CC_ALPHA,
+  ['U'] = CC_ALPHA, ['V'] = CC_ALPHA, ['W'] = CC_ALPHA, ['X'] = CC_ALPHA, ['Y'] = CC_ALPHA,
+  ['Z'] = CC_ALPHA, ['_'] = CC_ALPHA,
+  ['"'] = CC_QUOTE, ['\''] = CC_APOSTROPHE,
+  ['['] = CC_LBRACK, [']'] = CC_RBRACK, ['{'] = CC_LBRACE, ['}'] = CC_RBRACE,
+  ['('] = CC_LPAREN, [')'] = CC_RPAREN,
+  ['.'] = CC_DOT, [','] = CC_COMMA, [';'] = CC_SEMI_COLON, [':'] = CC_COLON,
+  ['~'] = CC_TILDE, ['?'] = CC_QMARK,
+  ['+'] = CC_PLUS, ['-'] = CC_MINUS, ['*'] = CC_STAR, ['/'] = CC_SLASH, ['%'] = CC_PERCENT,
+  ['<'] = CC_LESS, ['>'] = CC_GREATER, ['='] = CC_EQUAL, ['!'] = CC_NOT,
+  ['&'] = CC_AMPER, ['|'] = CC_PIPE, ['^'] = CC_CARET,
+};
 
 int get_line(void) {
   return line;
@@ -26,154 +76,180 @@ void inc_line(void) {
   line++;
 }
 
-bool is_valid_identifier(char n) {
-  if(((n >= 'a') && (n <= 'z')) || ((n >= 'A') && (n <= 'Z')) || (n == '_') || ((n >= '0') && (n <= '9'))) {
-    return true;
-  } else {
-    return false;
-  }
-}
-
-bool is_valid_integer_constant(char n) {
-  if(((n >= '0') && (n <= '9')) || ((n >= 'A') && (n <= 'F')) || ((n >= 'a') && (n <= 'f'))) {
-    return true;
-  } else {
-    return false;
-  }
-}
-
-char *lex_identifier(void) {
+/* Returns the length of the identifier at the lex head */
+size_t lex_identifier(void) {
   size_t id_len = 0;
-  char *id_start = source_ptr;
+  const unsigned char *ptr = (const unsigned char *)source_ptr;
 
-  char *ptr = id_start;
-  while(is_valid_identifier(*ptr)) {
+  while(IS_IDENTIFIER_CLASS(char_class[*ptr])) {
     ptr++;
     id_len++;
   }
 
-  char *id_str = malloc(id_len);
-  memcpy(id_str, id_start, id_len);
-  id_str[id_len] = '\0';
   CONSUME_CHAR(id_len);
-
-  return id_str;
+  return id_len;
 }
 
-token_type match_keyword(char *s) {
-  size_t id_len = strlen(s);
-  for(int i = 0; i < NUM_KEYWORDS; i++) {
-    if(id_len == strlen(keywords[i])) {
-      if(!strcmp(s, keywords[i])) {
-        return i;
-      }
-    }
+/*
+ * Perfect hash of the keywords on their length, first and last character.
+ * Every keyword lands in its own slot so classifying an identifier costs one
+ * table lookup and a single comparison. If a keyword is ever added the
+ * multipliers must be searched again so that there are no collisions.
+ */
+#define KEYWORD_HASH_SIZE 64
+#define KEYWORD_HASH(s, len) ((((len) * 5) + ((unsigned char)(s)[0] * 14) + ((unsigned char)(s)[(len) - 1] * 5)) & (KEYWORD_HASH_SIZE - 1))
+#define MIN_KEYWORD_LEN 2
+#define MAX_KEYWORD_LEN 8
+
+typedef struct {
+  const char *name;
+  size_t len;
+  token_type type;
+} keyword_entry;
+
+static const keyword_entry keyword_hash[KEYWORD_HASH_SIZE] = {
+  [0] = { "return", 6, RETURN },
+  [2] = { "unsigned", 8, UNSIGNED },
+  [6] = { "if", 2, IF },
+  [7] = { "const", 5, CONST },
+  [10] = { "extern", 6, EXTERN },
+  [11] = { "continue", 8, CONTINUE },
+  [12] = { "break", 5, BREAK },
+  [13] = { "auto", 4, AUTO },
+  [15] = { "double", 6, DOUBLE },
+  [17] = { "int", 3, INT },
+  [19] = { "else", 4, ELSE },
+  [20] = { "while", 5, WHILE },
+  [21] = { "volatile", 8, VOLATILE },
+  [23] = { "static", 6, STATIC },
+  [28] = { "signed", 6, SIGNED },
+  [29] = { "for", 3, FOR },
+  [30] = { "register", 8, REGISTER },
+  [31] = { "default", 7, DEFAULT },
+  [33] = { "goto", 4, GOTO },
+  [37] = { "union", 5, UNION },
+  [39] = { "short", 5, SHORT },
+  [44] = { "struct", 6, STRUCT },
+  [45] = { "do", 2, DO },
+  [48] = { "switch", 6, SWITCH },
+  [49] = { "float", 5, FLOAT },
+  [55] = { "case", 4, CASE },
+  [56] = { "char", 4, CHAR },
+  [57] = { "typedef", 7, TYPEDEF },
+  [59] = { "enum", 4, ENUM },
+  [60] = { "void", 4, VOID },
+  [63] = { "long", 4, LONG },
+};
+
+token_type match_keyword(const char *s, size_t id_len) {
+  if(id_len < MIN_KEYWORD_LEN || id_len > MAX_KEYWORD_LEN) {
+    return IDENTIFIER;
+  }
+
+  const keyword_entry *k = &keyword_hash[KEYWORD_HASH(s, id_len)];
+  if(k->len == id_len && !memcmp(s, k->name, id_len)) {
+    return k->type;
   }
   return IDENTIFIER;
 }
 
-
-
-bool is_valid_suffix(char s) {
-	switch(s) {
-		case 'u':
-		case 'U':
-		case 'l':
-		case 'L':
-			return true;
-		default:
-			return false;
-	}
+/* Value of a digit in bases up to 16, or 16 if n is not a digit at all */
+static inline unsigned digit_value(char n) {
+  if(n >= '0' && n <= '9') {
+    return n - '0';
+  } else if(n >= 'a' && n <= 'f') {
+    return n - 'a' + 10;
+  } else if(n >= 'A' && n <= 'F') {
+    return n - 'A' + 10;
+  }
+  return 16;
 }
 
 /*
- * Lex an integer constant in accordance with A2.5.1
- * Returns a pointer to the string including any suffixes, or hex prefixes
- */ 
-char *lex_integer_constant(void) {
-  size_t ic_len = 0;
-  char *ic_start = source_ptr;
-  char *ptr = ic_start;
- 
-  /* Handle hex prefix if present */
+ * Lex an integer constant in accordance with A2.5.1, decoding its value and
+ * suffix into the token as the digits are scanned. Integer constants are:
+ * 	octal if they have a leading zero (01234)
+ * 	hex if they begin with 0x (0x1234)
+ * 	decimal if beginning with non-zero (1234)
+ * Returns the length of the constant including any suffixes, or hex prefixes
+ */
+size_t lex_integer_constant(token *t) {
+  const char *ptr = source_ptr;
+  unsigned base = 10;
+  unsigned d;
+  uint64_t val = 0;
+  uint8_t flags = 0;
+
   if(*ptr == '0') {
-	  if(ptr[1] == 'x') {
-		  ptr += 2;
-		  ic_len += 2;
-	  }
+    if(ptr[1] == 'x' || ptr[1] == 'X') {
+      base = 16;
+      ptr += 2;
+    } else {
+      base = 8;
+    }
+  } else {
+    flags |= INT_CONST_DECIMAL;
   }
 
-  /* 0-9, a-f, A-F */
-  while(is_valid_integer_constant(*ptr)) {
-	ptr++;
-    ic_len++;
+  /* 0-9, a-f, A-F are all taken as part of the constant, the value stops at the first bad digit */
+  while((d = digit_value(*ptr)) < 16) {
+    if(d >= base) {
+      flags |= INT_CONST_BAD_DIGIT;
+    }
+    if(!(flags & (INT_CONST_BAD_DIGIT | INT_CONST_OVERFLOW))) {
+      val = val * base + d;
+      if(val > UINT32_MAX) {
+        flags |= INT_CONST_OVERFLOW;
+      }
+    }
+    ptr++;
   }
 
-  /* this will accept invalid suffixes such as uuullllll etc but the parser will catch this. */
-  while(is_valid_suffix(*ptr)) {
-	  ptr++;
-	  ic_len++;
+  /* A suffix is at most one u and one l in either order or case */
+  int n_unsigned = 0, n_long = 0;
+  for(;;) {
+    if(*ptr == 'u' || *ptr == 'U') {
+      n_unsigned++;
+    } else if(*ptr == 'l' || *ptr == 'L') {
+      n_long++;
+    } else {
+      break;
+    }
+    ptr++;
   }
-
-  char *ic_str = malloc(ic_len + 1);
-  memcpy(ic_str, ic_start, ic_len);
-  CONSUME_CHAR(ic_len);
-  ic_str[ic_len] = '\0';
- // printf("%s\n", ic_str);	
-  return ic_str;
-}
-  /* This should be done by the parser to handle any suffixes */
-  /*
-   * Integer constants are considered as:
-   * 	octal if they have a leading zero (01234)
-   * 	hex if they begin with 0x (0x1234)
-   * 	decimal if beginning with non-zero (1234)
- 
-  if(ic_str[0] == '0') {
-	  if(ic_str[1] == 'x') {
-	    val = hex_str_to_int(ic_str);
-	  } else {
-		val = oct_str_to_int(ic_str);
-	  }
+  if(n_unsigned > 1 || n_long > 1) {
+    flags |= INT_CONST_BAD_SUFFIX;
   } else {
-	  val = dec_str_to_int(ic_str);
+    flags |= (n_unsigned ? INT_CONST_UNSIGNED : 0) | (n_long ? INT_CONST_LONG : 0);
   }
-  // Temp string no longer needed
-  free(ic_str);
- 
-  // The attributes of a token are stored in a void pointer so allocate space for an int and copy in 
-  int *val_ptr = malloc(sizeof(int));
-  memcpy(val_ptr, &val, sizeof(int));
 
+  t->attr.integer.val = (uint32_t)val;
+  t->attr.integer.flags = flags;
 
-  return val_ptr;
+  size_t ic_len = ptr - source_ptr;
+  CONSUME_CHAR(ic_len);
+  return ic_len;
 }
-*/
 
-char *lex_string(void) {
+size_t lex_string(void) {
   size_t len = 0;
-  char *start = source_ptr;
-  char *ptr = start;
-
-  /* Handles L"..." string literal */
-  if(*ptr == 'L') {
-	  len++;
-  }
+  char *ptr = source_ptr;
 
   for(int i = 0; i < MAX_STRING_LITERAL_LEN; i++) {
     if(*ptr == '"' || *ptr == '\0') {
 		break;
     }
+    /* An escaped quote doesn't end the string */
+    if(*ptr == '\\' && ptr[1] != '\0') {
+      len++;
+      ptr++;
+    }
     len++;
     ptr++;
   }
 
-  char *str = malloc(len+1);
-  memcpy(str, start, len);
-  str[len] = '\0';
   CONSUME_CHAR(len);
-  //printf("str = %s\n", str);
-  return str;
+  return len;
 }
 
 bool is_character_constant(char c) {
@@ -184,22 +260,13 @@ bool is_character_constant(char c) {
 	}
 }
 
-char *lex_character_constant(void) {
-	int len = 0;
+size_t lex_character_constant(void) {
+	size_t len = 0;
 	char *ptr = source_ptr;
-	char *start = ptr;
-
-	/* 
-	 * Handles the case of L'x'
-	 * Doesn't actually do anything with it, just accepts it with no errors
-	 */
-	if(*ptr == 'L') {
-		len++;
-	}
 
 	if(is_character_constant(*ptr)) {
 		if(*ptr == '\\') {
-			while(*ptr != '\'') {
+			while(*ptr != '\'' && *ptr != '\0') {
 				len++;
 				ptr++;
 			}
@@ -213,425 +280,640 @@ char *lex_character_constant(void) {
 		}
 	}	
 
-	char *str = malloc(len);
-	memcpy(str, start, len);
 	CONSUME_CHAR(len);
-//	printf("str = %s\n", str);
-	return str;
+	return len;
 }
 
-/* Returns DIVIDE if not a comment or UNKNOWN if is a comment */
-token_type lex_possible_comment(void) {
-	if(source_ptr[1] == '/') {
-		while(*source_ptr != '\n') {
-			source_ptr++;
-		}
-		return UNKNOWN;
-	} else if(source_ptr[1] == '*') {
-		source_ptr += 2;
-		while(*source_ptr != '*') {
-			if(*source_ptr == '\n') {
-				line++;
-			}
-			if(source_ptr[1] == '*' && source_ptr[2] == '/') {
-				source_ptr+=2;
-				break;
-			}
-			source_ptr++;
-		}
-		return UNKNOWN;
-	} else {
-		return DIVIDE;
-	}
+/*
+ * DFA states for punctuators. Every state except P_START accepts, the
+ * token it accepts is in punct_accept[]. P_NONE marks a missing transition.
+ */
+enum {
+  P_NONE = 0,
+  P_START,
+  P_OTHER,
+  P_QUOTE, P_APOSTROPHE,
+  P_LBRACK, P_RBRACK, P_LBRACE, P_RBRACE, P_LPAREN, P_RPAREN,
+  P_DOT, P_COMMA, P_SEMI_COLON, P_COLON, P_TILDE, P_QMARK,
+  P_ADD, P_INCREMENT, P_ADD_ASSIGN,
+  P_SUB, P_DECREMENT, P_SUB_ASSIGN, P_ARROW,
+  P_ASTERISK, P_MUL_ASSIGN,
+  P_DIVIDE, P_DIV_ASSIGN, P_LINE_COMMENT, P_BLOCK_COMMENT,
+  P_MOD, P_MOD_ASSIGN,
+  P_LESS, P_LTEQ, P_LSHIFT, P_LSHIFT_ASSIGN,
+  P_GREATER, P_GTEQ, P_RSHIFT, P_RSHIFT_ASSIGN,
+  P_ASSIGN, P_EQUAL,
+  P_NOT, P_NOTEQ,
+  P_AMPER, P_LOGAND, P_AMPER_ASSIGN,
+  P_PIPE, P_LOGOR, P_PIPE_ASSIGN,
+  P_CARET, P_CARET_ASSIGN,
+  NUM_PUNCT_STATES
+};
+
+/* Pseudo token types for comments, these never leave the lexer */
+#define LINE_COMMENT (UNKNOWN + 1)
+#define BLOCK_COMMENT (UNKNOWN + 2)
+
+static const uint8_t punct_dfa[NUM_PUNCT_STATES][NUM_CHAR_CLASSES] = {
+  [P_START] = {
+    [CC_OTHER] = P_OTHER,
+    [CC_QUOTE] = P_QUOTE, [CC_APOSTROPHE] = P_APOSTROPHE,
+    [CC_LBRACK] = P_LBRACK, [CC_RBRACK] = P_RBRACK, [CC_LBRACE] = P_LBRACE, [CC_RBRACE] = P_RBRACE,
+    [CC_LPAREN] = P_LPAREN, [CC_RPAREN] = P_RPAREN,
+    [CC_DOT] = P_DOT, [CC_COMMA] = P_COMMA, [CC_SEMI_COLON] = P_SEMI_COLON, [CC_COLON] = P_COLON,
+    [CC_TILDE] = P_TILDE, [CC_QMARK] = P_QMARK,
+    [CC_PLUS] = P_ADD, [CC_MINUS] = P_SUB, [CC_STAR] = P_ASTERISK, [CC_SLASH] = P_DIVIDE,
+    [CC_PERCENT] = P_MOD, [CC_LESS] = P_LESS, [CC_GREATER] = P_GREATER, [CC_EQUAL] = P_ASSIGN,
+    [CC_NOT] = P_NOT, [CC_AMPER] = P_AMPER, [CC_PIPE] = P_PIPE, [CC_CARET] = P_CARET,
+  },
+  [P_ADD] = { [CC_PLUS] = P_INCREMENT, [CC_EQUAL] = P_ADD_ASSIGN },
+  [P_SUB] = { [CC_MINUS] = P_DECREMENT, [CC_EQUAL] = P_SUB_ASSIGN, [CC_GREATER] = P_ARROW },
+  [P_ASTERISK] = { [CC_EQUAL] = P_MUL_ASSIGN },
+  [P_DIVIDE] = { [CC_EQUAL] = P_DIV_ASSIGN, [CC_SLASH] = P_LINE_COMMENT, [CC_STAR] = P_BLOCK_COMMENT },
+  [P_MOD] = { [CC_EQUAL] = P_MOD_ASSIGN },
+  [P_LESS] = { [CC_EQUAL] = P_LTEQ, [CC_LESS] = P_LSHIFT },
+  [P_LSHIFT] = { [CC_EQUAL] = P_LSHIFT_ASSIGN },
+  [P_GREATER] = { [CC_EQUAL] = P_GTEQ, [CC_GREATER] = P_RSHIFT },
+  [P_RSHIFT] = { [CC_EQUAL] = P_RSHIFT_ASSIGN },
+  [P_ASSIGN] = { [CC_EQUAL] = P_EQUAL },
+  [P_NOT] = { [CC_EQUAL] = P_NOTEQ },
+  [P_AMPER] = { [CC_AMPER] = P_LOGAND, [CC_EQUAL] = P_AMPER_ASSIGN },
+  [P_PIPE] = { [CC_PIPE] = P_LOGOR, [CC_EQUAL] = P_PIPE_ASSIGN },
+  [P_CARET] = { [CC_EQUAL] = P_CARET_ASSIGN },
+};
+
+static const uint8_t punct_accept[NUM_PUNCT_STATES] = {
+  [P_OTHER] = UNKNOWN,
+  [P_QUOTE] = QUOTE, [P_APOSTROPHE] = APOSTROPHE,
+  [P_LBRACK] = LBRACK, [P_RBRACK] = RBRACK, [P_LBRACE] = LBRACE, [P_RBRACE] = RBRACE,
+  [P_LPAREN] = LPAREN, [P_RPAREN] = RPAREN,
+  [P_DOT] = DOT, [P_COMMA] = COMMA, [P_SEMI_COLON] = SEMI_COLON, [P_COLON] = COLON,
+  [P_TILDE] = TILDE, [P_QMARK] = QMARK,
+  [P_ADD] = ADD, [P_INCREMENT] = INCREMENT, [P_ADD_ASSIGN] = ADD_ASSIGN,
+  [P_SUB] = SUB, [P_DECREMENT] = DECREMENT, [P_SUB_ASSIGN] = SUB_ASSIGN, [P_ARROW] = ARROW,
+  [P_ASTERISK] = ASTERISK, [P_MUL_ASSIGN] = MUL_ASSIGN,
+  [P_DIVIDE] = DIVIDE, [P_DIV_ASSIGN] = DIV_ASSIGN,
+  [P_LINE_COMMENT] = LINE_COMMENT, [P_BLOCK_COMMENT] = BLOCK_COMMENT,
+  [P_MOD] = MOD, [P_MOD_ASSIGN] = MOD_ASSIGN,
+  [P_LESS] = LESS, [P_LTEQ] = LTEQ, [P_LSHIFT] = LSHIFT, [P_LSHIFT_ASSIGN] = LSHIFT_ASSIGN,
+  [P_GREATER] = GREATER, [P_GTEQ] = GTEQ, [P_RSHIFT] = RSHIFT, [P_RSHIFT_ASSIGN] = RSHIFT_ASSIGN,
+  [P_ASSIGN] = ASSIGN, [P_EQUAL] = EQUAL,
+  [P_NOT] = NOT, [P_NOTEQ] = NOTEQ,
+  [P_AMPER] = AMPER, [P_LOGAND] = LOGAND, [P_AMPER_ASSIGN] = AMPER_ASSIGN,
+  [P_PIPE] = PIPE, [P_LOGOR] = LOGOR, [P_PIPE_ASSIGN] = PIPE_ASSIGN,
+  [P_CARET] = CARET, [P_CARET_ASSIGN] = CARET_ASSIGN,
+};
+
+/*
+ * Runs the punctuator DFA from the lex head for as long as there is a
+ * transition, which gives the longest match (C99 6.4 maximal munch).
+ */
+static inline token_type lex_punctuator(void) {
+  const unsigned char *ptr = (const unsigned char *)source_ptr;
+  int state = P_START;
+  int next;
+  while((next = punct_dfa[state][char_class[*ptr]]) != P_NONE) {
+    state = next;
+    ptr++;
+  }
+  source_ptr = (char *)ptr;
+  return punct_accept[state];
 }
 
 /*
- * C99 Section 6.4
- * If the input stream has been parsed into preprocessing tokens up to a given character, the next preprocessing token is the longest sequence of characters that could constitute a preprocessing token.
- * The maximal munch principle.
+ * Whitespace and comments are skipped SIMD_WIDTH bytes at a time where the
+ * target has vector instructions. The input buffer always has at least
+ * INPUT_PADDING zero bytes after it and every scan stops at the '\0', so a
+ * vector load starting before the end never reads outside the buffer.
  */
-token *lex_token(void) {
-  token *t = NEW_TOKEN;
-  lex_next_token:
-  switch(READ_LEX_HEAD) {
-    case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
-      t->type = INTEGER_CONST;
-      t->attr = (void *)lex_integer_constant();
-      break;
- 
-    case '"':
-	  t->type = QUOTE;
-	  CONSUME_CHAR(1);
-	  break;
-
-    case '\'':
-	  t->type = APOSTROPHE;
-	  CONSUME_CHAR(1);
-	  break;
-
-	case '[':
-      t->type = LBRACK;
-      CONSUME_CHAR(1);
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 32
+#define SIMD_FULL_MASK 0xffffffffu
+typedef __m256i simd_vec;
+#define SIMD_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define SIMD_SPLAT(c) _mm256_set1_epi8(c)
+#define SIMD_EQ_MASK(v, c) ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8((v), (c))))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 16
+#define SIMD_FULL_MASK 0xffffu
+typedef __m128i simd_vec;
+#define SIMD_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define SIMD_SPLAT(c) _mm_set1_epi8(c)
+#define SIMD_EQ_MASK(v, c) ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8((v), (c))))
+#endif
+
+/* Bits of the mask below position n */
+#define MASK_BELOW(n) ((1u << (n)) - 1)
+
+/* Skips any run of spaces, tabs and newlines, counting lines as it goes */
+void skip_whitespace(void) {
+#ifdef SIMD_WIDTH
+  const char *ptr = source_ptr;
+  const simd_vec space = SIMD_SPLAT(' ');
+  const simd_vec tab = SIMD_SPLAT('\t');
+  const simd_vec newline = SIMD_SPLAT('\n');
+
+  for(;;) {
+    simd_vec v = SIMD_LOAD(ptr);
+    uint32_t nl = SIMD_EQ_MASK(v, newline);
+    uint32_t ws = SIMD_EQ_MASK(v, space) | SIMD_EQ_MASK(v, tab) | nl;
+
+    if(ws != SIMD_FULL_MASK) {
+      int stop = __builtin_ctz(~ws);
+      line += __builtin_popcount(nl & MASK_BELOW(stop));
+      source_ptr = (char *)ptr + stop;
+      return;
+    }
+    line += __builtin_popcount(nl);
+    ptr += SIMD_WIDTH;
+  }
+#else
+  for(;;) {
+    switch(READ_LEX_HEAD) {
+      case '\n':
+        inc_line();
+      case ' ':
+      case '\t':
+        CONSUME_CHAR(1);
       break;
 
-    case ']':
-      t->type = RBRACK;
-      CONSUME_CHAR(1);
-      break;
+      default:
+        return;
+    }
+  }
+#endif
+}
 
-    case '{':
-      t->type = LBRACE;
-      CONSUME_CHAR(1);
-      break;
+void skip_line_comment(void) {
+#ifdef SIMD_WIDTH
+  const char *ptr = source_ptr;
+  const simd_vec newline = SIMD_SPLAT('\n');
+  const simd_vec nul = SIMD_SPLAT('\0');
+
+  for(;;) {
+    simd_vec v = SIMD_LOAD(ptr);
+    uint32_t stop = SIMD_EQ_MASK(v, newline) | SIMD_EQ_MASK(v, nul);
+    if(stop != 0) {
+      source_ptr = (char *)ptr + __builtin_ctz(stop);
+      return;
+    }
+    ptr += SIMD_WIDTH;
+  }
+#else
+  while(READ_LEX_HEAD != '\n' && READ_LEX_HEAD != '\0') {
+    CONSUME_CHAR(1);
+  }
+#endif
+}
 
-    case '}':
-      t->type = RBRACE;
-      CONSUME_CHAR(1);
-      break;
+void skip_block_comment(void) {
+#ifdef SIMD_WIDTH
+  const char *ptr = source_ptr;
+  const simd_vec newline = SIMD_SPLAT('\n');
+  const simd_vec star = SIMD_SPLAT('*');
+  const simd_vec nul = SIMD_SPLAT('\0');
+
+  for(;;) {
+    simd_vec v = SIMD_LOAD(ptr);
+    uint32_t nl = SIMD_EQ_MASK(v, newline);
+    uint32_t stop = SIMD_EQ_MASK(v, star) | SIMD_EQ_MASK(v, nul);
+
+    if(stop == 0) {
+      line += __builtin_popcount(nl);
+      ptr += SIMD_WIDTH;
+      continue;
+    }
 
-    case '(':
-      t->type = LPAREN;
-      CONSUME_CHAR(1);
+    /* Count the lines up to the '*' and see if it closes the comment */
+    int i = __builtin_ctz(stop);
+    line += __builtin_popcount(nl & MASK_BELOW(i));
+    ptr += i;
+    if(*ptr == '\0') {
       break;
-
-    case ')':
-      t->type = RPAREN;
-      CONSUME_CHAR(1);
+    }
+    if(ptr[1] == '/') {
+      ptr += 2;
       break;
+    }
+    ptr++;
+  }
+  source_ptr = (char *)ptr;
+#else
+  while(READ_LEX_HEAD != '\0') {
+    if(source_ptr[0] == '*' && source_ptr[1] == '/') {
+      CONSUME_CHAR(2);
+      return;
+    }
+    if(READ_LEX_HEAD == '\n') {
+      inc_line();
+    }
+    CONSUME_CHAR(1);
+  }
+#endif
+}
 
-    case '*':
-   	  if(source_ptr[1] == '=') {
-		  t->type = MUL_ASSIGN;
-		  CONSUME_CHAR(2);
-	  } else {
-		 t->type = ASTERISK;
-		 CONSUME_CHAR(1);
-	  }
-      break;
+/*
+ * String literals and character constants come out of the lexer as an opening
+ * QUOTE/APOSTROPHE, the body as STRING_LITERAL/CHAR_CONST and then the closing
+ * QUOTE/APOSTROPHE. The context tracks where we are so the body is taken as is.
+ */
+enum {
+  LEX_NORMAL,
+  LEX_STRING_OPEN,
+  LEX_STRING_CLOSE,
+  LEX_CHAR_OPEN,
+  LEX_CHAR_CLOSE
+};
+
+static int lex_context = LEX_NORMAL;
+
+/* Lexes the token after an opening quote or apostrophe, returns false if there is nothing special to do */
+bool lex_literal(token *t) {
+  char c = READ_LEX_HEAD;
+  int ctx = lex_context;
+  lex_context = LEX_NORMAL;
+
+  if(c == '\0') {
+    return false;
+  }
 
-	case '~':
-	  t->type = TILDE;
-	  CONSUME_CHAR(1);
-	  break;
+  switch(ctx) {
+    case LEX_STRING_OPEN:
+    case LEX_STRING_CLOSE:
+      if(c == '"') {
+        t->type = QUOTE;
+        CONSUME_CHAR(1);
+      } else if(ctx == LEX_STRING_OPEN) {
+        t->type = STRING_LITERAL;
+        t->len = lex_string();
+        lex_context = LEX_STRING_CLOSE;
+      } else {
+        return false;
+      }
+      return true;
 
+    case LEX_CHAR_OPEN:
+    case LEX_CHAR_CLOSE:
+      if(c == '\'') {
+        t->type = APOSTROPHE;
+        CONSUME_CHAR(1);
+      } else if(ctx == LEX_CHAR_OPEN) {
+        t->type = CHAR_CONST;
+        t->len = lex_character_constant();
+        lex_context = LEX_CHAR_CLOSE;
+      } else {
+        return false;
+      }
+      return true;
 
-    case '/':
-      t->type = lex_possible_comment();
-      if(t->type == UNKNOWN) {
-        goto lex_next_token;
-	  } else {
-		  if(source_ptr[1] == '=') {
-			  t->type = DIV_ASSIGN;
-			  CONSUME_CHAR(2);
-		  } else {
-			  CONSUME_CHAR(1);
-		  }
-	  }
-      break;
+    default:
+      return false;
+  }
+}
 
-	case '%':
-	  if(source_ptr[1] == '=') {
-		  t->type = MOD_ASSIGN;
-		  CONSUME_CHAR(2);
-	  } else {
-		  t->type = MOD;
-		  CONSUME_CHAR(1);
-	  }
-	break;
-
-    case '+':
-	  switch(source_ptr[1]) {
-		  case '+':
-			  t->type = INCREMENT;
-			  CONSUME_CHAR(2);
-		  break;
-	      
-	      case '=':
-			  t->type = ADD_ASSIGN;
-			  CONSUME_CHAR(2);
-		  break;
-		  
-		  default:
-			  t->type = ADD;
-			  CONSUME_CHAR(1);
-		  break;
-	  }
-	  break;
-
-    case '-':
-	  switch(source_ptr[1]) {
-		  case '-':
-			  t->type = DECREMENT;
-			  CONSUME_CHAR(2);
-			  break;
-
-		  case '=':
-			  t->type = SUB_ASSIGN;
-			  CONSUME_CHAR(2);
-			  break;
-
-		  case '>':
-			  t->type = ARROW;
-			  CONSUME_CHAR(2);
-			  break;
-			  
-		  default:
-			  t->type = SUB;
-			  CONSUME_CHAR(1);
-			  break;
-	  }
-	  break;
-
-	case '^':
-	  if(source_ptr[1] == '=') {
-		  t->type = CARET_ASSIGN;
-		  CONSUME_CHAR(2);
-	  } else {
-		 t->type = CARET;
-		 CONSUME_CHAR(1);
-	  }
-	  break;
-
-    case '>':
-      switch(source_ptr[1]) {
-        case '>':
-			if(source_ptr[2] == '=') {
-				t->type = LSHIFT_ASSIGN;
-				CONSUME_CHAR(3);
-			} else {
-				t->type = LSHIFT;
-				CONSUME_CHAR(2);
-			}
-          break;
+/*
+ * C99 Section 6.4
+ * If the input stream has been parsed into preprocessing tokens up to a given character, the next preprocessing token is the longest sequence of characters that could constitute a preprocessing token.
+ * The maximal munch principle.
+ *
+ * Whitespace, identifiers and constants are picked out by their character class,
+ * everything else goes through the punctuator DFA.
+ */
+void lex_token(token *t) {
+  lex_next_token:
+  t->offset = source_ptr - source;
+  t->len = 0;
+  t->attr.ident = NULL;
 
-        case '=':
-          t->type = GTEQ;
-          CONSUME_CHAR(2);
-          break;
+  if(lex_context != LEX_NORMAL && lex_literal(t)) {
+    t->line = get_line();
+    return;
+  }
 
-        default:
-          t->type = GREATER;
-          CONSUME_CHAR(1);
-          break;
+  switch(char_class[(unsigned char)READ_LEX_HEAD]) {
+    case CC_NEWLINE:
+      inc_line();
+      /* fall through */
+    case CC_SPACE:
+      /* Single spaces between tokens are the common case, leave those to the switch */
+      CONSUME_CHAR(1);
+      if(char_class[(unsigned char)READ_LEX_HEAD] == CC_SPACE || READ_LEX_HEAD == '\n') {
+        skip_whitespace();
       }
-      break;
-
-    case '<':
-      switch(source_ptr[1]) {
-        case '<':
-			if(source_ptr[2] == '=') {
-				t->type = RSHIFT_ASSIGN;
-				CONSUME_CHAR(3);
-			} else {
-				t->type = RSHIFT;
-          		CONSUME_CHAR(2);
-			}
-		  break;
+      goto lex_next_token;
 
-        case '=':
-          t->type = LTEQ;
-          CONSUME_CHAR(2);
-          break;
+    case CC_NUL:
+      t->type = END;
+      break;
 
-        default:
-          t->type = LESS;
-          CONSUME_CHAR(1);
-          break;
-      }
+    case CC_DIGIT:
+      t->type = INTEGER_CONST;
+      t->len = lex_integer_constant(t);
       break;
 
-    case '=':
-      if(source_ptr[1] == '=') {
-        t->type = EQUAL;
+    case CC_ALPHA:
+      /* handles the case of L'x' and L"x" in A2.5.2 */
+      if(source_ptr[0] == 'L' && (source_ptr[1] == '\'' || source_ptr[1] == '"')) {
+        t->type = source_ptr[1] == '\'' ? APOSTROPHE : QUOTE;
         CONSUME_CHAR(2);
       } else {
-        t->type = ASSIGN;
-        CONSUME_CHAR(1);
+        t->len = lex_identifier();
+        t->type = match_keyword(&source[t->offset], t->len);
+        if(t->type == IDENTIFIER) {
+          t->attr.ident = intern(&source[t->offset], t->len);
+        }
       }
       break;
 
-    case '!':
-      if(source_ptr[1] == '=') {
-        t->type = NOTEQ;
-        CONSUME_CHAR(2);
-      } else {
-        t->type = NOT;
-        CONSUME_CHAR(1);
+    default:
+      t->type = lex_punctuator();
+      if(t->type == LINE_COMMENT) {
+        skip_line_comment();
+        goto lex_next_token;
+      } else if(t->type == BLOCK_COMMENT) {
+        skip_block_comment();
+        goto lex_next_token;
       }
       break;
+  }
 
-    case '&':
-	  switch(source_ptr[1]) {
-		  case '&':
-		  	t->type = LOGAND;
-			CONSUME_CHAR(2);
-			break;
+  if(t->type == QUOTE) {
+    lex_context = LEX_STRING_OPEN;
+  } else if(t->type == APOSTROPHE) {
+    lex_context = LEX_CHAR_OPEN;
+  }
+  t->line = get_line();
+}
 
-		  case '=':
-			t->type = AMPER_ASSIGN;
-			CONSUME_CHAR(2);
-			break;
+void init_lex(char *input_file) {
+	source = map_input_file(input_file, &source_len);
+	source_ptr = source;
+}
 
-		  default:
-			t->type = AMPER;
-			CONSUME_CHAR(1);
-	  }
-      break;
+/*
+ * The lexed translation unit is kept in one contiguous buffer, split into
+ * parallel arrays so the parser only ever touches the ones it needs. Most
+ * of the time that is just the type array.
+ *
+ * In streaming mode the same buffer is a small ring and tokens are lexed on
+ * demand as the parser looks ahead, so token memory doesn't grow with the
+ * size of the input. Token n always lives in slot (n & mask), the mask is
+ * all ones when the whole translation unit is buffered.
+ */
+typedef struct {
+	uint8_t *type;
+	token_attr *attr;
+	int *line;
+	uint32_t *offset;
+	uint32_t *len;
+	size_t count; /* Number of tokens lexed so far */
+	size_t cap;
+	size_t mask;
+	bool streaming;
+} token_buffer;
+
+static token_buffer tokens;
+/*
+ * Each parsing thread has its own cursor. Tokens after cursor_limit read
+ * as END, which keeps a thread inside the function body it was given.
+ */
+static _Thread_local size_t cursor; /* Index of the parser's current token */
+static _Thread_local size_t cursor_limit = SIZE_MAX;
+
+static void grow_token_buffer(size_t cap) {
+	tokens.type = realloc(tokens.type, cap * sizeof(uint8_t));
+	tokens.attr = realloc(tokens.attr, cap * sizeof(token_attr));
+	tokens.line = realloc(tokens.line, cap * sizeof(int));
+	tokens.offset = realloc(tokens.offset, cap * sizeof(uint32_t));
+	tokens.len = realloc(tokens.len, cap * sizeof(uint32_t));
+	tokens.cap = cap;
+}
 
-    case '|':
-   	  switch(source_ptr[1]) {
-		  case '|':
-		  	t->type = LOGOR;
-			CONSUME_CHAR(2);
-			break;
+static void append_token(token *t) {
+	if(!tokens.streaming && tokens.count == tokens.cap) {
+		grow_token_buffer(tokens.cap * 2);
+	}
+	size_t slot = tokens.count & tokens.mask;
+	tokens.type[slot] = t->type;
+	tokens.attr[slot] = t->attr;
+	tokens.line[slot] = t->line;
+	tokens.offset[slot] = t->offset;
+	tokens.len[slot] = t->len;
+	tokens.count++;
+}
 
-		  case '=':
-			t->type = PIPE_ASSIGN;
-			CONSUME_CHAR(2);
-			break;
+/* Lexes the whole input into the token buffer, returns the number of tokens including END */
+size_t lex_translation_unit(void) {
+	token t;
+	/* Roughly one token per four bytes of source, it grows if that's wrong. */
+	grow_token_buffer(source_len / 4 + 16);
+	tokens.mask = SIZE_MAX;
+	tokens.streaming = false;
+
+	do {
+		lex_token(&t);
+		append_token(&t);
+	} while(t.type != END);
+
+	cursor = 0;
+	return tokens.count;
+}
 
-		  default:
-			t->type = PIPE;
-			CONSUME_CHAR(1);
-	  }
-     break;
+/*
+ * Sets up the token buffer as a ring that the parser pulls tokens through,
+ * instead of lexing the whole translation unit up front.
+ */
+void lex_stream(void) {
+	grow_token_buffer(TOKEN_RING_SIZE);
+	tokens.mask = TOKEN_RING_SIZE - 1;
+	tokens.streaming = true;
+	tokens.count = 0;
+	cursor = 0;
+}
 
-    case ',':
-      t->type = COMMA;
-      CONSUME_CHAR(1);
-      break;
+/* Lexes up to token n unless END comes first. Returns the index of the last token available. */
+static size_t fill_tokens(size_t n) {
+	token t;
+	while(tokens.count <= n) {
+		if(tokens.count > 0 && tokens.type[(tokens.count - 1) & tokens.mask] == END) {
+			return tokens.count - 1;
+		}
+		lex_token(&t);
+		append_token(&t);
+	}
+	return n;
+}
 
-    case ':':
-      t->type = COLON;
-      CONSUME_CHAR(1);
-      break;
+/* Buffer slot of the token n ahead of the cursor. The parser can never move past the END token. */
+static size_t token_slot(size_t n) {
+	size_t i = cursor + n;
+	if(i > cursor_limit) {
+		i = tokens.count - 1;
+	} else if(i >= tokens.count) {
+		i = fill_tokens(i);
+	}
+	return i & tokens.mask;
+}
 
-    case ';':
-      t->type = SEMI_COLON;
-      CONSUME_CHAR(1);
-      break;
+/* Index of the current token, only meaningful for comparing positions */
+size_t get_token_index(void) {
+	return cursor;
+}
 
-	case '.':
-	  t->type = DOT;
-	  CONSUME_CHAR(1);
-	break;
-
-	case '\t':
-	  while(READ_LEX_HEAD == '\t') {
-		  CONSUME_CHAR(1);
-	  }
-	  goto lex_next_token;
-	  break;
-
-    case ' ':
-      /* skip whitespace */
-      while(READ_LEX_HEAD == ' ') {
-        CONSUME_CHAR(1);
-      }
-      goto lex_next_token;
-      break;
+/*
+ * Puts the cursor on token start with everything after token end reading
+ * as END. The whole translation unit must have been lexed.
+ */
+void set_token_range(size_t start, size_t end) {
+	cursor = start;
+	cursor_limit = end;
+}
 
-    case '\n':
-      //t->type = NEWLINE;
-	  while(READ_LEX_HEAD == '\n') {
-	  	inc_line();
-	  	CONSUME_CHAR(1);
-	  }  
-	  goto lex_next_token;
-	  break;
+/*
+ * With the cursor just past a '{', moves it past the matching '}' and
+ * returns that token's index. Stops at END if the braces are unbalanced.
+ */
+size_t skip_braced_tokens(void) {
+	size_t depth = 1;
+	for(;;) {
+		size_t slot = token_slot(0);
+		switch(tokens.type[slot]) {
+			case END:
+				return cursor;
+
+			case LBRACE:
+				depth++;
+			break;
 
-    case '\0':
-      t->type = END;
-      break;
+			case RBRACE:
+				if(--depth == 0) {
+					return cursor++;
+				}
+			break;
+		}
+		cursor++;
+	}
+}
 
-    default:
-      /*
-	   * if(previous == apostrophe) {
-	   *	return valid char const stuff up to ' or ;
-	   * } else if(previous == quote) {
-	   * 	return valid string stuff up to " or ;
-	   * } else if(is_valid_identifer){
-	   * 	return identifier;
-	   * } else {
-	   * 	return unknwon
-	   * }
-	   */ 
-	  if(prev_type == APOSTROPHE) {
-		  t->type = CHAR_CONST;
-		  t->attr = (void *)lex_character_constant();
-	  } else if(prev_type == QUOTE) {
-		  t->type = STRING_LITERAL;
-		  t->attr = (void *)lex_string();
-	  } else if(is_valid_identifier(*source_ptr)) {
-		  /* handles the case of L'x' in A2.5.2 */
-		  if(source_ptr[0] == 'L' && (source_ptr[1] == '\'' || source_ptr[1] == '\"')) {
-			  if(source_ptr[1] == '\'') {
-				  t->type = APOSTROPHE;
-				  t->attr = (void *)lex_character_constant();
-			  } else {
-				  t->type = QUOTE;
-				  t->attr = (void *)lex_string();
-			  }
-		  } else {
-			  t->attr = (void *)lex_identifier();
-			  t->type = match_keyword((char *)t->attr);
-		  }
-	  } else {
-		  t->type = UNKNOWN;
-		  CONSUME_CHAR(1);
-	  }
-	  break;
-  }
-  t->line = get_line();
-//  print_token_type(t->type);
-  prev_type = t->type;
-  return t;
+void consume_token(void) {
+	if(tokens.type[token_slot(0)] != END) {
+		cursor++;
+	}
 }
 
-token *current_token;
+token_type get_current_type(void) {
+	return tokens.type[token_slot(0)];
+}
 
-void init_lex(char *input_file) {
-	FILE *ifp = open_input_file(input_file);
-	
-	if(ifp != NULL) {
-		source = read_input_file(ifp);
-		source_ptr = source;
-	}
+token_type peek_next_type(void) {
+	return tokens.type[token_slot(1)];
 }
 
-token *head;
-token *tail;
+token_type peek_2nd_type(void) {
+	return tokens.type[token_slot(2)];
+}
 
-token *lex_translation_unit(void) {
-    token *t = lex_token();
-    head = t;
-    tail = t;
+int get_current_line(void) {
+	return tokens.line[token_slot(0)];
+}
 
-    while(t->type != END) {
-        tail->next = t;
-        tail = t;
-        t = lex_token();
-    }
-    tail->next = t;
-    tail = t;
-	current_token = head;
-    return head;
+token get_current_token(void) {
+	size_t slot = token_slot(0);
+	token t;
+	t.type = tokens.type[slot];
+	t.attr = tokens.attr[slot];
+	t.line = tokens.line[slot];
+	t.offset = tokens.offset[slot];
+	t.len = tokens.len[slot];
+	return t;
 }
 
-void consume_token(void) {
-	current_token = current_token->next;
+/* Start of the token's spelling within the source buffer, not NUL terminated */
+const char *token_start(token *t) {
+	return &source[t->offset];
+}
+
+/* Returns a NUL terminated copy of the token's spelling. Only call this when a string is actually needed. */
+char *token_str(token *t) {
+	char *s = malloc(t->len + 1);
+	memcpy(s, &source[t->offset], t->len);
+	s[t->len] = '\0';
+	return s;
+}
+
+static int hex_digit(char c) {
+	if(c >= '0' && c <= '9') {
+		return c - '0';
+	} else if(c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	} else if(c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
 }
 
-token *get_current_token(void) {
-	return current_token;
+/* Simple escape sequences and the characters they stand for, in the same order */
+static const char escape_names[] = "ntvbrfa\\?'\"";
+static const char escape_values[] = "\n\t\v\b\r\f\a\\?'\"";
+
+/*
+ * Decodes the escape sequences in a string literal's spelling into out,
+ * which must have room for len bytes, and returns the decoded length.
+ */
+size_t decode_string(const char *s, size_t len, char *out) {
+	const char *end = s + len;
+	size_t n = 0;
+	while(s < end) {
+		if(*s != '\\' || s + 1 == end) {
+			out[n++] = *s++;
+			continue;
+		}
+		s++;
+		int val = 0;
+		if(*s >= '0' && *s <= '7') {
+			/* \ooo */
+			for(int i = 0; i < 3 && s < end && *s >= '0' && *s <= '7'; i++) {
+				val = val * 8 + *s++ - '0';
+			}
+		} else if(*s == 'x') {
+			/* \xhh..., as many digits as there are */
+			if(++s == end || hex_digit(*s) < 0) {
+				error("\\x used with no following hex digits");
+			}
+			for(; s < end && hex_digit(*s) >= 0; s++) {
+				if(val <= 255) {
+					val = val * 16 + hex_digit(*s);
+				}
+			}
+		} else {
+			const char *e = strchr(escape_names, *s);
+			if(e == NULL) {
+				error("unknown escape sequence");
+				val = (unsigned char)*s;
+			} else {
+				val = escape_values[e - escape_names];
+			}
+			s++;
+		}
+		if(val > 255) {
+			error("escape sequence out of range");
+			val = 255;
+		}
+		out[n++] = (char)val;
+	}
+	return n;
 }
 
-token *peek_next_token(void) {
-	return current_token->next;
+char *current_token_str(void) {
+	token t = get_current_token();
+	return token_str(&t);
 }
 
-token *peek_2nd_token(void) {
-	return current_token->next->next;
+/* Interned spelling of the current IDENTIFIER token, compare these by pointer */
+char *current_token_ident(void) {
+	return tokens.attr[token_slot(0)].ident;
 }
 
 
@@ -0,0 +1,1400 @@
+#include "../inc/lower.h"
+#include "../inc/decl.h"
+#include "../inc/type.h"
+#include "../inc/table.h"
+#include "../inc/fold.h"
+#include "../inc/error.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define STACK_INITIAL_SIZE 64
+#define LABEL_HASH_INITIAL_SIZE 64 /* Must be a power of two */
+#define CASE_HASH_INITIAL_SIZE 64 /* Must be a power of two */
+
+/*
+ * The tree is lowered in a single walk, each node's triples are appended
+ * as it is reached. An expression gives a value: an immediate or the
+ * triple computing it, along with its C type. Jumps forward are patched
+ * as their label is placed.
+ *
+ * The chains the parser builds in a loop, like a + b + c, a = b = c,
+ * a[0][0] and else if, are lowered in a loop as well. The nodes down the
+ * chain are pushed on the spine stack and lowered on the way back up, so
+ * a long chain can't overflow the call stack.
+ *
+ * Only code is lowered, global variables and their initializers are left
+ * to the back end.
+ */
+typedef struct {
+	operand op;
+	type *ty;
+	bool is_unsigned;
+} value;
+
+/*
+ * Scalar variables are read and written with get and set, everything else
+ * is in memory at an address. A value that isn't an lvalue at all is
+ * carried along as one so that errors can be reported where it is used.
+ */
+typedef enum {
+	LV_VAR,
+	LV_MEM,
+	LV_VALUE
+} lvalue_kind;
+
+typedef struct {
+	lvalue_kind kind;
+	value v; /* The variable, the address or the value, with the object's type */
+} lvalue;
+
+/* Jumps emitted before the label is placed are chained through their target */
+typedef struct {
+	triple_ref at;
+	triple_ref waiting;
+} label;
+
+typedef struct {
+	char *ident;
+	node *first; /* Where it was first named, for reporting it undefined */
+	label l;
+} goto_label;
+
+typedef struct {
+	uint32_t index;
+	uint32_t gen;
+} label_entry;
+
+typedef struct {
+	uint32_t val;
+	triple_ref at;
+	node *n; /* For diagnostics */
+} switch_case;
+
+typedef struct {
+	uint32_t index;
+	uint32_t gen;
+} case_entry;
+
+/* Cases are collected while the body is lowered and tested after it */
+typedef struct {
+	size_t base; /* Its first case on the case stack */
+	triple_ref default_at;
+	value v;
+} switch_state;
+
+static type *void_type;
+static type *char_type;
+static type *int_type;
+static type *long_type;
+
+static _Thread_local ir_module *module;
+static _Thread_local type *return_type;
+static _Thread_local label *break_label;
+static _Thread_local label *continue_label;
+static _Thread_local switch_state *current_switch;
+
+static _Thread_local node **spine;
+static _Thread_local size_t spine_count;
+static _Thread_local size_t spine_cap;
+
+static _Thread_local value *args;
+static _Thread_local size_t arg_count;
+static _Thread_local size_t arg_cap;
+
+static _Thread_local switch_case *cases;
+static _Thread_local size_t case_count;
+static _Thread_local size_t case_cap;
+
+/* A switch's case values, checked once its body is lowered, emptied by moving on a generation */
+static _Thread_local case_entry *case_entries;
+static _Thread_local size_t case_size;
+static _Thread_local uint32_t case_gen;
+
+/* Labels named by goto, found through a hash that is emptied by moving on a generation */
+static _Thread_local goto_label *goto_labels;
+static _Thread_local uint32_t goto_count;
+static _Thread_local uint32_t goto_cap;
+static _Thread_local label_entry *label_entries;
+static _Thread_local uint32_t label_size;
+static _Thread_local uint32_t label_gen;
+
+static const uint8_t binary_ops[UNKNOWN + 1] = {
+	[ASTERISK] = IR_MUL, [DIVIDE] = IR_DIV, [MOD] = IR_MOD,
+	[ADD] = IR_ADD, [SUB] = IR_SUB,
+	[LSHIFT] = IR_SHL, [RSHIFT] = IR_SHR,
+	[GREATER] = IR_GT, [GTEQ] = IR_GE, [LESS] = IR_LT, [LTEQ] = IR_LE,
+	[EQUAL] = IR_EQ, [NOTEQ] = IR_NE,
+	[AMPER] = IR_AND, [CARET] = IR_XOR, [PIPE] = IR_OR,
+};
+
+/* The binary operator each compound assignment applies */
+static const token_type compound_ops[UNKNOWN + 1] = {
+	[ADD_ASSIGN] = ADD, [SUB_ASSIGN] = SUB, [MUL_ASSIGN] = ASTERISK,
+	[DIV_ASSIGN] = DIVIDE, [MOD_ASSIGN] = MOD,
+	[AMPER_ASSIGN] = AMPER, [CARET_ASSIGN] = CARET, [PIPE_ASSIGN] = PIPE,
+	[LSHIFT_ASSIGN] = LSHIFT, [RSHIFT_ASSIGN] = RSHIFT,
+};
+
+static value lower_rvalue(node *n);
+static lvalue lower_lvalue(node *n);
+static void lower_statement(node *s);
+
+/* Errors are reported at the line of the node being lowered */
+static void at_node(node *n) {
+	set_diagnostic_line(n->line);
+}
+
+static void push_spine(node *n) {
+	if(spine_count == spine_cap) {
+		spine_cap = spine_cap == 0 ? STACK_INITIAL_SIZE : spine_cap * 2;
+		spine = realloc(spine, spine_cap * sizeof(node *));
+	}
+	spine[spine_count++] = n;
+}
+
+static void push_arg(value v) {
+	if(arg_count == arg_cap) {
+		arg_cap = arg_cap == 0 ? STACK_INITIAL_SIZE : arg_cap * 2;
+		args = realloc(args, arg_cap * sizeof(value));
+	}
+	args[arg_count++] = v;
+}
+
+static void push_case(uint32_t val, triple_ref at, node *n) {
+	if(case_count == case_cap) {
+		case_cap = case_cap == 0 ? STACK_INITIAL_SIZE : case_cap * 2;
+		cases = realloc(cases, case_cap * sizeof(switch_case));
+	}
+	cases[case_count++] = (switch_case){ val, at, n };
+}
+
+static bool is_integer(type *t) {
+	return t->kind == TYPE_CHAR || t->kind == TYPE_INT || t->kind == TYPE_LONG;
+}
+
+static bool is_pointer(type *t) {
+	return t->kind == TYPE_POINTER;
+}
+
+static bool is_aggregate(type *t) {
+	return t->kind == TYPE_ARRAY || t->kind == TYPE_STRUCT || t->kind == TYPE_UNION;
+}
+
+static bool is_comparison(ir_op op) {
+	return op >= IR_EQ && op <= IR_GE;
+}
+
+static value make_value(operand op, type *ty, bool is_unsigned) {
+	return (value){ op, ty, is_unsigned };
+}
+
+static value int_value(uint32_t v) {
+	return make_value(imm_operand(v), int_type, false);
+}
+
+static value emit_value(ir_op op, type *ty, bool is_unsigned, operand a, operand b) {
+	triple_ref t = emit(op, ty->size, is_unsigned ? IR_UNSIGNED : 0, a, b);
+	return make_value(triple_operand(t), ty, is_unsigned);
+}
+
+static lvalue not_lvalue(value v) {
+	return (lvalue){ LV_VALUE, v };
+}
+
+/* Stands in for an lvalue that has already been reported, so the error isn't repeated */
+static lvalue error_lvalue(void) {
+	return (lvalue){ LV_MEM, int_value(0) };
+}
+
+static label new_label(void) {
+	return (label){ NO_TRIPLE, NO_TRIPLE };
+}
+
+static void jump_to(label *l, ir_op op, uint8_t size, operand cond) {
+	triple_ref target = l->at;
+	if(target == NO_TRIPLE) {
+		target = l->waiting;
+		l->waiting = next_triple();
+	}
+	if(op == IR_JUMP) {
+		emit(IR_JUMP, 0, 0, triple_operand(target), no_operand());
+	} else {
+		emit(op, size, 0, cond, triple_operand(target));
+	}
+}
+
+static void jump(label *l) {
+	jump_to(l, IR_JUMP, 0, no_operand());
+}
+
+/* A label straight after another is the same place, so that one is used */
+static void place_label(label *l) {
+	triple_ref at = next_triple();
+	if(at > 0 && get_triple(at - 1)->op == IR_LABEL) {
+		at--;
+	} else {
+		/* Nothing may jump to the entry block, so a function never starts with a label */
+		if(at == 0) {
+			emit(IR_NOP, 0, 0, no_operand(), no_operand());
+			at++;
+		}
+		emit(IR_LABEL, 0, 0, no_operand(), no_operand());
+	}
+
+	triple_ref j = l->waiting;
+	while(j != NO_TRIPLE) {
+		triple *t = get_triple(j);
+		uint32_t *target = t->op == IR_JUMP ? &t->a : &t->b;
+		j = *target;
+		*target = at;
+	}
+	l->at = at;
+	l->waiting = NO_TRIPLE;
+}
+
+static size_t hash_ident(char *id) {
+	return (size_t)(((uintptr_t)id >> 3) * 0x9e3779b97f4a7c15ull);
+}
+
+static void grow_label_hash(void) {
+	free(label_entries);
+	label_size = label_size == 0 ? LABEL_HASH_INITIAL_SIZE : label_size * 2;
+	label_entries = calloc(label_size, sizeof(label_entry));
+
+	for(uint32_t g = 0; g < goto_count; g++) {
+		size_t i = hash_ident(goto_labels[g].ident) & (label_size - 1);
+		while(label_entries[i].gen == label_gen) {
+			i = (i + 1) & (label_size - 1);
+		}
+		label_entries[i] = (label_entry){ g, label_gen };
+	}
+}
+
+/* The label an identifier names in the current function, only valid until the next one is added */
+static label *named_label(node *id) {
+	if((goto_count + 1) * 2 > label_size) {
+		grow_label_hash();
+	}
+	size_t i = hash_ident(id->constant.tok_str) & (label_size - 1);
+	while(label_entries[i].gen == label_gen) {
+		goto_label *g = &goto_labels[label_entries[i].index];
+		if(g->ident == id->constant.tok_str) {
+			return &g->l;
+		}
+		i = (i + 1) & (label_size - 1);
+	}
+
+	if(goto_count == goto_cap) {
+		goto_cap = goto_cap == 0 ? STACK_INITIAL_SIZE : goto_cap * 2;
+		goto_labels = realloc(goto_labels, goto_cap * sizeof(goto_label));
+	}
+	goto_labels[goto_count] = (goto_label){ id->constant.tok_str, id, new_label() };
+	label_entries[i] = (label_entry){ goto_count, label_gen };
+	return &goto_labels[goto_count++].l;
+}
+
+/* An immediate converted to a type of the size, held sign or zero extended to 32 bits */
+static uint32_t convert_imm(uint32_t v, unsigned size, bool is_unsigned) {
+	switch(size) {
+		case 1:
+			return is_unsigned ? (uint8_t)v : (uint32_t)(int8_t)v;
+		case 2:
+			return is_unsigned ? (uint16_t)v : (uint32_t)(int16_t)v;
+		default:
+			return v;
+	}
+}
+
+static value convert(value v, type *to, bool is_unsigned) {
+	if(to->kind == TYPE_VOID) {
+		return make_value(no_operand(), to, false);
+	}
+	if(v.ty->kind == TYPE_VOID) {
+		error("void value not ignored as it ought to be");
+		return convert(int_value(0), to, is_unsigned);
+	}
+	if(to->kind == TYPE_STRUCT || to->kind == TYPE_UNION || v.ty->kind == TYPE_STRUCT || v.ty->kind == TYPE_UNION) {
+		if(v.ty != to) {
+			error("incompatible types when converting a struct or union");
+		}
+		return v;
+	}
+
+	is_unsigned = is_unsigned && is_integer(to);
+	if(v.op.kind == OPERAND_IMM) {
+		v.op.val = convert_imm(v.op.val, to->size, is_unsigned);
+	} else if(v.ty->size != to->size) {
+		triple_ref t = emit(IR_CONV, to->size, v.is_unsigned ? IR_UNSIGNED : 0, v.op, imm_operand(v.ty->size));
+		v.op = triple_operand(t);
+	}
+	v.ty = to;
+	v.is_unsigned = is_unsigned;
+	return v;
+}
+
+/* Plain char is signed on the target */
+static value promote(value v) {
+	return v.ty->kind == TYPE_CHAR ? convert(v, int_type, false) : v;
+}
+
+/* long holds every unsigned int, so mixing the two gives long */
+static void arithmetic_conversion(value *l, value *r) {
+	*l = promote(*l);
+	*r = promote(*r);
+	bool l_long = l->ty->kind == TYPE_LONG;
+	bool r_long = r->ty->kind == TYPE_LONG;
+	bool is_unsigned;
+	if(l_long || r_long) {
+		is_unsigned = (l_long && l->is_unsigned) || (r_long && r->is_unsigned);
+	} else {
+		is_unsigned = l->is_unsigned || r->is_unsigned;
+	}
+	type *t = l_long || r_long ? long_type : int_type;
+	*l = convert(*l, t, is_unsigned);
+	*r = convert(*r, t, is_unsigned);
+}
+
+static value pointer_arithmetic(ir_op op, value p, value i) {
+	uint32_t scale = p.ty->base->size != 0 ? p.ty->base->size : 1;
+	i = convert(promote(i), int_type, false);
+	if(i.op.kind == OPERAND_IMM) {
+		i.op.val = convert_imm(i.op.val * scale, 2, false);
+		if(i.op.val == 0) {
+			return p;
+		}
+	} else if(scale != 1) {
+		i = emit_value(IR_MUL, int_type, false, i.op, imm_operand(scale));
+	}
+	return emit_value(op, p.ty, false, p.op, i.op);
+}
+
+static value binary_values(operation o, value l, value r) {
+	ir_op op = binary_ops[o];
+
+	if(o == ADD || o == SUB) {
+		if(is_pointer(l.ty) && is_integer(r.ty)) {
+			return pointer_arithmetic(op, l, r);
+		}
+		if(o == ADD && is_integer(l.ty) && is_pointer(r.ty)) {
+			return pointer_arithmetic(op, r, l);
+		}
+		/* The difference of two pointers is in elements */
+		if(o == SUB && is_pointer(l.ty) && is_pointer(r.ty)) {
+			value d = emit_value(IR_SUB, int_type, false, l.op, r.op);
+			if(l.ty->base->size > 1) {
+				d = emit_value(IR_DIV, int_type, false, d.op, imm_operand(l.ty->base->size));
+			}
+			return d;
+		}
+	}
+
+	/* Addresses compare unsigned, a null pointer constant is just an int */
+	if(is_comparison(op) && (is_pointer(l.ty) || is_pointer(r.ty))) {
+		if(!is_pointer(l.ty)) {
+			l = convert(promote(l), int_type, false);
+		}
+		if(!is_pointer(r.ty)) {
+			r = convert(promote(r), int_type, false);
+		}
+		return make_value(triple_operand(emit(op, 2, IR_UNSIGNED, l.op, r.op)), int_type, false);
+	}
+
+	if(op == IR_NOP || !is_integer(l.ty) || !is_integer(r.ty)) {
+		error("invalid operands to binary operator");
+		return int_value(0);
+	}
+
+	/* A shift has the type of its left operand */
+	if(op == IR_SHL || op == IR_SHR) {
+		l = promote(l);
+		r = convert(promote(r), l.ty, false);
+		return emit_value(op, l.ty, l.is_unsigned, l.op, r.op);
+	}
+
+	arithmetic_conversion(&l, &r);
+	if(is_comparison(op)) {
+		triple_ref t = emit(op, l.ty->size, l.is_unsigned ? IR_UNSIGNED : 0, l.op, r.op);
+		return make_value(triple_operand(t), int_type, false);
+	}
+	return emit_value(op, l.ty, l.is_unsigned, l.op, r.op);
+}
+
+static operand address_at(operand base, uint32_t offset) {
+	if(offset == 0) {
+		return base;
+	}
+	return triple_operand(emit(IR_ADD, 2, 0, base, imm_operand(offset)));
+}
+
+/* A word at a time, nothing on the target is aligned to more than 2 */
+static void copy_memory(operand dst, operand src, uint32_t size) {
+	for(uint32_t off = 0; off < size; off += 2) {
+		uint8_t n = size - off == 1 ? 1 : 2;
+		triple_ref w = emit(IR_LOAD, n, 0, address_at(src, off), no_operand());
+		emit(IR_STORE, n, 0, address_at(dst, off), triple_operand(w));
+	}
+}
+
+static void zero_memory(operand dst, uint32_t offset, uint32_t size) {
+	for(uint32_t off = 0; off < size; off += 2) {
+		uint8_t n = size - off == 1 ? 1 : 2;
+		emit(IR_STORE, n, 0, address_at(dst, offset + off), imm_operand(0));
+	}
+}
+
+/* An array or function becomes its address, as does a struct or union */
+static value load(lvalue lv) {
+	value v = lv.v;
+	if(lv.kind == LV_VALUE) {
+		return v;
+	}
+	switch(v.ty->kind) {
+		case TYPE_ARRAY:
+			return make_value(v.op, pointer_to(v.ty->base), false);
+		case TYPE_FUNCTION:
+			return make_value(v.op, pointer_to(v.ty), false);
+		case TYPE_STRUCT:
+		case TYPE_UNION:
+			return v;
+		default:
+			return emit_value(lv.kind == LV_VAR ? IR_GET : IR_LOAD, v.ty, false, v.op, no_operand());
+	}
+}
+
+/* Gives the value stored, which is the value of an assignment */
+static value store(lvalue lv, value v) {
+	type *t = lv.v.ty;
+	if(lv.kind == LV_VALUE || t->kind == TYPE_ARRAY || t->kind == TYPE_FUNCTION) {
+		error("lvalue required as left operand of assignment");
+		return v;
+	}
+	if(t->kind == TYPE_STRUCT || t->kind == TYPE_UNION) {
+		if(v.ty != t) {
+			error("incompatible types in assignment");
+		} else {
+			copy_memory(lv.v.op, v.op, t->size);
+		}
+		return lv.v;
+	}
+
+	v = convert(v, t, false);
+	emit(lv.kind == LV_VAR ? IR_SET : IR_STORE, t->size, 0, lv.v.op, v.op);
+	return v;
+}
+
+/* Globals and functions are shared between functions, aggregates always live in memory */
+static lvalue identifier_lvalue(node *n) {
+	symbol *s = n->constant.sym;
+	if(s == NULL) {
+		return error_lvalue();
+	}
+	if(s->n_type == ENUM_DECL_NODE) {
+		return not_lvalue(int_value(s->value));
+	}
+
+	type *t = s->ty;
+	uint32_t flags = s->scope == 0 || t->kind == TYPE_FUNCTION ? VAR_GLOBAL : 0;
+	if(is_aggregate(t) || t->kind == TYPE_FUNCTION) {
+		if(t->kind != TYPE_FUNCTION) {
+			flags |= VAR_ADDRESSED;
+		}
+		operand var = var_operand(function_var(s, flags));
+		triple_ref addr = emit(IR_ADDR, 2, 0, var, no_operand());
+		return (lvalue){ LV_MEM, make_value(triple_operand(addr), t, false) };
+	}
+	return (lvalue){ LV_VAR, make_value(var_operand(function_var(s, flags)), t, false) };
+}
+
+static lvalue dereference(value p) {
+	if(!is_pointer(p.ty)) {
+		error("indirection requires a pointer operand");
+		return error_lvalue();
+	}
+	return (lvalue){ LV_MEM, make_value(p.op, p.ty->base, false) };
+}
+
+static lvalue member_lvalue(node *n, lvalue lv) {
+	/* The address of the struct, or the pointer to it */
+	value v = load(lv);
+	type *t = v.ty;
+	if(n->postfix.o == ARROW) {
+		t = is_pointer(t) ? t->base : void_type;
+	}
+
+	member *m = NULL;
+	node *id = NODE(n->postfix.params);
+	if(id != NULL && (t->kind == TYPE_STRUCT || t->kind == TYPE_UNION)) {
+		m = find_member(t, id->constant.tok_str);
+	}
+	if(m == NULL) {
+		error("no member with that name");
+		return error_lvalue();
+	}
+	return (lvalue){ LV_MEM, make_value(address_at(v.op, m->offset), m->type, false) };
+}
+
+static lvalue subscript_lvalue(node *n, lvalue lv) {
+	value p = load(lv);
+	value i = lower_rvalue(NODE(n->postfix.params));
+	/* a[i] is the same as i[a] */
+	if(!is_pointer(p.ty)) {
+		value t = p;
+		p = i;
+		i = t;
+	}
+	if(!is_pointer(p.ty) || !is_integer(i.ty)) {
+		error("subscripted value is not an array or pointer");
+		return error_lvalue();
+	}
+	return dereference(pointer_arithmetic(IR_ADD, p, i));
+}
+
+static bool is_lvalue_step(node *n) {
+	return n->type == ARRAY_ACCESS_NODE || n->type == STRUCT_ACCESS_NODE
+		|| (n->type == UNARY_EXPR_NODE && n->unary.o == ASTERISK);
+}
+
+/* *p, a[i], s.m and p->m each step from the lvalue inside them */
+static lvalue lower_lvalue(node *n) {
+	size_t base = spine_count;
+	while(n != NULL && is_lvalue_step(n)) {
+		push_spine(n);
+		n = NODE(n->type == UNARY_EXPR_NODE ? n->unary.rval : n->postfix.lval);
+	}
+
+	lvalue lv;
+	if(n != NULL && n->type == IDENTIFIER_NODE) {
+		at_node(n);
+		lv = identifier_lvalue(n);
+	} else {
+		lv = not_lvalue(lower_rvalue(n));
+	}
+
+	while(spine_count > base) {
+		node *s = spine[--spine_count];
+		at_node(s);
+		switch(s->type) {
+			case UNARY_EXPR_NODE:
+				lv = dereference(load(lv));
+			break;
+			case ARRAY_ACCESS_NODE:
+				lv = subscript_lvalue(s, lv);
+			break;
+			default:
+				lv = member_lvalue(s, lv);
+			break;
+		}
+	}
+	return lv;
+}
+
+static value address_of(node *n) {
+	lvalue lv = lower_lvalue(n);
+	switch(lv.kind) {
+		case LV_VAR:
+			get_var(lv.v.op.val)->flags |= VAR_ADDRESSED;
+			return emit_value(IR_ADDR, pointer_to(lv.v.ty), false, lv.v.op, no_operand());
+		case LV_MEM:
+			return make_value(lv.v.op, pointer_to(lv.v.ty), false);
+		default:
+			error("lvalue required as unary '&' operand");
+			return lv.v;
+	}
+}
+
+static value lower_increment(node *operand, operation o, bool postfix) {
+	lvalue lv = lower_lvalue(operand);
+	value old = load(lv);
+	value v = store(lv, binary_values(o == INCREMENT ? ADD : SUB, old, int_value(1)));
+	return postfix ? old : v;
+}
+
+/* The literal's index in the module */
+static uint32_t string_index(node *n) {
+	char *s = n->constant.tok_str;
+	return add_ir_string(module, s != NULL ? s : "", s != NULL ? strlen(s) : 0);
+}
+
+static value string_value(uint32_t i) {
+	return emit_value(IR_STRING, pointer_to(char_type), false, imm_operand(i), no_operand());
+}
+
+static void lower_cond(node *n, label *target, bool jump_if);
+
+/* && and || as values, the result goes through a temporary */
+static value lower_logical(node *n) {
+	uint32_t t = temp_var(2);
+	label is_false = new_label();
+	label end = new_label();
+	lower_cond(n, &is_false, false);
+	emit(IR_SET, 2, 0, var_operand(t), imm_operand(1));
+	jump(&end);
+	place_label(&is_false);
+	emit(IR_SET, 2, 0, var_operand(t), imm_operand(0));
+	place_label(&end);
+	return emit_value(IR_GET, int_type, false, var_operand(t), no_operand());
+}
+
+/* Operands are lowered left to right down the chain of left operands */
+static value lower_binary(node *n) {
+	if(n->expression.o == LOGAND || n->expression.o == LOGOR) {
+		return lower_logical(n);
+	}
+
+	size_t base = spine_count;
+	while(n != NULL && n->type == BINARY_EXPR_NODE && n->expression.o != LOGAND && n->expression.o != LOGOR) {
+		push_spine(n);
+		n = NODE(n->expression.lval);
+	}
+	value v = lower_rvalue(n);
+	while(spine_count > base) {
+		node *e = spine[--spine_count];
+		value r = lower_rvalue(NODE(e->expression.rval));
+		at_node(e);
+		v = binary_values(e->expression.o, v, r);
+	}
+	return v;
+}
+
+/* The value is stored into each lvalue from the right */
+static value lower_assignment(node *n) {
+	size_t base = spine_count;
+	while(n != NULL && n->type == ASSIGNMENT_EXPR_NODE) {
+		push_spine(n);
+		n = NODE(n->expression.rval);
+	}
+	value v = lower_rvalue(n);
+	while(spine_count > base) {
+		node *a = spine[--spine_count];
+		lvalue lv = lower_lvalue(NODE(a->expression.lval));
+		at_node(a);
+		if(a->expression.o != ASSIGN) {
+			v = binary_values(compound_ops[a->expression.o], load(lv), v);
+		}
+		v = store(lv, v);
+	}
+	return v;
+}
+
+/*
+ * Every argument is evaluated before any is passed, so calls in the
+ * arguments don't interleave with this call's.
+ */
+static value lower_call(node *n) {
+	node *callee = NODE(n->postfix.lval);
+	operand target;
+	type *ft;
+	if(callee != NULL && callee->type == IDENTIFIER_NODE && callee->constant.sym != NULL
+			&& callee->constant.sym->ty->kind == TYPE_FUNCTION) {
+		ft = callee->constant.sym->ty;
+		target = var_operand(function_var(callee->constant.sym, VAR_GLOBAL));
+	} else {
+		value f = lower_rvalue(callee);
+		if(!is_pointer(f.ty) || f.ty->base->kind != TYPE_FUNCTION) {
+			error("called object is not a function");
+			return int_value(0);
+		}
+		ft = f.ty->base;
+		target = f.op;
+	}
+
+	size_t base = arg_count;
+	uint32_t i = 0;
+	for(node *a = NODE(n->postfix.params); a != NULL; a = NODE(a->next), i++) {
+		value v = lower_rvalue(a);
+		if(!(ft->flags & TYPE_UNPROTOTYPED) && i < ft->count) {
+			v = convert(v, ft->params[i], false);
+		} else {
+			v = promote(v);
+		}
+		if(!is_integer(v.ty) && !is_pointer(v.ty)) {
+			error("passing a struct or union by value is not supported");
+		}
+		push_arg(v);
+	}
+	for(size_t j = base; j < arg_count; j++) {
+		emit(IR_ARG, args[j].ty->size, 0, args[j].op, no_operand());
+	}
+	arg_count = base;
+
+	at_node(n);
+	type *ret = ft->base;
+	if(ret->kind == TYPE_STRUCT || ret->kind == TYPE_UNION) {
+		error("returning a struct or union is not supported");
+		ret = int_type;
+	}
+	return emit_value(IR_CALL, ret, false, target, imm_operand(i));
+}
+
+/* Everything that isn't a prefix operator or a cast */
+static value lower_operand(node *n) {
+	if(n == NULL) {
+		return int_value(0);
+	}
+	at_node(n);
+	switch(n->type) {
+		case INTEGER_CONSTANT_NODE:
+		case CHAR_CONSTANT_NODE:
+			return make_value(imm_operand(n->constant.val), n->constant.is_long ? long_type : int_type, n->constant.is_unsigned);
+
+		case STRING_LITERAL_NODE:
+			return string_value(string_index(n));
+
+		case ASSIGNMENT_EXPR_NODE:
+			return lower_assignment(n);
+
+		case BINARY_EXPR_NODE:
+			return lower_binary(n);
+
+		case FUNCTION_CALL_NODE:
+			return lower_call(n);
+
+		case POSTFIX_EXPR_NODE:
+			return lower_increment(NODE(n->postfix.lval), n->postfix.o, true);
+
+		case UNARY_EXPR_NODE:
+			if(n->unary.o == AMPER) {
+				return address_of(NODE(n->unary.rval));
+			} else if(n->unary.o == INCREMENT || n->unary.o == DECREMENT) {
+				return lower_increment(NODE(n->unary.rval), n->unary.o, false);
+			}
+			return load(lower_lvalue(n));
+
+		case IDENTIFIER_NODE:
+		case ARRAY_ACCESS_NODE:
+		case STRUCT_ACCESS_NODE:
+			return load(lower_lvalue(n));
+
+		default:
+			error("expected expression");
+			return int_value(0);
+	}
+}
+
+static value prefix_step(node *n, value v) {
+	if(n->type == CAST_EXPR_NODE) {
+		type *t = declaration_type(NODE(n->cast.a_decl));
+		if(t->kind != TYPE_VOID && !is_integer(t) && !is_pointer(t)) {
+			error("conversion to non-scalar type requested");
+			return v;
+		}
+		return convert(v, t, false);
+	}
+
+	if(!is_integer(v.ty) && !(n->unary.o == NOT && is_pointer(v.ty))) {
+		error("invalid operand to unary operator");
+		return int_value(0);
+	}
+	v = promote(v);
+	switch(n->unary.o) {
+		case NOT: {
+			uint8_t flags = v.is_unsigned || is_pointer(v.ty) ? IR_UNSIGNED : 0;
+			triple_ref t = emit(IR_EQ, v.ty->size, flags, v.op, imm_operand(0));
+			return make_value(triple_operand(t), int_type, false);
+		}
+		case SUB:
+			return emit_value(IR_NEG, v.ty, v.is_unsigned, v.op, no_operand());
+		case TILDE:
+			return emit_value(IR_COM, v.ty, v.is_unsigned, v.op, no_operand());
+		default:
+			return v;
+	}
+}
+
+static bool is_prefix_step(node *n) {
+	if(n->type == CAST_EXPR_NODE) {
+		return true;
+	}
+	if(n->type != UNARY_EXPR_NODE) {
+		return false;
+	}
+	return n->unary.o == ADD || n->unary.o == SUB || n->unary.o == TILDE || n->unary.o == NOT;
+}
+
+/* Prefix operators and casts are applied innermost first */
+static value lower_rvalue(node *n) {
+	size_t base = spine_count;
+	while(n != NULL && is_prefix_step(n)) {
+		push_spine(n);
+		n = NODE(n->type == CAST_EXPR_NODE ? n->cast.expr : n->unary.rval);
+	}
+	value v = lower_operand(n);
+	while(spine_count > base) {
+		node *p = spine[--spine_count];
+		at_node(p);
+		v = prefix_step(p, v);
+	}
+	return v;
+}
+
+/*
+ * Jumps to target when the condition is jump_if and falls through
+ * otherwise. && and || only evaluate their right operands when they have
+ * to, every operand of a chain of one of them is tested in turn.
+ */
+static void lower_logical_cond(node *n, label *target, bool jump_if) {
+	operation o = n->expression.o;
+	bool decided = o == LOGOR;
+	label skip = new_label();
+	/* An operand that decides the chain either jumps to the target or past the rest */
+	label *l = decided == jump_if ? target : &skip;
+
+	size_t base = spine_count;
+	while(n != NULL && n->type == BINARY_EXPR_NODE && n->expression.o == o) {
+		push_spine(NODE(n->expression.rval));
+		n = NODE(n->expression.lval);
+	}
+	lower_cond(n, l, decided);
+	while(spine_count > base + 1) {
+		lower_cond(spine[--spine_count], l, decided);
+	}
+	lower_cond(spine[--spine_count], target, jump_if);
+
+	if(l == &skip) {
+		place_label(&skip);
+	}
+}
+
+static void lower_cond(node *n, label *target, bool jump_if) {
+	while(n != NULL && n->type == UNARY_EXPR_NODE && n->unary.o == NOT) {
+		jump_if = !jump_if;
+		n = NODE(n->unary.rval);
+	}
+	if(n != NULL && n->type == BINARY_EXPR_NODE && (n->expression.o == LOGAND || n->expression.o == LOGOR)) {
+		lower_logical_cond(n, target, jump_if);
+		return;
+	}
+
+	value v = lower_rvalue(n);
+	if(!is_integer(v.ty) && !is_pointer(v.ty)) {
+		error("used a value where a scalar is required");
+		return;
+	}
+	if(v.op.kind == OPERAND_IMM) {
+		if((v.op.val != 0) == jump_if) {
+			jump(target);
+		}
+		return;
+	}
+	jump_to(target, jump_if ? IR_BRANCH : IR_BRANCHZ, v.ty->size, v.op);
+}
+
+static node *scalar_initializer(node *init) {
+	if(init->type != INITIALIZER_LIST_NODE) {
+		return init;
+	}
+	if(init->init_list.count > 1) {
+		error("excess elements in scalar initializer");
+	}
+	return NODE(init->init_list.head);
+}
+
+static void lower_initializer(operand base, uint32_t offset, type *t, node *init);
+
+/* Anything not given a value is zeroed, padding included */
+static void lower_initializer_list(operand base, uint32_t offset, type *t, node *e) {
+	if(t->kind == TYPE_ARRAY) {
+		uint32_t size = t->base->size;
+		uint32_t i = 0;
+		for(; e != NULL && i < t->count; e = NODE(e->next), i++) {
+			lower_initializer(base, offset + i * size, t->base, e);
+		}
+		zero_memory(base, offset + i * size, (t->count - i) * size);
+	} else {
+		uint32_t count = t->kind == TYPE_UNION && t->count > 1 ? 1 : t->count;
+		uint32_t end = 0;
+		for(uint32_t i = 0; e != NULL && i < count; e = NODE(e->next), i++) {
+			member *m = &t->members[i];
+			zero_memory(base, offset + end, m->offset - end);
+			lower_initializer(base, offset + m->offset, m->type, e);
+			end = m->offset + m->type->size;
+		}
+		zero_memory(base, offset + end, t->size - end);
+	}
+
+	if(e != NULL) {
+		error("excess elements in initializer");
+	}
+}
+
+static void lower_initializer(operand base, uint32_t offset, type *t, node *init) {
+	if(init == NULL) {
+		return;
+	}
+	if(init->type == INITIALIZER_LIST_NODE && is_aggregate(t)) {
+		lower_initializer_list(base, offset, t, NODE(init->init_list.head));
+		return;
+	}
+
+	/* A char array can be initialized from a string, without its null if there's no room */
+	if(t->kind == TYPE_ARRAY && t->base->kind == TYPE_CHAR && init->type == STRING_LITERAL_NODE) {
+		uint32_t i = string_index(init);
+		value s = string_value(i);
+		uint32_t len = module->strings[i].len + 1;
+		if(len > t->size) {
+			len = t->size;
+		}
+		copy_memory(address_at(base, offset), s.op, len);
+		zero_memory(base, offset + len, t->size - len);
+		return;
+	}
+
+	if(is_aggregate(t)) {
+		value v = lower_rvalue(init);
+		if(v.ty != t) {
+			error("braces are needed around an aggregate initializer");
+		} else {
+			copy_memory(address_at(base, offset), v.op, t->size);
+		}
+		return;
+	}
+
+	value v = convert(lower_rvalue(scalar_initializer(init)), t, false);
+	emit(IR_STORE, t->size, 0, address_at(base, offset), v.op);
+}
+
+/* Every local gets a variable, even one that is never used */
+static void lower_local(node *d) {
+	node *id = declarator_identifier(NODE(d->declaration.declarator));
+	symbol *s = id != NULL ? id->constant.sym : NULL;
+	if(s == NULL || s->ty->kind == TYPE_FUNCTION) {
+		return;
+	}
+	node *init = NODE(d->declaration.initialiser);
+	at_node(id);
+
+	if(!is_aggregate(s->ty)) {
+		lvalue lv = identifier_lvalue(id);
+		if(init != NULL) {
+			store(lv, lower_rvalue(scalar_initializer(init)));
+		}
+		return;
+	}
+
+	/* Its address is only needed to initialize it */
+	if(init == NULL) {
+		function_var(s, VAR_ADDRESSED);
+		return;
+	}
+	lvalue lv = identifier_lvalue(id);
+	lower_initializer(lv.v.op, 0, s->ty, init);
+}
+
+static void lower_statement_list(node *s) {
+	for(; s != NULL; s = NODE(s->next)) {
+		lower_statement(s);
+	}
+}
+
+/* An else if chain is lowered in a loop, every arm jumps to the one end */
+static void lower_if(node *s) {
+	label end = new_label();
+	for(;;) {
+		label next = new_label();
+		lower_cond(NODE(s->if_statement.expr), &next, false);
+		lower_statement(NODE(s->if_statement.i_stmt));
+
+		node *e = s->type == IF_ELSE_STMT_NODE ? NODE(s->if_statement.e_stmt) : NULL;
+		if(e == NULL) {
+			place_label(&next);
+			break;
+		}
+		jump(&end);
+		place_label(&next);
+		if(e->type != IF_STMT_NODE && e->type != IF_ELSE_STMT_NODE) {
+			lower_statement(e);
+			break;
+		}
+		s = e;
+	}
+	if(end.waiting != NO_TRIPLE) {
+		place_label(&end);
+	}
+}
+
+static size_t hash_case(uint32_t val) {
+	return (size_t)(((uint64_t)val * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+/* Cases of nested switches are gone by the time a switch's own are checked */
+static void check_case_values(size_t base) {
+	size_t count = case_count - base;
+	if(count * 2 > case_size) {
+		free(case_entries);
+		if(case_size == 0) {
+			case_size = CASE_HASH_INITIAL_SIZE;
+		}
+		while(count * 2 > case_size) {
+			case_size *= 2;
+		}
+		case_entries = calloc(case_size, sizeof(case_entry));
+	}
+	case_gen++;
+
+	for(size_t c = base; c < case_count; c++) {
+		size_t i = hash_case(cases[c].val) & (case_size - 1);
+		while(case_entries[i].gen == case_gen && cases[case_entries[i].index].val != cases[c].val) {
+			i = (i + 1) & (case_size - 1);
+		}
+		if(case_entries[i].gen == case_gen) {
+			at_node(cases[c].n);
+			error("duplicate case value");
+		} else {
+			case_entries[i] = (case_entry){ c, case_gen };
+		}
+	}
+}
+
+static void lower_switch(node *s) {
+	value v = promote(lower_rvalue(NODE(s->statement.expr)));
+	if(!is_integer(v.ty)) {
+		error("switch quantity not an integer");
+		v = int_value(0);
+	}
+
+	switch_state sw = { case_count, NO_TRIPLE, v };
+	switch_state *outer_switch = current_switch;
+	label *outer_break = break_label;
+	label dispatch = new_label();
+	label end = new_label();
+	current_switch = &sw;
+	break_label = &end;
+
+	jump(&dispatch);
+	lower_statement(NODE(s->statement.stmt));
+	jump(&end);
+
+	check_case_values(sw.base);
+	place_label(&dispatch);
+	uint8_t flags = v.is_unsigned ? IR_UNSIGNED : 0;
+	for(size_t i = sw.base; i < case_count; i++) {
+		triple_ref c = emit(IR_EQ, v.ty->size, flags, v.op, imm_operand(cases[i].val));
+		emit(IR_BRANCH, 2, 0, triple_operand(c), triple_operand(cases[i].at));
+	}
+	if(sw.default_at != NO_TRIPLE) {
+		emit(IR_JUMP, 0, 0, triple_operand(sw.default_at), no_operand());
+	}
+	place_label(&end);
+
+	case_count = sw.base;
+	current_switch = outer_switch;
+	break_label = outer_break;
+}
+
+static void lower_case(node *s) {
+	if(current_switch == NULL) {
+		error("case label not within a switch statement");
+		return;
+	}
+	node *e = NODE(s->statement.expr);
+	if(!is_constant(e)) {
+		return;
+	}
+	value v = convert(lower_rvalue(e), current_switch->v.ty, current_switch->v.is_unsigned);
+	label l = new_label();
+	place_label(&l);
+	push_case(v.op.val, l.at, s);
+}
+
+static void lower_default(void) {
+	if(current_switch == NULL) {
+		error("'default' label not within a switch statement");
+		return;
+	}
+	if(current_switch->default_at != NO_TRIPLE) {
+		error("multiple default labels in one switch");
+	}
+	label l = new_label();
+	place_label(&l);
+	current_switch->default_at = l.at;
+}
+
+/* Loops save the targets of break and continue around their bodies */
+static void lower_loop_body(node *body, label *brk, label *cont) {
+	label *outer_break = break_label;
+	label *outer_continue = continue_label;
+	break_label = brk;
+	continue_label = cont;
+	lower_statement(body);
+	break_label = outer_break;
+	continue_label = outer_continue;
+}
+
+static void lower_while(node *s) {
+	label top = new_label();
+	label end = new_label();
+	place_label(&top);
+	lower_cond(NODE(s->statement.expr), &end, false);
+	lower_loop_body(NODE(s->statement.stmt), &end, &top);
+	jump(&top);
+	place_label(&end);
+}
+
+static void lower_do(node *s) {
+	label top = new_label();
+	label cont = new_label();
+	label end = new_label();
+	place_label(&top);
+	lower_loop_body(NODE(s->statement.stmt), &end, &cont);
+	place_label(&cont);
+	lower_cond(NODE(s->statement.expr), &top, true);
+	place_label(&end);
+}
+
+static void lower_for(node *s) {
+	label top = new_label();
+	label cont = new_label();
+	label end = new_label();
+	if(s->for_statement.expr_1 != 0) {
+		lower_rvalue(NODE(s->for_statement.expr_1));
+	}
+	place_label(&top);
+	if(s->for_statement.expr_2 != 0) {
+		lower_cond(NODE(s->for_statement.expr_2), &end, false);
+	}
+	lower_loop_body(NODE(s->for_statement.stmt), &end, &cont);
+	place_label(&cont);
+	if(s->for_statement.expr_3 != 0) {
+		lower_rvalue(NODE(s->for_statement.expr_3));
+	}
+	jump(&top);
+	place_label(&end);
+}
+
+static void lower_return(node *s) {
+	node *e = NODE(s->statement.expr);
+	if(e == NULL) {
+		emit(IR_RET, 0, 0, no_operand(), no_operand());
+		return;
+	}
+
+	value v = lower_rvalue(e);
+	at_node(s);
+	if(return_type->kind == TYPE_VOID) {
+		warn("return with a value in function returning void");
+		emit(IR_RET, 0, 0, no_operand(), no_operand());
+		return;
+	}
+	if(return_type->kind == TYPE_STRUCT || return_type->kind == TYPE_UNION) {
+		error("returning a struct or union is not supported");
+		return;
+	}
+	v = convert(v, return_type, false);
+	emit(IR_RET, return_type->size, 0, v.op, no_operand());
+}
+
+/* Labelled statements are lowered in a loop, a run of case labels can be long */
+static void lower_statement(node *s) {
+	while(s != NULL) {
+		at_node(s);
+		switch(s->type) {
+			case LABEL_STMT_NODE: {
+				label *l = named_label(NODE(s->statement.expr));
+				if(l->at != NO_TRIPLE) {
+					error("duplicate label");
+				}
+				place_label(l);
+				s = NODE(s->statement.stmt);
+			}
+			continue;
+
+			case CASE_STMT_NODE:
+				lower_case(s);
+				s = NODE(s->statement.stmt);
+			continue;
+
+			case DEFAULT_STMT_NODE:
+				lower_default();
+				s = NODE(s->statement.stmt);
+			continue;
+
+			case COMPOUND_STMT_NODE:
+				lower_statement_list(NODE(s->statement.stmt));
+			break;
+
+			case DECLARATION_NODE:
+				lower_local(s);
+			break;
+
+			case EXPR_STMT_NODE:
+				lower_rvalue(NODE(s->statement.expr));
+			break;
+
+			case IF_STMT_NODE:
+			case IF_ELSE_STMT_NODE:
+				lower_if(s);
+			break;
+
+			case SWITCH_STMT_NODE:
+				lower_switch(s);
+			break;
+
+			case WHILE_STMT_NODE:
+				lower_while(s);
+			break;
+
+			case DO_STMT_NODE:
+				lower_do(s);
+			break;
+
+			case FOR_STMT_NODE:
+				lower_for(s);
+			break;
+
+			case GOTO_STMT_NODE:
+				if(s->statement.expr != 0) {
+					jump(named_label(NODE(s->statement.expr)));
+				}
+			break;
+
+			case CONTINUE_STMT_NODE:
+				if(continue_label == NULL) {
+					error("continue statement not within a loop");
+				} else {
+					jump(continue_label);
+				}
+			break;
+
+			case BREAK_STMT_NODE:
+				if(break_label == NULL) {
+					error("break statement not within loop or switch");
+				} else {
+					jump(break_label);
+				}
+			break;
+
+			case RETURN_STMT_NODE:
+				lower_return(s);
+			break;
+
+			/* An expression statement is just the expression */
+			default:
+				lower_rvalue(s);
+			break;
+		}
+		return;
+	}
+}
+
+/* Parameters arrive as IR_PARAMs and are copied into their variables */
+static void lower_function(node *decl, node *def) {
+	node *id = declarator_identifier(NODE(decl->declaration.declarator));
+	if(id == NULL || id->constant.sym == NULL) {
+		return;
+	}
+	symbol *s = id->constant.sym;
+	/* A deferred body is parsed here, its errors are at its tokens */
+	set_diagnostic_line(0);
+	node *body = get_function_body(def);
+	at_node(id);
+
+	begin_function(s);
+	goto_count = 0;
+	label_gen++;
+	return_type = s->ty->base;
+
+	uint32_t i = 0;
+	for(node *p = NODE(def->direct_declarator.params); p != NULL; p = NODE(p->next)) {
+		node *pid = declarator_identifier(NODE(p->declaration.declarator));
+		if(pid == NULL || pid->constant.sym == NULL) {
+			continue;
+		}
+		symbol *ps = pid->constant.sym;
+		if(is_aggregate(ps->ty)) {
+			error("passing a struct or union by value is not supported");
+		}
+		operand var = var_operand(function_var(ps, VAR_PARAM));
+		triple_ref t = emit(IR_PARAM, ps->ty->size, 0, imm_operand(i++), no_operand());
+		emit(IR_SET, ps->ty->size, 0, var, triple_operand(t));
+	}
+
+	lower_statement(body);
+
+	/* Falling off the end returns */
+	triple_ref last = next_triple();
+	if(last == 0 || (get_triple(last - 1)->op != IR_RET && get_triple(last - 1)->op != IR_JUMP)) {
+		emit(IR_RET, 0, 0, no_operand(), no_operand());
+	}
+	for(uint32_t g = 0; g < goto_count; g++) {
+		if(goto_labels[g].l.at == NO_TRIPLE) {
+			at_node(goto_labels[g].first);
+			error("label used but not defined");
+		}
+	}
+	end_function(module);
+}
+
+/* Only constants and string literals can be in a global's initializer */
+static ir_global global_initializer(char *ident, type *t, node *init) {
+	ir_global g = { ident, t->size, INIT_ZERO, 0 };
+	if(t->kind == TYPE_ARRAY && t->base->kind == TYPE_CHAR && init->type == STRING_LITERAL_NODE) {
+		g.init = INIT_CHARS;
+		g.val = string_index(init);
+		return g;
+	}
+	if(is_aggregate(t)) {
+		error("initializing a global struct, union or array is not supported");
+		return g;
+	}
+
+	node *e = scalar_initializer(init);
+	if(e != NULL && e->type == STRING_LITERAL_NODE && is_pointer(t)) {
+		g.init = INIT_STRING;
+		g.val = string_index(e);
+	} else if(is_constant(e) && (is_integer(t) || is_pointer(t))) {
+		g.init = INIT_CONSTANT;
+		g.val = convert_imm(e->constant.val, t->size, false);
+	} else {
+		error("initializer element is not constant");
+	}
+	return g;
+}
+
+/* Each declaration of a global has its own symbol, they are merged by name */
+static void lower_global(node *d) {
+	node *id = declarator_identifier(NODE(d->declaration.declarator));
+	symbol *s = id != NULL ? id->constant.sym : NULL;
+	if(s == NULL || s->ty->kind == TYPE_FUNCTION) {
+		return;
+	}
+	node *init = NODE(d->declaration.initialiser);
+	at_node(id);
+
+	ir_global g = { s->ident, s->ty->size, INIT_ZERO, 0 };
+	if(init != NULL) {
+		g = global_initializer(s->ident, s->ty, init);
+	}
+	ir_global *old = find_ir_global(module, s->ident);
+	if(old == NULL) {
+		add_ir_global(module, g);
+	} else if(old->size != g.size) {
+		error("conflicting types for a global");
+	} else if(init != NULL) {
+		if(old->init != INIT_ZERO) {
+			error("redefinition of a global");
+		}
+		*old = g;
+	}
+}
+
+ir_module *lower_translation_unit(node *unit) {
+	void_type = basic_type(VOID);
+	char_type = basic_type(CHAR);
+	int_type = basic_type(INT);
+	long_type = basic_type(LONG);
+	module = new_ir_module();
+
+	for(node *d = unit; d != NULL; d = NODE(d->next)) {
+		node *def = NULL;
+		if(d->type == DECLARATION_NODE) {
+			def = function_definition(NODE(d->declaration.declarator));
+		}
+		if(def != NULL) {
+			lower_function(d, def);
+		} else if(d->type == DECLARATION_NODE) {
+			lower_global(d);
+		}
+	}
+	set_diagnostic_line(0);
+	return module;
+}
@@ -5,26 +5,222 @@
 #include "../inc/decl.h"
 #include "../inc/expr.h"
 #include "../inc/table.h"
+#include "../inc/type.h"
+#include "../inc/parallel.h"
+#include "../inc/lower.h"
+#include "../inc/cfg.h"
+#include "../inc/ssa.h"
+#include "../inc/sccp.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
 
+void usage(char *prog) {
+	printf("usage: %s [-acsvdSOr] [-j jobs] [-o output] file\n", prog);
+	printf("  -a  print the syntax tree instead of the triples\n");
+	printf("  -c  print each function's basic blocks and dominators after the triples\n");
+	printf("  -s  stream tokens to the parser instead of lexing the whole file first\n");
+	printf("  -v  print allocation statistics for each phase to stderr\n");
+	printf("  -j  parse function bodies on this many threads\n");
+	printf("  -d  declarations only, function bodies are skipped until something needs them\n");
+	printf("  -S  print the triples in SSA form\n");
+	printf("  -O  propagate constants and drop the code they make unreachable\n");
+	printf("  -o  write the triples to this file instead of printing them\n");
+	printf("  -r  read triples written by -o instead of compiling a source file\n");
+}
+
+/* Prints the allocations made between two snapshots of the node arena */
+void print_phase_stats(char *phase, arena_stats before, arena_stats after) {
+	fprintf(stderr, "%s: %zu nodes, %zu bytes (%zu reserved)\n", phase,
+		after.count - before.count, after.used - before.used, after.reserved - before.reserved);
+}
+
+/* Runs the passes asked for over each function, then prints or writes the module */
+void finish_module(ir_module *m, bool ssa, bool optimise, bool blocks, char *output) {
+	if((ssa || optimise) && !has_error_occurred()) {
+		cfg g = { 0 };
+		for(uint32_t i = 0; i < m->count; i++) {
+			enter_ssa(m, m->funcs[i], &g);
+			if(optimise) {
+				propagate_constants(m->funcs[i], &g);
+			}
+			if(!ssa) {
+				leave_ssa(m, m->funcs[i], &g);
+			}
+		}
+		release_cfg(&g);
+	}
+	if(has_error_occurred()) {
+		return;
+	}
+	if(output != NULL) {
+		FILE *out = fopen(output, "wb");
+		if(out == NULL) {
+			file_error("Output file open error.");
+			return;
+		}
+		write_ir_module(m, out);
+		fclose(out);
+	} else {
+		print_ir_module(m);
+	}
+	if(blocks) {
+		cfg g = { 0 };
+		for(uint32_t i = 0; i < m->count; i++) {
+			build_cfg(&g, m->funcs[i]);
+			print_cfg(&g);
+		}
+		release_cfg(&g);
+	}
+}
+
+/* Modules read back have no symbols or nodes, only the triples */
+int read_module(char *fname, bool ssa, bool optimise, bool blocks, char *output) {
+	FILE *in = fopen(fname, "rb");
+	if(in == NULL) {
+		file_error("Input file open error.");
+		return -1;
+	}
+	ir_module *m = read_ir_module(in);
+	fclose(in);
+	if(m == NULL) {
+		return -1;
+	}
+	/* The passes start from code without phis, written out before -S or after -O */
+	for(uint32_t i = 0; i < m->count && (ssa || optimise); i++) {
+		if(m->funcs[i]->phi_count != 0) {
+			file_error("triples already in SSA form can't be put through -S or -O");
+			release_ir_module(m);
+			return -1;
+		}
+	}
+	finish_module(m, ssa, optimise, blocks, output);
+	release_ir_module(m);
+	return has_error_occurred() ? -1 : 0;
+}
 
 int main(int argc, char **argv) {
-	init_lex(argv[1]);
+	bool stream = false;
+	bool stats = false;
+	int jobs = 0;
+	bool lazy = false;
+	bool tree = false;
+	bool blocks = false;
+	bool ssa = false;
+	bool optimise = false;
+	bool read = false;
+	char *output = NULL;
+	int opt;
+
+	while((opt = getopt(argc, argv, "acsvj:dSOo:r")) != -1) {
+		switch(opt) {
+			case 'a':
+				tree = true;
+			break;
+
+			case 'c':
+				blocks = true;
+			break;
+
+			case 's':
+				stream = true;
+			break;
+
+			case 'v':
+				stats = true;
+			break;
+
+			case 'd':
+				lazy = true;
+			break;
+
+			case 'S':
+				ssa = true;
+			break;
+
+			case 'O':
+				optimise = true;
+			break;
+
+			case 'o':
+				output = optarg;
+			break;
+
+			case 'r':
+				read = true;
+			break;
+
+			case 'j':
+				jobs = atoi(optarg);
+				if(jobs < 1) {
+					usage(argv[0]);
+					return -1;
+				}
+			break;
+
+			default:
+				usage(argv[0]);
+				return -1;
+		}
+	}
+
+	/* Bodies are found by brace matching over the whole token buffer */
+	if(optind >= argc || (stream && (jobs > 0 || lazy))) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	if(read) {
+		return read_module(argv[optind], ssa, optimise, blocks, output);
+	}
+
+	init_lex(argv[optind]);
 	if(has_error_occurred()) {
 		return -1;
 	}
 	init_symbol_table();
+	init_node_pool();
+	init_types();
+
+	if(stream) {
+		lex_stream();
+	} else {
+		size_t count = lex_translation_unit();
+		if(stats) {
+			fprintf(stderr, "lex: %zu tokens\n", count);
+		}
+	}
+
+	arena_stats before = node_stats();
+	node *s;
+	if(lazy) {
+		defer_function_bodies(true);
+		s = parse_translation_unit();
+		defer_function_bodies(false);
+	} else if(jobs > 0) {
+		s = parse_translation_unit_parallel(jobs);
+	} else {
+		s = parse_translation_unit();
+	}
+	if(stats) {
+		print_phase_stats("parse", before, node_stats());
+	}
 
-	token *tok = lex_translation_unit();
-	node *s = parse_translation_unit();
-	
 	if(s == NULL) {
 		error("empty source file");
-	} else {
+	} else if(tree) {
 		print_statement_list(s, 0);
+	} else if(!has_error_occurred()) {
+		ir_module *m = lower_translation_unit(s);
+		if(stats) {
+			arena_stats ir = arena_get_stats(&m->pool);
+			fprintf(stderr, "lower: %zu allocations, %zu bytes (%zu reserved)\n", ir.count, ir.used, ir.reserved);
+		}
+		finish_module(m, ssa, optimise, blocks, output);
+		release_ir_module(m);
 	}
+	release_nodes();
 	return 0;
 }
 
@@ -3,13 +3,111 @@
 //
 
 #include "../inc/node.h"
+#include "../inc/arena.h"
+
+#define NODE_POOL_CHUNK (256 * 1024)
+/* Refs count in NODE_ALIGN units so this is as far as a 32 bit ref can reach */
+#define NODE_POOL_RESERVE ((size_t)UINT32_MAX * NODE_ALIGN)
+
+#define NODE_HEADER_SIZE offsetof(node, constant)
+#define NODE_SIZE(member) (offsetof(node, member) + sizeof(((node *)0)->member))
+
+/* Bytes allocated for each node type, types not listed only have the header */
+static const uint8_t node_size[ERROR_NODE + 1] = {
+  [INTEGER_CONSTANT_NODE] = NODE_SIZE(constant),
+  [CHAR_CONSTANT_NODE] = NODE_SIZE(constant),
+  [STRING_LITERAL_NODE] = NODE_SIZE(constant),
+  [IDENTIFIER_NODE] = NODE_SIZE(constant),
+  [ASSIGNMENT_EXPR_NODE] = NODE_SIZE(expression),
+  [BINARY_EXPR_NODE] = NODE_SIZE(expression),
+  [UNARY_EXPR_NODE] = NODE_SIZE(unary),
+  [POSTFIX_EXPR_NODE] = NODE_SIZE(postfix),
+  [CAST_EXPR_NODE] = NODE_SIZE(cast),
+  [ARRAY_ACCESS_NODE] = NODE_SIZE(postfix),
+  [FUNCTION_CALL_NODE] = NODE_SIZE(postfix),
+  [STRUCT_ACCESS_NODE] = NODE_SIZE(postfix),
+  [DECLARATION_NODE] = NODE_SIZE(declaration),
+  [ARRAY_DECL_NODE] = NODE_SIZE(direct_declarator),
+  [FUNC_DECL_NODE] = NODE_SIZE(direct_declarator),
+  [ENUM_DECL_NODE] = NODE_SIZE(comp_declarator),
+  [STRUCT_DECL_NODE] = NODE_SIZE(comp_declarator),
+  [BITFIELD_DECL_NODE] = NODE_SIZE(declaration),
+  [UNION_DECL_NODE] = NODE_SIZE(comp_declarator),
+  [DECLARATOR_NODE] = NODE_SIZE(declarator),
+  [DIRECT_DECLARATOR_NODE] = NODE_SIZE(direct_declarator),
+  [DECLARATION_SPEC_NODE] = NODE_SIZE(declaration_spec),
+  [INITIALIZER_LIST_NODE] = NODE_SIZE(init_list),
+  [LABEL_STMT_NODE] = NODE_SIZE(statement),
+  [CASE_STMT_NODE] = NODE_SIZE(statement),
+  [DEFAULT_STMT_NODE] = NODE_SIZE(statement),
+  [EXPR_STMT_NODE] = NODE_SIZE(statement),
+  [COMPOUND_STMT_NODE] = NODE_SIZE(statement),
+  [IF_STMT_NODE] = NODE_SIZE(if_statement),
+  [IF_ELSE_STMT_NODE] = NODE_SIZE(if_statement),
+  [SWITCH_STMT_NODE] = NODE_SIZE(statement),
+  [WHILE_STMT_NODE] = NODE_SIZE(statement),
+  [DO_STMT_NODE] = NODE_SIZE(statement),
+  [FOR_STMT_NODE] = NODE_SIZE(for_statement),
+  [GOTO_STMT_NODE] = NODE_SIZE(statement),
+  [RETURN_STMT_NODE] = NODE_SIZE(statement),
+  [FUNC_DEF_NODE] = NODE_SIZE(direct_declarator),
+};
+
+/*
+ * Every AST node lives until the translation unit is finished with. Each
+ * thread allocates from its own child of the pool so parsing on several
+ * threads needs no locking.
+ */
+static arena node_pool;
+static _Thread_local arena node_arena;
+char *node_pool_base;
+
+void init_node_pool(void) {
+  arena_init_reserved(&node_pool, NODE_POOL_CHUNK, NODE_POOL_RESERVE);
+  node_pool_base = node_pool.base;
+  init_node_thread();
+  /* Burn the first slot so that no node has a ref of 0 */
+  arena_alloc(&node_arena, NODE_ALIGN);
+}
+
+/* Must be called by any other thread before it creates nodes */
+void init_node_thread(void) {
+  arena_init_child(&node_arena, &node_pool);
+}
+
+/* Called when a thread has finished creating nodes, its nodes stay in the pool */
+void finish_node_thread(void) {
+  arena_detach_child(&node_arena);
+}
 
 node *new_node(node_type type) {
-  node *n = calloc(1, sizeof(node));
+  size_t size = node_size[type] != 0 ? node_size[type] : NODE_HEADER_SIZE;
+  node *n = arena_alloc(&node_arena, size);
   n->type = type;
+  n->line = get_current_line();
   return n;
 }
 
+/* Zeroed memory that lives as long as the nodes, for things they point to */
+void *new_node_data(size_t size) {
+  return arena_alloc(&node_arena, size);
+}
+
+/* Counts for the nodes from finished threads and the calling thread */
+arena_stats node_stats(void) {
+  arena_stats pool = arena_get_stats(&node_pool);
+  arena_stats own = arena_get_stats(&node_arena);
+  pool.count += own.count;
+  pool.used += own.used;
+  pool.reserved += own.reserved;
+  return pool;
+}
+
+void release_nodes(void) {
+  arena_release(&node_pool);
+  arena_init_child(&node_arena, &node_pool);
+}
+
 node_stack *node_stack_init(size_t size) {
   node_stack *s = calloc(1, sizeof(node_stack));
   s->st = calloc(size, sizeof(token *));
@@ -54,9 +152,9 @@ void node_enqueue(node_queue *q, node *n) {
 	if(q->count == 0) {
 		q->head = n;
 		q->tail = n;
-		n->next = NULL;
+		n->next = 0;
 	} else {
-		q->tail->next = n;
+		q->tail->next = REF(n);
 		q->tail = n;
 		q->count++;
 	}
@@ -67,8 +165,8 @@ node *node_dequeue(node_queue *q) {
 		return NULL;
 	} else {
 		node *n = q->head;
-		q->head = n->next;
-		n->next = NULL;
+		q->head = NODE(n->next);
+		n->next = 0;
 		q->count--;
 		return n;
 	}
@@ -0,0 +1,81 @@
+#include "../inc/parallel.h"
+#include "../inc/lex.h"
+#include "../inc/node.h"
+#include "../inc/decl.h"
+#include "../inc/expr.h"
+#include "../inc/table.h"
+#include "../inc/error.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+/*
+ * The top level of the translation unit is parsed on the calling thread
+ * with every function body skipped over. Worker threads then take the
+ * bodies in turn and parse them into their own node arenas. Nothing a
+ * body parse does is visible outside the body, so the order they finish
+ * in doesn't matter. Diagnostics are held back and printed in source
+ * order at the end, so the output is the same as a serial parse.
+ */
+typedef struct {
+	deferred_body *bodies;
+	size_t count;
+	size_t next; /* Next body to hand out */
+} body_queue;
+
+typedef struct {
+	pthread_t thread;
+	body_queue *queue;
+	diag_buffer *diags;
+} parse_worker;
+
+static void *parse_bodies(void *arg) {
+	parse_worker *w = arg;
+	init_node_thread();
+	init_thread_scope();
+	set_diagnostic_buffer(w->diags);
+
+	for(;;) {
+		size_t i = __atomic_fetch_add(&w->queue->next, 1, __ATOMIC_RELAXED);
+		if(i >= w->queue->count) {
+			break;
+		}
+		parse_deferred_body(&w->queue->bodies[i]);
+	}
+
+	set_diagnostic_buffer(NULL);
+	finish_expr_thread();
+	finish_decl_thread();
+	finish_thread_scope();
+	finish_node_thread();
+	return NULL;
+}
+
+node *parse_translation_unit_parallel(int jobs) {
+	/* One buffer per worker and the last for the top level */
+	diag_buffer *diags = calloc(jobs + 1, sizeof(diag_buffer));
+	parse_worker *workers = calloc(jobs, sizeof(parse_worker));
+	body_queue queue = { 0 };
+
+	/* A top level diagnostic at the same token as a body's comes after it */
+	diags[jobs].rank = 1;
+	set_diagnostic_buffer(&diags[jobs]);
+	defer_function_bodies(true);
+	node *tu = parse_translation_unit();
+	defer_function_bodies(false);
+	set_diagnostic_buffer(NULL);
+
+	queue.bodies = get_deferred_bodies(&queue.count);
+	for(int i = 0; i < jobs; i++) {
+		workers[i].queue = &queue;
+		workers[i].diags = &diags[i];
+		pthread_create(&workers[i].thread, NULL, parse_bodies, &workers[i]);
+	}
+	for(int i = 0; i < jobs; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+
+	flush_diagnostics(diags, jobs + 1);
+	free(workers);
+	free(diags);
+	return tu;
+}
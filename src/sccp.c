@@ -0,0 +1,594 @@
+#include "../inc/sccp.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Wegman and Zadeck's algorithm. Every value starts undecided and can only
+ * move down to a constant and then to varying. A block is only looked at
+ * once an edge into it is known to be taken and a phi only meets the
+ * operands of taken edges, so an if on a constant doesn't let its dead
+ * arm spoil what the live one finds.
+ *
+ * Arithmetic is the target's. A value is cut to its triple's size and
+ * widened back to 32 bits, with zeros if the triple is unsigned, so int
+ * wraps around at 16 bits and long at 32.
+ */
+typedef enum {
+	UNDECIDED,
+	CONSTANT,
+	VARYING
+} lattice;
+
+typedef struct {
+	uint8_t *state;
+	uint32_t *value;
+	uint32_t *use_start;     /* Each triple's users in uses */
+	triple_ref *work;        /* Triples whose value has changed */
+	uint32_t work_count;
+	uint32_t triple_cap;
+	triple_ref *uses;
+	uint32_t *use_edge;      /* The edge a phi's operand comes in on, NO_EDGE for other uses */
+	uint32_t use_cap;
+
+	/* Edges are numbered twice their block plus which successor they go to */
+	uint8_t *executable;
+	uint8_t *taken;
+	uint32_t *position;      /* Each edge's operand in its target's phis */
+	uint32_t *flow;          /* Edges newly taken */
+	uint32_t flow_count;
+	uint32_t block_cap;
+} sccp_scratch;
+
+#define NO_EDGE UINT32_MAX
+
+static _Thread_local sccp_scratch s;
+
+static void reserve(ir_func *f, cfg *g) {
+	if(f->count + 1 > s.triple_cap) {
+		s.triple_cap = f->count + 1;
+		s.state = realloc(s.state, s.triple_cap);
+		s.value = realloc(s.value, s.triple_cap * sizeof(uint32_t));
+		s.use_start = realloc(s.use_start, s.triple_cap * sizeof(uint32_t));
+		s.work = realloc(s.work, 2 * s.triple_cap * sizeof(triple_ref));
+	}
+	if(g->count > s.block_cap) {
+		s.block_cap = g->count;
+		s.executable = realloc(s.executable, s.block_cap);
+		s.taken = realloc(s.taken, 2 * s.block_cap);
+		s.position = realloc(s.position, 2 * s.block_cap * sizeof(uint32_t));
+		s.flow = realloc(s.flow, 2 * s.block_cap * sizeof(uint32_t));
+	}
+	memset(s.state, UNDECIDED, f->count);
+	memset(s.executable, 0, g->count);
+	memset(s.taken, 0, 2 * g->count);
+	s.work_count = 0;
+	s.flow_count = 0;
+}
+
+/* Jump targets are labels rather than values */
+static bool uses_a(triple *t) {
+	return t->a_kind == OPERAND_TRIPLE && t->op != IR_JUMP;
+}
+
+static bool uses_b(triple *t) {
+	return t->b_kind == OPERAND_TRIPLE && t->op != IR_BRANCH && t->op != IR_BRANCHZ;
+}
+
+static uint32_t edge_to(cfg *g, block_ref p, block_ref b) {
+	return 2 * p + (g->succs[g->blocks[p].succ] == b ? 0 : 1);
+}
+
+/* Phis only have operands for reachable predecessors */
+static void number_edges(cfg *g) {
+	for(block_ref b = 0; b < g->count; b++) {
+		basic_block *blk = &g->blocks[b];
+		uint32_t k = 0;
+		for(uint32_t j = blk->pred; j < blk->pred + blk->pred_count; j++) {
+			if(g->blocks[g->preds[j]].rpo != NO_BLOCK) {
+				s.position[edge_to(g, g->preds[j], b)] = k++;
+			}
+		}
+	}
+}
+
+static void add_use(triple_ref used, triple_ref user, uint32_t edge, bool fill) {
+	if(fill) {
+		s.use_edge[s.use_start[used]] = edge;
+		s.uses[s.use_start[used]++] = user;
+	} else {
+		s.use_start[used + 1]++;
+	}
+}
+
+static void find_uses_of(ir_func *f, cfg *g, bool fill) {
+	for(triple_ref t = 0; t < f->count; t++) {
+		triple *tr = &f->code[t];
+		if(tr->op == IR_NOP) {
+			continue;
+		}
+		if(uses_a(tr)) {
+			add_use(tr->a, t, NO_EDGE, fill);
+		}
+		if(tr->op == IR_PHI) {
+			block_ref b = g->block_of[t];
+			basic_block *blk = &g->blocks[b];
+			operand *args = &f->phi_args[tr->b];
+			for(uint32_t j = blk->pred; j < blk->pred + blk->pred_count; j++) {
+				uint32_t e = edge_to(g, g->preds[j], b);
+				if(g->blocks[g->preds[j]].rpo != NO_BLOCK && args[1 + s.position[e]].kind == OPERAND_TRIPLE) {
+					add_use(args[1 + s.position[e]].val, t, e, fill);
+				}
+			}
+		} else if(uses_b(tr)) {
+			add_use(tr->b, t, NO_EDGE, fill);
+		}
+	}
+}
+
+/* Counted first, then filled in with each triple's start moving up to the next's */
+static void find_uses(ir_func *f, cfg *g) {
+	memset(s.use_start, 0, (f->count + 1) * sizeof(uint32_t));
+	find_uses_of(f, g, false);
+	for(triple_ref t = 0; t < f->count; t++) {
+		s.use_start[t + 1] += s.use_start[t];
+	}
+	if(s.use_start[f->count] > s.use_cap) {
+		s.use_cap = s.use_start[f->count];
+		s.uses = realloc(s.uses, s.use_cap * sizeof(triple_ref));
+		s.use_edge = realloc(s.use_edge, s.use_cap * sizeof(uint32_t));
+	}
+	find_uses_of(f, g, true);
+	for(triple_ref t = f->count; t > 0; t--) {
+		s.use_start[t] = s.use_start[t - 1];
+	}
+	s.use_start[0] = 0;
+}
+
+/* v cut to size bytes and widened back */
+static uint32_t extend(uint32_t v, uint8_t size, bool is_unsigned) {
+	switch(size) {
+		case 1:
+			return is_unsigned ? (uint8_t)v : (uint32_t)(int8_t)v;
+		case 2:
+			return is_unsigned ? (uint16_t)v : (uint32_t)(int16_t)v;
+		default:
+			return v;
+	}
+}
+
+static int64_t numeric(uint32_t v, uint8_t size, bool is_unsigned) {
+	v = extend(v, size, is_unsigned);
+	return is_unsigned ? (int64_t)v : (int64_t)(int32_t)v;
+}
+
+static lattice operand_state(uint8_t kind, uint32_t val, uint32_t *v) {
+	switch(kind) {
+		case OPERAND_TRIPLE:
+			*v = s.value[val];
+			return s.state[val];
+		case OPERAND_IMM:
+			*v = val;
+			return CONSTANT;
+		default:
+			return VARYING;
+	}
+}
+
+static void lower_to(triple_ref t, lattice state, uint32_t v) {
+	if(state == s.state[t] && (state != CONSTANT || v == s.value[t])) {
+		return;
+	}
+	/* A second constant means it isn't one */
+	if(s.state[t] == CONSTANT && state == CONSTANT) {
+		state = VARYING;
+	}
+	s.state[t] = state;
+	s.value[t] = v;
+	s.work[s.work_count++] = t;
+}
+
+/* Whether the operation could be done, shifts out of range and division by zero are left to run */
+static bool compute(triple *t, uint32_t a, uint32_t b, uint32_t *out) {
+	bool is_unsigned = t->flags & IR_UNSIGNED;
+	int64_t x = numeric(a, t->size, is_unsigned);
+	int64_t y = numeric(b, t->size, is_unsigned);
+	uint64_t r;
+
+	switch(t->op) {
+		case IR_COPY:
+			r = a;
+		break;
+		case IR_CONV:
+			r = numeric(a, b, is_unsigned);
+		break;
+		case IR_NEG:
+			r = -(uint64_t)x;
+		break;
+		case IR_COM:
+			r = ~(uint64_t)x;
+		break;
+		case IR_ADD:
+			r = (uint64_t)x + (uint64_t)y;
+		break;
+		case IR_SUB:
+			r = (uint64_t)x - (uint64_t)y;
+		break;
+		case IR_MUL:
+			r = (uint64_t)x * (uint64_t)y;
+		break;
+		case IR_DIV:
+		case IR_MOD:
+			if(y == 0) {
+				return false;
+			}
+			r = t->op == IR_DIV ? x / y : x % y;
+		break;
+		case IR_SHL:
+		case IR_SHR:
+			if(y < 0 || y >= t->size * 8) {
+				return false;
+			}
+			r = t->op == IR_SHL ? (uint64_t)x << y : (uint64_t)(x >> y);
+		break;
+		case IR_AND:
+			r = x & y;
+		break;
+		case IR_OR:
+			r = x | y;
+		break;
+		case IR_XOR:
+			r = x ^ y;
+		break;
+
+		/* Comparisons give an int */
+		case IR_EQ:
+			*out = x == y;
+			return true;
+		case IR_NE:
+			*out = x != y;
+			return true;
+		case IR_LT:
+			*out = x < y;
+			return true;
+		case IR_LE:
+			*out = x <= y;
+			return true;
+		case IR_GT:
+			*out = x > y;
+			return true;
+		case IR_GE:
+			*out = x >= y;
+			return true;
+
+		default:
+			return false;
+	}
+	*out = extend((uint32_t)r, t->size, is_unsigned);
+	return true;
+}
+
+static bool is_unary(uint8_t op) {
+	return op == IR_NEG || op == IR_COM || op == IR_COPY || op == IR_CONV;
+}
+
+static bool is_foldable(uint8_t op) {
+	return op == IR_COPY || op == IR_CONV || (op >= IR_NEG && op <= IR_GE);
+}
+
+static void visit_value(ir_func *f, triple_ref t) {
+	triple *tr = &f->code[t];
+	if(!is_foldable(tr->op)) {
+		lower_to(t, VARYING, 0);
+		return;
+	}
+
+	uint32_t a, b = tr->b;
+	lattice as = operand_state(tr->a_kind, tr->a, &a);
+	lattice bs = is_unary(tr->op) ? CONSTANT : operand_state(tr->b_kind, tr->b, &b);
+	uint32_t v;
+	if(as == VARYING || bs == VARYING) {
+		lower_to(t, VARYING, 0);
+	} else if(as == CONSTANT && bs == CONSTANT) {
+		if(compute(tr, a, b, &v)) {
+			lower_to(t, CONSTANT, v);
+		} else {
+			lower_to(t, VARYING, 0);
+		}
+	}
+}
+
+/*
+ * A phi's value is met with each operand as its edge is taken or as the
+ * operand's value changes. Values only move down, so this gives the same
+ * as meeting them all again without going quadratic in a phi with many.
+ */
+static void meet(ir_func *f, triple_ref t, operand arg) {
+	uint32_t x;
+	lattice xs = operand_state(arg.kind, arg.val, &x);
+	x = extend(x, f->code[t].size, false);
+	if(xs == UNDECIDED) {
+		return;
+	} else if(s.state[t] == UNDECIDED) {
+		lower_to(t, xs, x);
+	} else if(xs == VARYING || x != s.value[t]) {
+		lower_to(t, VARYING, 0);
+	}
+}
+
+static void visit_phi(ir_func *f, cfg *g, triple_ref t) {
+	block_ref b = g->block_of[t];
+	basic_block *blk = &g->blocks[b];
+	operand *args = &f->phi_args[f->code[t].b];
+	for(uint32_t j = blk->pred; j < blk->pred + blk->pred_count; j++) {
+		uint32_t e = edge_to(g, g->preds[j], b);
+		if(s.taken[e]) {
+			meet(f, t, args[1 + s.position[e]]);
+		}
+	}
+}
+
+/* Phis come straight after the label, NOPs aside */
+static void meet_edge(ir_func *f, cfg *g, uint32_t e) {
+	basic_block *blk = &g->blocks[g->succs[g->blocks[e / 2].succ + e % 2]];
+	triple_ref t = blk->start;
+	if(f->code[t].op == IR_LABEL) {
+		t++;
+	}
+	for(; t < blk->end && (f->code[t].op == IR_PHI || f->code[t].op == IR_NOP); t++) {
+		if(f->code[t].op == IR_PHI) {
+			meet(f, t, f->phi_args[f->code[t].b + 1 + s.position[e]]);
+		}
+	}
+}
+
+static void take_edge(block_ref b, uint32_t which) {
+	if(s.taken[2 * b + which]) {
+		return;
+	}
+	s.taken[2 * b + which] = 1;
+	s.flow[s.flow_count++] = 2 * b + which;
+}
+
+static bool branch_taken(triple *t, uint32_t cond) {
+	return (extend(cond, t->size, false) != 0) == (t->op == IR_BRANCH);
+}
+
+/* A branch target comes before the fall through, they are one edge if they are the same block */
+static void visit_end(ir_func *f, cfg *g, block_ref b) {
+	basic_block *blk = &g->blocks[b];
+	triple *last = &f->code[blk->end - 1];
+	if(last->op == IR_BRANCH || last->op == IR_BRANCHZ) {
+		uint32_t cond;
+		lattice state = operand_state(last->a_kind, last->a, &cond);
+		if(state == CONSTANT) {
+			take_edge(b, branch_taken(last, cond) ? 0 : blk->succ_count - 1);
+			return;
+		} else if(state == UNDECIDED) {
+			return;
+		}
+	}
+	for(uint32_t w = 0; w < blk->succ_count; w++) {
+		take_edge(b, w);
+	}
+}
+
+static void visit(ir_func *f, cfg *g, triple_ref t) {
+	switch(f->code[t].op) {
+		case IR_NOP:
+		case IR_LABEL:
+		case IR_SET:
+		case IR_STORE:
+		case IR_ARG:
+		case IR_RET:
+		case IR_JUMP:
+		break;
+
+		case IR_BRANCH:
+		case IR_BRANCHZ:
+			visit_end(f, g, g->block_of[t]);
+		break;
+
+		case IR_PHI:
+			visit_phi(f, g, t);
+		break;
+
+		default:
+			visit_value(f, t);
+		break;
+	}
+}
+
+static void visit_block(ir_func *f, cfg *g, block_ref b) {
+	basic_block *blk = &g->blocks[b];
+	for(triple_ref t = blk->start; t < blk->end; t++) {
+		triple *tr = &f->code[t];
+		if(tr->op != IR_BRANCH && tr->op != IR_BRANCHZ) {
+			visit(f, g, t);
+		}
+	}
+	visit_end(f, g, b);
+}
+
+static void propagate(ir_func *f, cfg *g) {
+	s.executable[0] = 1;
+	visit_block(f, g, 0);
+	while(s.flow_count > 0 || s.work_count > 0) {
+		if(s.flow_count > 0) {
+			uint32_t e = s.flow[--s.flow_count];
+			block_ref b = g->succs[g->blocks[e / 2].succ + e % 2];
+			if(!s.executable[b]) {
+				s.executable[b] = 1;
+				visit_block(f, g, b);
+			} else {
+				meet_edge(f, g, e);
+			}
+			continue;
+		}
+
+		triple_ref t = s.work[--s.work_count];
+		for(uint32_t j = s.use_start[t]; j < s.use_start[t + 1]; j++) {
+			triple_ref u = s.uses[j];
+			if(!s.executable[g->block_of[u]]) {
+				continue;
+			} else if(s.use_edge[j] == NO_EDGE) {
+				visit(f, g, u);
+			} else if(s.taken[s.use_edge[j]]) {
+				meet(f, u, triple_operand(t));
+			}
+		}
+	}
+}
+
+static void substitute(uint8_t *kind, uint32_t *val) {
+	if(*kind == OPERAND_TRIPLE && s.state[*val] == CONSTANT) {
+		*kind = OPERAND_IMM;
+		*val = s.value[*val];
+	}
+}
+
+/* Operands of edges that can't be taken go */
+static void rewrite_phi(ir_func *f, cfg *g, triple_ref t) {
+	block_ref b = g->block_of[t];
+	basic_block *blk = &g->blocks[b];
+	operand *args = &f->phi_args[f->code[t].b];
+	uint32_t n = 0;
+	for(uint32_t j = blk->pred; j < blk->pred + blk->pred_count; j++) {
+		uint32_t e = edge_to(g, g->preds[j], b);
+		if(s.taken[e]) {
+			operand arg = args[1 + s.position[e]];
+			uint8_t kind = arg.kind;
+			substitute(&kind, &arg.val);
+			args[1 + n++] = (operand){ kind, arg.val };
+		}
+	}
+	args[0] = imm_operand(n);
+}
+
+static void rewrite(ir_func *f, cfg *g) {
+	for(block_ref b = 0; b < g->count; b++) {
+		basic_block *blk = &g->blocks[b];
+		for(triple_ref t = blk->start; t < blk->end; t++) {
+			triple *tr = &f->code[t];
+			if(!s.executable[b] || s.state[t] == CONSTANT) {
+				tr->op = IR_NOP;
+				continue;
+			}
+
+			uint8_t kind = tr->a_kind;
+			uint32_t val = tr->a;
+			if(uses_a(tr)) {
+				substitute(&kind, &val);
+				tr->a_kind = kind;
+				tr->a = val;
+			}
+			kind = tr->b_kind;
+			val = tr->b;
+			if(uses_b(tr)) {
+				substitute(&kind, &val);
+				tr->b_kind = kind;
+				tr->b = val;
+			}
+
+			if(tr->op == IR_PHI) {
+				rewrite_phi(f, g, t);
+			} else if((tr->op == IR_BRANCH || tr->op == IR_BRANCHZ) && tr->a_kind == OPERAND_IMM) {
+				if(branch_taken(tr, tr->a)) {
+					*tr = (triple){ .op = IR_JUMP, .a_kind = OPERAND_TRIPLE, .a = tr->b };
+				} else {
+					tr->op = IR_NOP;
+				}
+			}
+		}
+	}
+}
+
+static triple_ref next_kept(ir_func *f, triple_ref t) {
+	while(t < f->count && f->code[t].op == IR_NOP) {
+		t++;
+	}
+	return t;
+}
+
+/*
+ * Where a jump to label really ends up, through blocks that only jump on.
+ * A block with phis is never jumped past since its predecessors would
+ * change. Each label's target is kept so a long chain is only followed
+ * once, and a label is its own target while its chain is followed, which
+ * stops a loop of jumps.
+ */
+static triple_ref final_target(ir_func *f, triple_ref label) {
+	uint32_t *target = s.value;
+	triple_ref *path = s.work;
+	uint32_t n = 0;
+	while(target[label] == NO_TRIPLE) {
+		target[label] = label;
+		path[n++] = label;
+		triple_ref t = next_kept(f, label + 1);
+		if(t == f->count || f->code[t].op != IR_JUMP) {
+			break;
+		}
+		triple_ref next = next_kept(f, f->code[t].a + 1);
+		if(next < f->count && f->code[next].op == IR_PHI) {
+			break;
+		}
+		label = f->code[t].a;
+	}
+
+	triple_ref end = target[label];
+	while(n > 0) {
+		target[path[--n]] = end;
+	}
+	return end;
+}
+
+/*
+ * Jumps left going through empty blocks or to the next label once dead
+ * arms have gone. Labels nothing jumps to any more go too, so the blocks
+ * they started merge with the ones before, unless they start phis.
+ */
+static void simplify_jumps(ir_func *f) {
+	memset(s.value, 0xff, f->count * sizeof(uint32_t));
+	for(triple_ref t = 0; t < f->count; t++) {
+		triple *tr = &f->code[t];
+		if(tr->op != IR_JUMP) {
+			continue;
+		}
+		tr->a = final_target(f, tr->a);
+		if(next_kept(f, t + 1) == tr->a) {
+			tr->op = IR_NOP;
+		}
+	}
+
+	uint32_t *jumped_to = s.value;
+	memset(jumped_to, 0, f->count * sizeof(uint32_t));
+	for(triple_ref t = 0; t < f->count; t++) {
+		triple *tr = &f->code[t];
+		if(tr->op == IR_JUMP) {
+			jumped_to[tr->a] = 1;
+		} else if(tr->op == IR_BRANCH || tr->op == IR_BRANCHZ) {
+			jumped_to[tr->b] = 1;
+		}
+	}
+	for(triple_ref t = 0; t < f->count; t++) {
+		if(f->code[t].op != IR_LABEL || jumped_to[t]) {
+			continue;
+		}
+		triple_ref next = next_kept(f, t + 1);
+		if(next == f->count || f->code[next].op != IR_PHI) {
+			f->code[t].op = IR_NOP;
+		}
+	}
+}
+
+void propagate_constants(ir_func *f, cfg *g) {
+	if(g->count == 0) {
+		return;
+	}
+	reserve(f, g);
+	number_edges(g);
+	find_uses(f, g);
+	propagate(f, g);
+	rewrite(f, g);
+	simplify_jumps(f);
+	build_cfg(g, f);
+}
@@ -0,0 +1,772 @@
+#include "../inc/ssa.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Phis are placed with Sreedhar and Gao's method. A variable's iterated
+ * dominance frontier is found by taking the blocks that set it deepest in
+ * the dominator tree first and walking the subtree under each, the edges
+ * leaving it that don't go to a dominator tree child give the frontier.
+ * The frontiers themselves are never built, they can be quadratic in size
+ * after a long else if.
+ *
+ * Only variables read in some block before being set in it get phis, one
+ * set and read within a block never needs any.
+ *
+ * Renaming walks the dominator tree with each variable's current value,
+ * logging the value each set replaces so leaving a block can undo them.
+ */
+#define PROMOTED 1
+#define LIVE_IN 2
+
+typedef struct {
+	uint32_t var;
+	operand old;
+} def_entry;
+
+typedef struct {
+	block_ref block;
+	uint32_t mark;  /* Log size when the block was entered */
+	uint32_t child; /* Next child to visit */
+} rename_frame;
+
+typedef struct {
+	block_ref block;
+	uint32_t var;
+} phi_site;
+
+/* Scratch arrays reused from one function to the next */
+typedef struct {
+	uint32_t *level;
+	uint32_t *bank;      /* Blocks waiting to be walked, listed by level */
+	uint32_t *bank_next;
+	uint32_t *in_bank;
+	uint32_t *visited;
+	uint32_t *has_phi;
+	uint32_t *phi_start; /* Each block's phis in phi_var */
+	uint32_t *arg_count;
+	uint32_t *edge;      /* Two per block, the position of each successor edge among its target's predecessors */
+	uint32_t *jumped_to; /* Marked for blocks a jump kept by leave_ssa goes to */
+	uint32_t *stack;
+	rename_frame *frames;
+	uint32_t block_cap;
+
+	uint8_t *var_state;
+	uint32_t *var_def;   /* Each variable's sets in def_blocks */
+	uint32_t *var_seen;
+	operand *current;
+	uint32_t var_cap;
+
+	uint32_t *def_blocks;
+	uint32_t *new_index;
+	operand *value;
+	uint32_t triple_cap;
+
+	phi_site *sites;
+	uint32_t *phi_var;
+	uint32_t *phi_at;
+	uint32_t *phi_off;
+	uint32_t site_count;
+	uint32_t site_cap;
+
+	def_entry *log;
+	uint32_t log_count;
+	uint32_t log_cap;
+
+	uint32_t mark;
+} ssa_scratch;
+
+static _Thread_local ssa_scratch s;
+
+static void reserve_blocks(uint32_t count) {
+	if(count + 1 <= s.block_cap) {
+		return;
+	}
+	s.block_cap = count + 1;
+	s.level = realloc(s.level, s.block_cap * sizeof(uint32_t));
+	s.bank = realloc(s.bank, s.block_cap * sizeof(uint32_t));
+	s.bank_next = realloc(s.bank_next, s.block_cap * sizeof(uint32_t));
+	s.in_bank = realloc(s.in_bank, s.block_cap * sizeof(uint32_t));
+	s.visited = realloc(s.visited, s.block_cap * sizeof(uint32_t));
+	s.has_phi = realloc(s.has_phi, s.block_cap * sizeof(uint32_t));
+	s.phi_start = realloc(s.phi_start, s.block_cap * sizeof(uint32_t));
+	s.arg_count = realloc(s.arg_count, s.block_cap * sizeof(uint32_t));
+	s.edge = realloc(s.edge, 2 * s.block_cap * sizeof(uint32_t));
+	s.jumped_to = realloc(s.jumped_to, s.block_cap * sizeof(uint32_t));
+	s.stack = realloc(s.stack, s.block_cap * sizeof(uint32_t));
+	s.frames = realloc(s.frames, s.block_cap * sizeof(rename_frame));
+
+	/* Marks from before are meaningless now */
+	memset(s.in_bank, 0, s.block_cap * sizeof(uint32_t));
+	memset(s.visited, 0, s.block_cap * sizeof(uint32_t));
+	memset(s.has_phi, 0, s.block_cap * sizeof(uint32_t));
+	memset(s.jumped_to, 0, s.block_cap * sizeof(uint32_t));
+}
+
+static void reserve_vars(uint32_t count) {
+	if(count + 1 <= s.var_cap) {
+		return;
+	}
+	s.var_cap = count + 1;
+	s.var_state = realloc(s.var_state, s.var_cap);
+	s.var_def = realloc(s.var_def, s.var_cap * sizeof(uint32_t));
+	s.var_seen = realloc(s.var_seen, s.var_cap * sizeof(uint32_t));
+	s.current = realloc(s.current, s.var_cap * sizeof(operand));
+}
+
+static void reserve_triples(uint32_t count) {
+	if(count <= s.triple_cap) {
+		return;
+	}
+	s.triple_cap = count;
+	s.def_blocks = realloc(s.def_blocks, count * sizeof(uint32_t));
+	s.new_index = realloc(s.new_index, count * sizeof(uint32_t));
+	s.value = realloc(s.value, count * sizeof(operand));
+}
+
+static void add_site(block_ref b, uint32_t var) {
+	if(s.site_count == s.site_cap) {
+		s.site_cap = s.site_cap == 0 ? 64 : s.site_cap * 2;
+		s.sites = realloc(s.sites, s.site_cap * sizeof(phi_site));
+		s.phi_var = realloc(s.phi_var, s.site_cap * sizeof(uint32_t));
+		s.phi_at = realloc(s.phi_at, s.site_cap * sizeof(uint32_t));
+		s.phi_off = realloc(s.phi_off, s.site_cap * sizeof(uint32_t));
+	}
+	s.sites[s.site_count++] = (phi_site){ b, var };
+}
+
+static void set_current(uint32_t var, operand v) {
+	if(s.log_count == s.log_cap) {
+		s.log_cap = s.log_cap == 0 ? 64 : s.log_cap * 2;
+		s.log = realloc(s.log, s.log_cap * sizeof(def_entry));
+	}
+	s.log[s.log_count++] = (def_entry){ var, s.current[var] };
+	s.current[var] = v;
+}
+
+static void undo_to(uint32_t mark) {
+	while(s.log_count > mark) {
+		def_entry *e = &s.log[--s.log_count];
+		s.current[e->var] = e->old;
+	}
+}
+
+static bool is_reachable(cfg *g, block_ref b) {
+	return g->blocks[b].rpo != NO_BLOCK;
+}
+
+static bool is_promoted(operand_kind kind, uint32_t v) {
+	return kind == OPERAND_VAR && (s.var_state[v] & PROMOTED);
+}
+
+/* Whether a triple is still there once promoted variables are gone */
+static bool is_kept(triple *t) {
+	if(t->op == IR_NOP) {
+		return false;
+	}
+	return !((t->op == IR_GET || t->op == IR_SET) && is_promoted(t->a_kind, t->a));
+}
+
+static bool is_terminator(uint8_t op) {
+	return op == IR_JUMP || op == IR_BRANCH || op == IR_BRANCHZ || op == IR_RET;
+}
+
+static operand operand_of(uint8_t kind, uint32_t val) {
+	return (operand){ kind, val };
+}
+
+/* Scalars live only in their variable, as long as nothing can reach them through memory */
+static void find_promoted(ir_func *f) {
+	for(uint32_t v = 0; v < f->var_count; v++) {
+		ir_var *var = &f->vars[v];
+		bool scalar = var->size == 1 || var->size == 2 || var->size == 4;
+		s.var_state[v] = scalar && !(var->flags & (VAR_GLOBAL | VAR_ADDRESSED)) ? PROMOTED : 0;
+	}
+}
+
+/* Marks the variables live into a block and lists the blocks setting each one */
+static void find_definitions(ir_func *f, cfg *g) {
+	memset(s.var_seen, 0, f->var_count * sizeof(uint32_t));
+	memset(s.var_def, 0, (f->var_count + 1) * sizeof(uint32_t));
+	for(block_ref b = 0; b < g->count; b++) {
+		if(!is_reachable(g, b)) {
+			continue;
+		}
+		for(triple_ref t = g->blocks[b].start; t < g->blocks[b].end; t++) {
+			triple *tr = &f->code[t];
+			if(!is_promoted(tr->a_kind, tr->a)) {
+				continue;
+			}
+			if(tr->op == IR_GET && s.var_seen[tr->a] != b + 1) {
+				s.var_state[tr->a] |= LIVE_IN;
+			} else if(tr->op == IR_SET) {
+				s.var_seen[tr->a] = b + 1;
+				s.var_def[tr->a + 1]++;
+			}
+		}
+	}
+
+	for(uint32_t v = 0; v < f->var_count; v++) {
+		s.var_def[v + 1] += s.var_def[v];
+		s.var_seen[v] = s.var_def[v];
+	}
+	for(block_ref b = 0; b < g->count; b++) {
+		if(!is_reachable(g, b)) {
+			continue;
+		}
+		for(triple_ref t = g->blocks[b].start; t < g->blocks[b].end; t++) {
+			triple *tr = &f->code[t];
+			if(tr->op == IR_SET && is_promoted(tr->a_kind, tr->a)) {
+				s.def_blocks[s.var_seen[tr->a]++] = b;
+			}
+		}
+	}
+}
+
+static void number_levels(cfg *g) {
+	for(uint32_t i = 0; i < g->order_count; i++) {
+		block_ref b = g->order[i];
+		s.level[b] = i == 0 ? 0 : s.level[g->blocks[b].idom] + 1;
+		s.bank[i] = NO_BLOCK;
+	}
+}
+
+static void bank_insert(block_ref b, uint32_t *top) {
+	if(s.in_bank[b] == s.mark) {
+		return;
+	}
+	s.in_bank[b] = s.mark;
+	uint32_t level = s.level[b];
+	s.bank_next[b] = s.bank[level];
+	s.bank[level] = b;
+	if(level + 1 > *top) {
+		*top = level + 1;
+	}
+}
+
+/* The deepest block waiting, levels at top and above are empty */
+static block_ref bank_take(uint32_t *top) {
+	while(*top > 0 && s.bank[*top - 1] == NO_BLOCK) {
+		(*top)--;
+	}
+	if(*top == 0) {
+		return NO_BLOCK;
+	}
+	block_ref b = s.bank[*top - 1];
+	s.bank[*top - 1] = s.bank_next[b];
+	return b;
+}
+
+static void place_phis(cfg *g, uint32_t var) {
+	uint32_t top = 0;
+	s.mark++;
+	for(uint32_t i = s.var_def[var]; i < s.var_def[var + 1]; i++) {
+		bank_insert(s.def_blocks[i], &top);
+	}
+
+	block_ref x;
+	while((x = bank_take(&top)) != NO_BLOCK) {
+		uint32_t root = s.level[x];
+		uint32_t sp = 0;
+		s.visited[x] = s.mark;
+		s.stack[sp++] = x;
+		while(sp > 0) {
+			block_ref y = s.stack[--sp];
+			basic_block *b = &g->blocks[y];
+			for(uint32_t j = b->succ; j < b->succ + b->succ_count; j++) {
+				block_ref z = g->succs[j];
+				if(g->blocks[z].idom == y || s.level[z] > root || s.has_phi[z] == s.mark) {
+					continue;
+				}
+				s.has_phi[z] = s.mark;
+				add_site(z, var);
+				bank_insert(z, &top);
+			}
+			for(uint32_t j = b->child; j < b->child + b->child_count; j++) {
+				block_ref c = g->children[j];
+				if(s.visited[c] != s.mark) {
+					s.visited[c] = s.mark;
+					s.stack[sp++] = c;
+				}
+			}
+		}
+	}
+}
+
+/* Sorts the phis by block, they stay in variable order within one */
+static void sort_phis(cfg *g) {
+	memset(s.phi_start, 0, (g->count + 1) * sizeof(uint32_t));
+	for(uint32_t i = 0; i < s.site_count; i++) {
+		s.phi_start[s.sites[i].block + 1]++;
+	}
+	for(block_ref b = 0; b < g->count; b++) {
+		s.phi_start[b + 1] += s.phi_start[b];
+		s.stack[b] = s.phi_start[b];
+	}
+	for(uint32_t i = 0; i < s.site_count; i++) {
+		s.phi_var[s.stack[s.sites[i].block]++] = s.sites[i].var;
+	}
+}
+
+/* A phi has an operand for each reachable predecessor */
+static void number_edges(cfg *g) {
+	for(block_ref b = 0; b < g->count; b++) {
+		basic_block *blk = &g->blocks[b];
+		uint32_t k = 0;
+		for(uint32_t j = blk->pred; j < blk->pred + blk->pred_count; j++) {
+			block_ref p = g->preds[j];
+			if(!is_reachable(g, p)) {
+				continue;
+			}
+			uint32_t which = g->succs[g->blocks[p].succ] == b ? 0 : 1;
+			s.edge[2 * p + which] = k++;
+		}
+		s.arg_count[b] = k;
+	}
+}
+
+/* Gives every triple kept and every phi its place in the new code */
+static uint32_t lay_out(ir_func *f, cfg *g, uint32_t *arg_total) {
+	uint32_t n = 0;
+	uint32_t args = 0;
+	for(block_ref b = 0; b < g->count; b++) {
+		basic_block *blk = &g->blocks[b];
+		if(!is_reachable(g, b)) {
+			continue;
+		}
+		uint32_t first = n;
+		triple_ref t = blk->start;
+		if(f->code[t].op == IR_LABEL) {
+			s.new_index[t++] = n++;
+		}
+		for(uint32_t k = s.phi_start[b]; k < s.phi_start[b + 1]; k++) {
+			s.phi_at[k] = n++;
+			s.phi_off[k] = args;
+			args += 1 + s.arg_count[b];
+		}
+		for(; t < blk->end; t++) {
+			if(is_kept(&f->code[t])) {
+				s.new_index[t] = n++;
+			}
+		}
+		/* An empty block still has to be there for its edges */
+		if(n == first) {
+			n++;
+		}
+	}
+	*arg_total = args;
+	return n;
+}
+
+static operand renamed(uint8_t kind, uint32_t val) {
+	return kind == OPERAND_TRIPLE ? s.value[val] : operand_of(kind, val);
+}
+
+static void rename_block(ir_func *f, cfg *g, block_ref b, operand *args) {
+	basic_block *blk = &g->blocks[b];
+	for(uint32_t k = s.phi_start[b]; k < s.phi_start[b + 1]; k++) {
+		set_current(s.phi_var[k], triple_operand(s.phi_at[k]));
+	}
+	for(triple_ref t = blk->start; t < blk->end; t++) {
+		triple *tr = &f->code[t];
+		if(tr->op == IR_NOP) {
+			continue;
+		}
+		if(!is_promoted(tr->a_kind, tr->a)) {
+			s.value[t] = triple_operand(s.new_index[t]);
+		} else if(tr->op == IR_GET) {
+			s.value[t] = s.current[tr->a];
+		} else if(tr->op == IR_SET) {
+			set_current(tr->a, renamed(tr->b_kind, tr->b));
+		}
+	}
+
+	for(uint32_t w = 0; w < blk->succ_count; w++) {
+		block_ref succ = g->succs[blk->succ + w];
+		uint32_t e = s.edge[2 * b + w];
+		for(uint32_t k = s.phi_start[succ]; k < s.phi_start[succ + 1]; k++) {
+			args[s.phi_off[k] + 1 + e] = s.current[s.phi_var[k]];
+		}
+	}
+}
+
+/* Preorder over the dominator tree, so every value is renamed before its uses */
+static void rename_values(ir_func *f, cfg *g, operand *args) {
+	/* A variable read before it is set has no value, 0 will do */
+	for(uint32_t v = 0; v < f->var_count; v++) {
+		s.current[v] = imm_operand(0);
+	}
+	for(block_ref b = 0; b < g->count; b++) {
+		for(uint32_t k = s.phi_start[b]; k < s.phi_start[b + 1]; k++) {
+			args[s.phi_off[k]] = imm_operand(s.arg_count[b]);
+		}
+	}
+
+	uint32_t fp = 0;
+	s.log_count = 0;
+	s.frames[fp++] = (rename_frame){ 0, 0, 0 };
+	rename_block(f, g, 0, args);
+	while(fp > 0) {
+		rename_frame *fr = &s.frames[fp - 1];
+		basic_block *b = &g->blocks[fr->block];
+		if(fr->child == b->child_count) {
+			undo_to(fr->mark);
+			fp--;
+			continue;
+		}
+		block_ref c = g->children[b->child + fr->child++];
+		s.frames[fp++] = (rename_frame){ c, s.log_count, 0 };
+		rename_block(f, g, c, args);
+	}
+}
+
+static void set_operand_a(triple *t, operand o) {
+	t->a_kind = o.kind;
+	t->a = o.val;
+}
+
+static void set_operand_b(triple *t, operand o) {
+	t->b_kind = o.kind;
+	t->b = o.val;
+}
+
+static void emit_ssa(ir_func *f, cfg *g, triple *code) {
+	uint32_t out = 0;
+	for(block_ref b = 0; b < g->count; b++) {
+		basic_block *blk = &g->blocks[b];
+		if(!is_reachable(g, b)) {
+			continue;
+		}
+		uint32_t first = out;
+		triple_ref t = blk->start;
+		if(f->code[t].op == IR_LABEL) {
+			code[out++] = f->code[t++];
+		}
+		for(uint32_t k = s.phi_start[b]; k < s.phi_start[b + 1]; k++) {
+			uint32_t v = s.phi_var[k];
+			code[out] = (triple){ .op = IR_PHI, .size = f->vars[v].size };
+			set_operand_a(&code[out], var_operand(v));
+			set_operand_b(&code[out++], imm_operand(s.phi_off[k]));
+		}
+		for(; t < blk->end; t++) {
+			triple *tr = &f->code[t];
+			if(!is_kept(tr)) {
+				continue;
+			}
+			triple *n = &code[out++];
+			*n = *tr;
+			/* Jump targets are labels, which stay as they are */
+			if(tr->op == IR_JUMP) {
+				set_operand_a(n, triple_operand(s.new_index[tr->a]));
+			} else {
+				set_operand_a(n, renamed(tr->a_kind, tr->a));
+			}
+			if(tr->op == IR_BRANCH || tr->op == IR_BRANCHZ) {
+				set_operand_b(n, triple_operand(s.new_index[tr->b]));
+			} else {
+				set_operand_b(n, renamed(tr->b_kind, tr->b));
+			}
+		}
+		if(out == first) {
+			code[out++] = (triple){ .op = IR_NOP };
+		}
+	}
+}
+
+void enter_ssa(ir_module *m, ir_func *f, cfg *g) {
+	build_cfg(g, f);
+	reserve_blocks(g->count);
+	reserve_vars(f->var_count);
+	reserve_triples(f->count);
+
+	find_promoted(f);
+	find_definitions(f, g);
+	number_levels(g);
+	s.site_count = 0;
+	for(uint32_t v = 0; v < f->var_count; v++) {
+		if(s.var_state[v] == (PROMOTED | LIVE_IN)) {
+			place_phis(g, v);
+		}
+	}
+	sort_phis(g);
+	number_edges(g);
+
+	uint32_t arg_total;
+	uint32_t count = lay_out(f, g, &arg_total);
+	operand *args = arena_alloc(&m->pool, arg_total * sizeof(operand));
+	rename_values(f, g, args);
+	triple *code = arena_alloc(&m->pool, count * sizeof(triple));
+	emit_ssa(f, g, code);
+
+	f->code = code;
+	f->count = count;
+	f->phi_args = args;
+	f->phi_count = arg_total;
+	build_cfg(g, f);
+}
+
+/* The triple ending a block, NO_TRIPLE if it falls through */
+static triple_ref terminator(ir_func *f, basic_block *b) {
+	for(triple_ref t = b->end; t > b->start; t--) {
+		if(f->code[t - 1].op != IR_NOP) {
+			return is_terminator(f->code[t - 1].op) ? t - 1 : NO_TRIPLE;
+		}
+	}
+	return NO_TRIPLE;
+}
+
+/* A block jumping to the next one kept can fall through instead */
+static bool jumps_to_next(ir_func *f, cfg *g, block_ref b, triple_ref term) {
+	if(term == NO_TRIPLE || f->code[term].op != IR_JUMP) {
+		return false;
+	}
+	for(block_ref next = b + 1; next < g->count; next++) {
+		if(is_reachable(g, next)) {
+			return f->code[term].a == g->blocks[next].start;
+		}
+	}
+	return false;
+}
+
+/* Phis come straight after the label, NOPs left by other passes aside */
+static triple_ref first_phi(ir_func *f, basic_block *b) {
+	return f->code[b->start].op == IR_LABEL ? b->start + 1 : b->start;
+}
+
+static bool is_phi_area(ir_func *f, basic_block *b, triple_ref t) {
+	return t < b->end && (f->code[t].op == IR_PHI || f->code[t].op == IR_NOP);
+}
+
+static bool same_operand(operand a, operand b) {
+	return a.kind == b.kind && a.val == b.val;
+}
+
+/*
+ * Each phi becomes the variable it was placed for, coalescing its copies
+ * with the variable's own sets. Between being set at the end of a
+ * predecessor and read at the top of the phi's block nothing else can use
+ * the variable, so the only clash is a block setting it differently for
+ * each of two successors. The second phi then gets a variable of its own.
+ */
+static uint32_t choose_phi_vars(ir_func *f, cfg *g) {
+	uint32_t *var_of = s.def_blocks;
+	uint32_t extra = 0;
+	for(triple_ref t = 0; t < f->count; t++) {
+		triple *tr = &f->code[t];
+		if(tr->op == IR_PHI) {
+			var_of[t] = tr->a_kind == OPERAND_VAR ? tr->a : f->var_count + extra++;
+		}
+	}
+
+	memset(s.var_seen, 0, f->var_count * sizeof(uint32_t));
+	for(block_ref b = 0; b < g->count; b++) {
+		basic_block *blk = &g->blocks[b];
+		if(blk->succ_count != 2 || !is_reachable(g, b)) {
+			continue;
+		}
+		s.mark++;
+		for(uint32_t w = 0; w < 2; w++) {
+			basic_block *succ = &g->blocks[g->succs[blk->succ + w]];
+			uint32_t e = s.edge[2 * b + w];
+			for(triple_ref t = first_phi(f, succ); is_phi_area(f, succ, t); t++) {
+				if(f->code[t].op != IR_PHI || var_of[t] >= f->var_count) {
+					continue;
+				}
+				uint32_t v = var_of[t];
+				operand arg = f->phi_args[f->code[t].b + 1 + e];
+				if(w == 0) {
+					s.var_seen[v] = s.mark;
+					s.current[v] = arg;
+				} else if(s.var_seen[v] == s.mark && !same_operand(s.current[v], arg)) {
+					var_of[t] = f->var_count + extra++;
+				}
+			}
+		}
+	}
+	return extra;
+}
+
+static void add_phi_vars(ir_module *m, ir_func *f, uint32_t extra) {
+	if(extra == 0) {
+		return;
+	}
+	ir_var *vars = arena_alloc(&m->pool, (f->var_count + extra) * sizeof(ir_var));
+	if(f->var_count > 0) {
+		memcpy(vars, f->vars, f->var_count * sizeof(ir_var));
+	}
+	for(triple_ref t = 0; t < f->count; t++) {
+		if(f->code[t].op == IR_PHI && s.def_blocks[t] >= f->var_count) {
+			vars[s.def_blocks[t]] = (ir_var){ .size = f->code[t].size };
+		}
+	}
+	f->vars = vars;
+	f->var_count += extra;
+}
+
+static operand renumbered(uint8_t kind, uint32_t val) {
+	return kind == OPERAND_TRIPLE ? triple_operand(s.new_index[val]) : operand_of(kind, val);
+}
+
+/*
+ * A phi's argument that is a phi of the same variable at the top of the
+ * block needs no copy, nothing sets the variable before the block's own
+ * copies and any of those setting it copy the same value.
+ */
+static bool is_self_copy(ir_func *f, cfg *g, block_ref b, triple_ref phi, operand arg) {
+	return arg.kind == OPERAND_TRIPLE && g->block_of[arg.val] == b && f->code[arg.val].op == IR_PHI
+		&& s.def_blocks[arg.val] == s.def_blocks[phi];
+}
+
+/* The copies a block ends with, one for each phi argument it passes on that isn't already in place */
+static uint32_t copies_out(ir_func *f, cfg *g, block_ref b) {
+	basic_block *blk = &g->blocks[b];
+	uint32_t n = 0;
+	for(uint32_t w = 0; w < blk->succ_count; w++) {
+		basic_block *succ = &g->blocks[g->succs[blk->succ + w]];
+		uint32_t e = s.edge[2 * b + w];
+		for(triple_ref t = first_phi(f, succ); is_phi_area(f, succ, t); t++) {
+			if(f->code[t].op == IR_PHI && !is_self_copy(f, g, b, t, f->phi_args[f->code[t].b + 1 + e])) {
+				n++;
+			}
+		}
+	}
+	return n;
+}
+
+static uint32_t emit_copies_out(ir_func *f, cfg *g, block_ref b, triple *code, uint32_t out) {
+	basic_block *blk = &g->blocks[b];
+	for(uint32_t w = 0; w < blk->succ_count; w++) {
+		basic_block *succ = &g->blocks[g->succs[blk->succ + w]];
+		uint32_t e = s.edge[2 * b + w];
+		for(triple_ref t = first_phi(f, succ); is_phi_area(f, succ, t); t++) {
+			if(f->code[t].op != IR_PHI) {
+				continue;
+			}
+			operand arg = f->phi_args[f->code[t].b + 1 + e];
+			if(is_self_copy(f, g, b, t, arg)) {
+				continue;
+			}
+			code[out] = (triple){ .op = IR_SET, .size = f->code[t].size };
+			set_operand_a(&code[out], var_operand(s.def_blocks[t]));
+			set_operand_b(&code[out++], renumbered(arg.kind, arg.val));
+		}
+	}
+	return out;
+}
+
+/* Marks the blocks jumps still go to once those to the next block are dropped */
+static uint32_t mark_jump_targets(ir_func *f, cfg *g) {
+	s.mark++;
+	for(block_ref b = 0; b < g->count; b++) {
+		if(!is_reachable(g, b)) {
+			continue;
+		}
+		triple_ref term = terminator(f, &g->blocks[b]);
+		if(term == NO_TRIPLE || jumps_to_next(f, g, b, term)) {
+			continue;
+		}
+		triple *tr = &f->code[term];
+		if(tr->op == IR_JUMP) {
+			s.jumped_to[g->block_of[tr->a]] = s.mark;
+		} else if(tr->op == IR_BRANCH || tr->op == IR_BRANCHZ) {
+			s.jumped_to[g->block_of[tr->b]] = s.mark;
+		}
+	}
+	return s.mark;
+}
+
+static bool is_dropped(ir_func *f, block_ref b, triple_ref t, triple_ref dropped, uint32_t mark) {
+	uint8_t op = f->code[t].op;
+	return op == IR_NOP || t == dropped || (op == IR_LABEL && s.jumped_to[b] != mark);
+}
+
+void leave_ssa(ir_module *m, ir_func *f, cfg *g) {
+	reserve_blocks(g->count);
+	reserve_vars(f->var_count);
+	reserve_triples(f->count);
+	number_edges(g);
+
+	uint32_t extra = choose_phi_vars(f, g);
+	uint32_t mark = mark_jump_targets(f, g);
+
+	/*
+	 * Copies go before the jump ending a block. NOPs, unreachable blocks,
+	 * jumps to the next block and labels nothing jumps to any more are dropped.
+	 */
+	uint32_t n = 0;
+	for(block_ref b = 0; b < g->count; b++) {
+		basic_block *blk = &g->blocks[b];
+		if(!is_reachable(g, b)) {
+			continue;
+		}
+		uint32_t first = n;
+		triple_ref term = terminator(f, blk);
+		triple_ref dropped = NO_TRIPLE;
+		if(jumps_to_next(f, g, b, term)) {
+			dropped = term;
+			term = NO_TRIPLE;
+		}
+		for(triple_ref t = blk->start; t < blk->end; t++) {
+			if(is_dropped(f, b, t, dropped, mark)) {
+				continue;
+			}
+			if(t == term) {
+				n += copies_out(f, g, b);
+			}
+			s.new_index[t] = n++;
+		}
+		if(term == NO_TRIPLE) {
+			n += copies_out(f, g, b);
+		}
+		if(n == first) {
+			n++;
+		}
+	}
+
+	triple *code = arena_alloc(&m->pool, n * sizeof(triple));
+	uint32_t out = 0;
+	for(block_ref b = 0; b < g->count; b++) {
+		basic_block *blk = &g->blocks[b];
+		if(!is_reachable(g, b)) {
+			continue;
+		}
+		uint32_t first = out;
+		triple_ref term = terminator(f, blk);
+		triple_ref dropped = NO_TRIPLE;
+		if(jumps_to_next(f, g, b, term)) {
+			dropped = term;
+			term = NO_TRIPLE;
+		}
+		for(triple_ref t = blk->start; t < blk->end; t++) {
+			triple *tr = &f->code[t];
+			if(is_dropped(f, b, t, dropped, mark)) {
+				continue;
+			}
+			if(t == term) {
+				out = emit_copies_out(f, g, b, code, out);
+			}
+			triple *c = &code[out++];
+			if(tr->op == IR_PHI) {
+				*c = (triple){ .op = IR_GET, .size = tr->size };
+				set_operand_a(c, var_operand(s.def_blocks[t]));
+				continue;
+			}
+			*c = *tr;
+			set_operand_a(c, renumbered(tr->a_kind, tr->a));
+			set_operand_b(c, renumbered(tr->b_kind, tr->b));
+		}
+		if(term == NO_TRIPLE) {
+			out = emit_copies_out(f, g, b, code, out);
+		}
+		if(out == first) {
+			code[out++] = (triple){ .op = IR_NOP };
+		}
+	}
+
+	add_phi_vars(m, f, extra);
+	f->code = code;
+	f->count = n;
+	f->phi_args = NULL;
+	f->phi_count = 0;
+	build_cfg(g, f);
+}
@@ -11,7 +11,7 @@
 bool is_statement(token_type t);
 
 void parser_panic(void) {
-	while(get_current_token()->type != SEMI_COLON) {
+	while(get_current_type() != SEMI_COLON) {
 		consume_token();
 	}
 }
@@ -30,6 +30,7 @@ bool is_statement(token_type t) {
 		case CONTINUE:
 		case BREAK:
 		case RETURN:
+		case LBRACE:
 		case ASTERISK:
 			return true;
 		
@@ -45,8 +46,8 @@ bool is_statement(token_type t) {
 node *parse_statement_decl_list(void) {
 	node *tail;
 	node *head;
-	//print_token_type(get_current_token()->type);
-	if(is_statement(get_current_token()->type)) {
+	//print_token_type(get_current_type());
+	if(is_statement(get_current_type())) {
 		head = parse_statement();
 	} else {
 		head = parse_declaration();
@@ -55,59 +56,60 @@ node *parse_statement_decl_list(void) {
 	tail = head;
 
 	while(1) {
-		if(is_statement(get_current_token()->type)) {
-			tail->next = parse_statement();
-		} else if(is_declaration(get_current_token()->type)) {
-			tail->next = parse_declaration();
+		if(is_statement(get_current_type())) {
+			tail->next = REF(parse_statement());
+		} else if(is_declaration(get_current_type())) {
+			tail->next = REF(parse_declaration());
 		} else {
 			break;
 		}
-		tail = tail->next;
+		tail = NODE(tail->next);
 	}	
 	return head;
 }
 
-/* case constant-expression : statement */
+/*
+ * case constant-expression :
+ *
+ * Only the label, parse_statement gives it its statement. NULL if the
+ * colon is missing.
+ */
 node *parse_case_statement(void) {
 	node *c = new_node(CASE_STMT_NODE);
-	c->statement.expr = constant_expr();
-	if(get_current_token()->type != COLON) {
+	c->statement.expr = REF(constant_expr());
+	if(get_current_type() != COLON) {
 		error("Expected ':' after 'case'");
-	} else {
-		consume_token();
-		c->statement.stmt = parse_statement();
+		return NULL;
 	}
+	consume_token();
 	return c;
 }
 
-/* default : statement */
+/* default : */
 node *parse_default_statement(void) {
 	node *d = new_node(DEFAULT_STMT_NODE);
-	if(get_current_token()->type != COLON) {
+	if(get_current_type() != COLON) {
 		error("Expected ':' after 'default'");
-	} else {
-		consume_token();
-		d->statement.stmt = parse_statement();
+		return NULL;
 	}
+	consume_token();
 	return d;
 }
 
 node *parse_decl_list(node *prev) {
-	if(is_declaration(get_current_token()->type)) {
+	if(is_declaration(get_current_type())) {
 		if(prev == NULL) {
 			prev = parse_declaration();
 		} 
 
-		if(is_declaration(get_current_token()->type)) {
-			prev->next = parse_declaration();
-			return parse_decl_list(prev->next);
-		} else {
-			return prev;
+		while(is_declaration(get_current_type())) {
+			prev->next = REF(parse_declaration());
+			prev = NODE(prev->next);
 		}
 	} else {
 		//debug("found no declaration in compound statement");
-		return prev;
 	}
+	return prev;
 }
 
 /*
@@ -117,9 +119,9 @@ node *parse_compound_statement(void) {
 	enter_scope();
 	node *c = new_node(COMPOUND_STMT_NODE);
 	//c->statement.expr = parse_decl_list(NULL); /* Declarations can involve expressions */
-	c->statement.stmt = parse_statement_decl_list();
+	c->statement.stmt = REF(parse_statement_decl_list());
 
-	if(get_current_token()->type != RBRACE) {
+	if(get_current_type() != RBRACE) {
 		error("expected '}'");
 	} else {
 		consume_token();
@@ -133,28 +135,49 @@ node *parse_compound_statement(void) {
 /*
  * if ( expression ) statement
  * if ( expression ) statement else statement
+ *
+ * An else if chain is parsed in a loop, each if becoming the else
+ * statement of the one before it.
  */
 node *parse_if_statement(void) {
-	node *i = new_node(IF_STMT_NODE);
-	if(!EXPECT_TOKEN(LPAREN)) {
-		error("expected '(' before expression");
-	} else {
+	node *head = NULL;
+	node *prev = NULL;
+
+	for(;;) {
+		node *i = new_node(IF_STMT_NODE);
+		if(prev == NULL) {
+			head = i;
+		} else {
+			prev->if_statement.e_stmt = REF(i);
+		}
+
+		if(!EXPECT_TOKEN(LPAREN)) {
+			error("expected '(' before expression");
+			return head;
+		}
 		consume_token();
-		i->if_statement.expr = parse_expr();
+		i->if_statement.expr = REF(parse_expr());
 		if(!EXPECT_TOKEN(RPAREN)) {
 			error("expected ')' before statement");
-		} else {
-			consume_token();
-			i->if_statement.i_stmt = parse_statement();
-			if(EXPECT_TOKEN(ELSE)) {
-				debug("found else in if statement");
-				i->type = IF_ELSE_STMT_NODE;
-				consume_token();
-				i->if_statement.e_stmt = parse_statement();
-			}
+			return head;
+		}
+		consume_token();
+		i->if_statement.i_stmt = REF(parse_statement());
+		if(!EXPECT_TOKEN(ELSE)) {
+			return head;
+		}
+
+		debug("found else in if statement");
+		i->type = IF_ELSE_STMT_NODE;
+		consume_token();
+		if(!EXPECT_TOKEN(IF)) {
+			i->if_statement.e_stmt = REF(parse_statement());
+			return head;
 		}
+		debug("parse_if_statement()");
+		consume_token();
+		prev = i;
 	}
-	return i;
 }
 
 /* switch ( expression ) statement */
@@ -164,12 +187,12 @@ node *parse_switch_statement(void) {
 		error("expected '(' before expression");
 	} else {
 		consume_token();
-		s->statement.expr = parse_expr();
+		s->statement.expr = REF(parse_expr());
 		if(!EXPECT_TOKEN(RPAREN)) {
 			error("expected ')' before statement");
 		} else {
 			consume_token();
-			s->statement.stmt = parse_statement();
+			s->statement.stmt = REF(parse_statement());
 		}
 	}
 	return s;
@@ -184,12 +207,12 @@ node *parse_while_statement(void) {
 		error("expected '(' before expression");
 	} else {
 		consume_token();
-		w->statement.expr = parse_expr();
+		w->statement.expr = REF(parse_expr());
 		if(!EXPECT_TOKEN(RPAREN)) {
 			error("expected ')' before statement");
 		} else {
 			consume_token();
-			w->statement.stmt = parse_statement();
+			w->statement.stmt = REF(parse_statement());
 		}
 	}
 	return w;
@@ -200,7 +223,7 @@ node *parse_while_statement(void) {
  */
 node *parse_do_statement(void) {
 	node *d = new_node(DO_STMT_NODE);
-	d->statement.stmt = parse_statement();
+	d->statement.stmt = REF(parse_statement());
 	if(!EXPECT_TOKEN(WHILE)) {
 		error("expected 'while'");
 	} else {
@@ -209,7 +232,7 @@ node *parse_do_statement(void) {
 			error("expected '(' before expression");
 		} else {
 			consume_token();
-			d->statement.expr = parse_expr();
+			d->statement.expr = REF(parse_expr());
 			if(!EXPECT_TOKEN(RPAREN)) {
 				error("expected ')' after expression");
 			} else {
@@ -234,17 +257,17 @@ node *parse_for_statement(void) {
 		error("expected '(' before expression");
 	} else {
 		consume_token();
-		f->for_statement.expr_1 = parse_expr();
+		f->for_statement.expr_1 = REF(parse_expr());
 		consume_token();
-		f->for_statement.expr_2 = parse_expr();
+		f->for_statement.expr_2 = REF(parse_expr());
 		consume_token();
-		f->for_statement.expr_3 = parse_expr();
+		f->for_statement.expr_3 = REF(parse_expr());
 
 		if(!EXPECT_TOKEN(RPAREN)) {
 			error("expected ')' before statement");
 		} else {
 			consume_token();
-			f->for_statement.stmt = parse_statement();
+			f->for_statement.stmt = REF(parse_statement());
 		}
 	}
 	return f;
@@ -256,8 +279,8 @@ node *parse_goto_statement(void) {
 	if(!EXPECT_TOKEN(IDENTIFIER)) {
 		error("expected identifier before ';'");
 	} else {
-		/* We know its an identifier. primary_expr() consumes the token */
-		g->statement.expr = primary_expr(); 
+		/* Labels are not ordinary identifiers so it isn't resolved */
+		g->statement.expr = REF(identifier_node());
 		if(!EXPECT_TOKEN(SEMI_COLON)) {
 			error("expected ';' at the end of statement");
 		} else {
@@ -284,7 +307,7 @@ node *parse_continue_break(node_type t) {
 /* return expression[opt] ; */
 node *parse_return_statement(void) {
 	node *r = new_node(RETURN_STMT_NODE);
-	r->statement.expr = parse_expr(); /* returns null if stmt is just return; */
+	r->statement.expr = REF(parse_expr()); /* returns null if stmt is just return; */
 	if(!EXPECT_TOKEN(SEMI_COLON)) {
 		error("expected ';' at the end of statement");
 	} else {
@@ -293,43 +316,84 @@ node *parse_return_statement(void) {
 	return r;
 }
 
-/* identifier : statement */
+/* identifier : */
 node *parse_label_statement(void) {
 	node *l = new_node(LABEL_STMT_NODE);
-	l->statement.expr = parse_expr(); /* known to be an identifier */
+	l->statement.expr = REF(identifier_node()); /* known to be an identifier */
 	consume_token(); /* known to be a colon */
-	l->statement.stmt = parse_statement();
 	return l;
 }
 
-node *parse_statement(void) {
-	node *s = NULL;
-	switch(get_current_token()->type) {
-		case ASTERISK:
+static bool is_label(void) {
+	token_type t = get_current_type();
+	return t == CASE || t == DEFAULT || (t == IDENTIFIER && peek_next_type() == COLON);
+}
+
+/* Parses the label is_label found, NULL if it was malformed */
+static node *parse_label(void) {
+	switch(get_current_type()) {
 		case IDENTIFIER:
-			if(peek_next_token()->type == COLON) {
-				debug("parse_label_statement()");
-				s = parse_label_statement();
-			} else {
-				s = parse_expr();
-				if(get_current_token()->type != SEMI_COLON) {
-					error("expected ';' at end of statement");
-				} else {
-					consume_token();
-				}
-			}
-		break;
-		
+			debug("parse_label_statement()");
+			return parse_label_statement();
+
 		case CASE:
 			debug("parse_case_statement()");
 			consume_token();
-			s = parse_case_statement();
-		break;
+			return parse_case_statement();
 
 		case DEFAULT:
 			debug("parse_default_statement()");
 			consume_token();
-			s = parse_default_statement();
+			return parse_default_statement();
+
+		default:
+			return NULL;
+	}
+}
+
+static node *parse_unlabelled_statement(void);
+
+/*
+ * A run of labels is parsed in a loop, each label's statement being the
+ * next label, and the last one's the statement they all label. A switch
+ * can have a long run of case labels.
+ */
+node *parse_statement(void) {
+	node *head = NULL;
+	node *prev = NULL;
+	node *l;
+
+	while(is_label()) {
+		l = parse_label();
+		if(l == NULL) {
+			return head;
+		}
+		if(prev == NULL) {
+			head = l;
+		} else {
+			prev->statement.stmt = REF(l);
+		}
+		prev = l;
+	}
+
+	if(prev == NULL) {
+		return parse_unlabelled_statement();
+	}
+	prev->statement.stmt = REF(parse_unlabelled_statement());
+	return head;
+}
+
+static node *parse_unlabelled_statement(void) {
+	node *s = NULL;
+	switch(get_current_type()) {
+		case ASTERISK:
+		case IDENTIFIER:
+			s = parse_expr();
+			if(get_current_type() != SEMI_COLON) {
+				error("expected ';' at end of statement");
+			} else {
+				consume_token();
+			}
 		break;
 
 		case LBRACE:
@@ -547,42 +611,54 @@ void print_node_type(node_type type) {
 	}
 }
 
-void print_statement(node *s, int indent);
-
-void print_statement_list(node *l, int indent) {
-	node *head = l;
-	while(head != NULL) {
-		print_statement(head, indent);
-		head = head->next;
-	}
-}
-
-void print_statement(node *s, int indent) {
-	//print_node_type(s->type);
-	node *head;
-	if(s == NULL) {
+/*
+ * The tree is printed depth first from an explicit stack, so very deep
+ * expression trees or else if chains can't overflow the call stack.
+ * A list frame prints its node and then carries on with the node's next.
+ */
+typedef struct {
+	node *n;
+	int indent;
+	bool list;
+} print_frame;
+
+typedef struct {
+	print_frame *frames;
+	size_t sp;
+	size_t cap;
+} print_stack;
+
+static void push_print(print_stack *st, node *n, int indent, bool list) {
+	if(n == NULL) {
 		return;
 	}
+	if(st->sp == st->cap) {
+		st->cap = st->cap == 0 ? 64 : st->cap * 2;
+		st->frames = realloc(st->frames, st->cap * sizeof(print_frame));
+	}
+	st->frames[st->sp++] = (print_frame){ n, indent, list };
+}
 
-	for(int i = 0; i < indent*2; i++) {
+static void print_indent_spaces(int n) {
+	for(int i = 0; i < n; i++) {
 		printf(" ");
 	}
+}
+
+/* Prints a single node and pushes its children, last child first */
+static void print_node(print_stack *st, node *s, int indent) {
+	print_indent_spaces(indent*2);
 	
 	switch(s->type)	{
 		case IDENTIFIER_NODE: 
 			print_node_type(s->type);
-			for(int i = 0; i <= indent*2; i++) {
-				printf(" ");
-			}
+			print_indent_spaces(indent*2 + 1);
 			printf("`- %s\n", (char *)s->constant.tok_str);
-			
 		break;
 
 		case STRING_LITERAL_NODE:
 			print_node_type(s->type);
-			for(int i = 0; i <= indent*2; i++) {
-				printf(" ");
-			}
+			print_indent_spaces(indent*2 + 1);
 			
 			if(s->constant.tok_str == NULL) {
 				printf("`- empty string literal\n");
@@ -594,45 +670,23 @@ void print_statement(node *s, int indent) {
 		case INTEGER_CONSTANT_NODE:
 		case CHAR_CONSTANT_NODE:
 			print_node_type(s->type);
-			for(int i = 0; i <= indent*2; i++) {
-				printf(" ");
-			}
-
-			printf("`- %d\n", s->constant.val);
-			/*
-			if(s->constant.tok != NULL) {
-				printf("`- %s\n", (char *)s->constant.tok->attr);
-			} else {
-				printf("`- empty string literal\n");
-			}
-			*/
+			print_indent_spaces(indent*2 + 1);
+			printf(s->constant.is_unsigned ? "`- %u\n" : "`- %d\n", s->constant.val);
 		break;
 
-		
 		case BITFIELD_DECL_NODE:
 		case DECLARATION_NODE:
 			print_node_type(s->type);
-			for(int i = 0; i < indent*2; i++) {
-				printf(" ");
-			}
+			print_indent_spaces(indent*2);
 			
+			push_print(st, NODE(s->declaration.initialiser), indent + 1, true);
+			push_print(st, NODE(s->declaration.declarator), indent + 1, false);
 			if(get_decl_type(s) != STRUCT && get_decl_type(s) != UNION) {
 				printf("`- ");
 				print_type_specifier(get_decl_type(s));
 			} else {
-				print_statement(s->declaration.specifier, indent);
+				push_print(st, NODE(s->declaration.specifier), indent, false);
 			}
-
-			indent++;
-			//print_node_type(s->declaration.declarator->type);
-			print_statement(s->declaration.declarator, indent);
-			//if(s->type == FUNC_DEF_NODE) {
-			//	printf("test568\n");
-			//	print_statement(s->declaration.stmt, indent);
-			//} else {
-				print_statement_list(s->declaration.initialiser, indent);
-			//}
-			indent--;
 		break;
 
 		case DECLARATOR_NODE:
@@ -642,99 +696,68 @@ void print_statement(node *s, int indent) {
 			} else {
 				printf("\n");
 			}
-			indent++;
-			print_statement(s->declarator.direct_declarator, indent);
-			indent--;
+			push_print(st, NODE(s->declarator.direct_declarator), indent + 1, false);
 		break;
 
 		case STRUCT_ACCESS_NODE:
 		case ARRAY_ACCESS_NODE:
 		case FUNCTION_CALL_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->postfix.lval, indent);
-			print_statement_list(s->postfix.params, indent);
-			indent--;
+			push_print(st, NODE(s->postfix.params), indent + 1, true);
+			push_print(st, NODE(s->postfix.lval), indent + 1, false);
 		break;
 
 		case INITIALIZER_LIST_NODE:
 			print_node_type(s->type);
-			//printf("size = %d\n", s->init_list.count);	
-			indent++;
-			node *ptr = s->init_list.head;
-			while(ptr != NULL) {
-				print_statement(ptr, indent);
-				ptr = ptr->next;
-			}
-			indent--;
+			push_print(st, NODE(s->init_list.head), indent + 1, true);
 		break;
 		
 		case STRUCT_DECL_NODE:
 		case UNION_DECL_NODE:
 		case ENUM_DECL_NODE:
 			print_node_type(s->type);
-			indent++;
-			
-			for(int i = 0; i < indent*2; i++) {
-				printf(" ");
-			}
+			print_indent_spaces((indent + 1)*2);
 
 			if(s->comp_declarator.identifier == NULL) {
 				printf("`- anonymous\n");
 			} else {
 				printf("`- %s\n", s->comp_declarator.identifier);
 			}
-
-			if(s->comp_declarator.decl_list != NULL) {
-				print_statement_list(s->comp_declarator.decl_list, indent);
-			}
-
-			indent--;
+			push_print(st, NODE(s->comp_declarator.decl_list), indent + 1, true);
 		break;
 
 	    case FUNC_DEF_NODE:
 		case FUNC_DECL_NODE:
 		case ARRAY_DECL_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->direct_declarator.direct, indent);
-			print_statement_list(s->direct_declarator.params, indent);
 			if(s->type == FUNC_DEF_NODE) {
-				print_statement(s->direct_declarator.stmt, indent);
+				push_print(st, NODE(s->direct_declarator.stmt), indent + 1, false);
 			}
-			indent--;
+			push_print(st, NODE(s->direct_declarator.params), indent + 1, true);
+			push_print(st, NODE(s->direct_declarator.direct), indent + 1, false);
 		break;
 
-	
 		case ASSIGNMENT_EXPR_NODE:
 		case BINARY_EXPR_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->expression.lval, indent);
-			print_statement(s->expression.rval, indent);
-			indent--;
+			push_print(st, NODE(s->expression.rval), indent + 1, false);
+			push_print(st, NODE(s->expression.lval), indent + 1, false);
 		break;
 
 		case UNARY_EXPR_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->unary.rval, indent);
-			indent--;
+			push_print(st, NODE(s->unary.rval), indent + 1, false);
 		break;
 
 		case POSTFIX_EXPR_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->postfix.lval, indent);
-			indent--;
+			push_print(st, NODE(s->postfix.lval), indent + 1, false);
 		break;
 		
 		case CAST_EXPR_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->cast.a_decl, indent);
-			print_statement(s->cast.expr, indent);
-			indent--;
+			push_print(st, NODE(s->cast.expr), indent + 1, false);
+			push_print(st, NODE(s->cast.a_decl), indent + 1, false);
 		break;
 
 		case LABEL_STMT_NODE:
@@ -745,21 +768,14 @@ void print_statement(node *s, int indent) {
 		case SWITCH_STMT_NODE:
 		case WHILE_STMT_NODE:
 			print_node_type(s->type);
-			indent++;
-			//print_statement(s->statement.expr, indent);
-			//print_statement(s->statement.stmt, indent);
-			
-			print_statement_list(s->statement.expr, indent);
-			print_statement_list(s->statement.stmt, indent);
-			indent--;
+			push_print(st, NODE(s->statement.stmt), indent + 1, true);
+			push_print(st, NODE(s->statement.expr), indent + 1, true);
 		break;
 
 		case GOTO_STMT_NODE:
 		case RETURN_STMT_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->statement.expr, indent);
-			indent--;
+			push_print(st, NODE(s->statement.expr), indent + 1, false);
 		break;
 
 		case CONTINUE_STMT_NODE:
@@ -769,43 +785,55 @@ void print_statement(node *s, int indent) {
 
 		case DO_STMT_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->statement.stmt, indent);
-			print_statement(s->statement.expr, indent);
-			indent--;
+			push_print(st, NODE(s->statement.expr), indent + 1, false);
+			push_print(st, NODE(s->statement.stmt), indent + 1, false);
 		break;
 
 		case IF_STMT_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->if_statement.expr, indent);
-			print_statement(s->if_statement.i_stmt, indent);
-			indent--;
+			push_print(st, NODE(s->if_statement.i_stmt), indent + 1, false);
+			push_print(st, NODE(s->if_statement.expr), indent + 1, false);
 		break;
 
 		case IF_ELSE_STMT_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->if_statement.expr, indent);
-			print_statement(s->if_statement.i_stmt, indent);
-			print_statement(s->if_statement.e_stmt, indent);
-			indent--;
+			push_print(st, NODE(s->if_statement.e_stmt), indent + 1, false);
+			push_print(st, NODE(s->if_statement.i_stmt), indent + 1, false);
+			push_print(st, NODE(s->if_statement.expr), indent + 1, false);
 		break;
 	
 		case FOR_STMT_NODE:
 			print_node_type(s->type);
-			indent++;
-			print_statement(s->for_statement.expr_1, indent);
-			print_statement(s->for_statement.expr_2, indent);
-			print_statement(s->for_statement.expr_3, indent);
-			print_statement(s->for_statement.stmt, indent);
-			indent--;
+			push_print(st, NODE(s->for_statement.stmt), indent + 1, false);
+			push_print(st, NODE(s->for_statement.expr_3), indent + 1, false);
+			push_print(st, NODE(s->for_statement.expr_2), indent + 1, false);
+			push_print(st, NODE(s->for_statement.expr_1), indent + 1, false);
 		break;
 	
 		default:
 			printf("Unknown statement type: %d\n", s->type);
-			return;
+		break;
 	}
-	return;
 }
 
+static void print_tree_from(node *s, int indent, bool list) {
+	print_stack st = { 0 };
+	push_print(&st, s, indent, list);
+
+	while(st.sp > 0) {
+		print_frame f = st.frames[--st.sp];
+		if(f.list) {
+			push_print(&st, NODE(f.n->next), f.indent, true);
+		}
+		print_node(&st, f.n, f.indent);
+	}
+	free(st.frames);
+}
+
+void print_statement_list(node *l, int indent) {
+	print_tree_from(l, indent, true);
+}
+
+void print_statement(node *s, int indent) {
+	print_tree_from(s, indent, false);
+}
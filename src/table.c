@@ -4,47 +4,190 @@
 #include "../inc/error.h"
 #include "../inc/decl.h"
 #include "../inc/stmt.h"
+#include "../inc/arena.h"
 #include <stdlib.h>
 #include <string.h>
 
-#define NEW_TABLE calloc(1, sizeof(symbol_table))
+#define SYMBOL_HASH_INITIAL_SIZE 256 /* Must be a power of two */
+#define SCOPE_POOL_CHUNK (4 * 1024)
+#define UNDO_LOG_INITIAL_SIZE 64
 
-int scope_count = 0;
+/*
+ * Symbols are found through an open addressing hash table keyed on the
+ * interned identifier. Each entry points at the innermost symbol with that
+ * identifier, which points at the one it shadows and so on outwards, so a
+ * lookup is a probe and a short walk rather than a search of every scope.
+ *
+ * Globals have their own table which is shared between threads. Every
+ * parsing thread has a table for its own local scopes.
+ */
+typedef struct {
+	char *ident;
+	symbol *sym; /* NULL once every symbol with this identifier has gone out of scope */
+} symbol_entry;
+
+typedef struct {
+	symbol_entry *entries;
+	size_t size;
+	size_t count;
+} symbol_hash;
+
+static symbol_hash global_symbols;
+static _Thread_local symbol_hash local_symbols;
+
+/*
+ * Every symbol added is pushed onto an undo log, and a scope remembers how
+ * long the log was when it was entered. Leaving a scope pops the log back
+ * to that mark, unshadowing each symbol on the way, and the scope goes
+ * back to the thread's pool to be handed out again. The symbols themselves
+ * stay, identifiers that were resolved to them still point to them.
+ */
+typedef struct {
+	symbol **syms;
+	size_t count;
+	size_t cap;
+} undo_log;
+
+static undo_log global_log;
+static _Thread_local undo_log local_log;
+
+static _Thread_local arena scope_pool;
+static _Thread_local symbol_table *free_scopes;
+
+/* The global scope is shared, every parsing thread has its own chain of local scopes */
+_Thread_local int scope_count = 0;
 
 symbol_table *global_scope;
-symbol_table *current_scope;
+_Thread_local symbol_table *current_scope;
+
+/* Identifiers are interned so the pointer is the key */
+static size_t hash_ident(char *id) {
+	return (size_t)(((uintptr_t)id >> 3) * 0x9e3779b97f4a7c15ull);
+}
 
+static void grow_symbol_hash(symbol_hash *h) {
+	symbol_entry *old = h->entries;
+	size_t old_size = h->size;
+
+	h->size = old_size == 0 ? SYMBOL_HASH_INITIAL_SIZE : old_size * 2;
+	h->entries = calloc(h->size, sizeof(symbol_entry));
+
+	for(size_t i = 0; i < old_size; i++) {
+		if(old[i].ident != NULL) {
+			size_t j = hash_ident(old[i].ident) & (h->size - 1);
+			while(h->entries[j].ident != NULL) {
+				j = (j + 1) & (h->size - 1);
+			}
+			h->entries[j] = old[i];
+		}
+	}
+	free(old);
+}
+
+/* Entry for the identifier, creating an empty one if insert is set */
+static symbol_entry *find_entry(symbol_hash *h, char *id, bool insert) {
+	if(h->size == 0) {
+		if(!insert) {
+			return NULL;
+		}
+		grow_symbol_hash(h);
+	}
+
+	size_t i = hash_ident(id) & (h->size - 1);
+	while(h->entries[i].ident != NULL) {
+		if(h->entries[i].ident == id) {
+			return &h->entries[i];
+		}
+		i = (i + 1) & (h->size - 1);
+	}
+
+	if(!insert) {
+		return NULL;
+	}
+	/* Entries are never removed, only emptied, so keep the load under a half */
+	if((h->count + 1) * 2 > h->size) {
+		grow_symbol_hash(h);
+		return find_entry(h, id, insert);
+	}
+	h->entries[i].ident = id;
+	h->count++;
+	return &h->entries[i];
+}
+
+static symbol_hash *scope_hash(symbol_table *scope) {
+	return scope == global_scope ? &global_symbols : &local_symbols;
+}
+
+static undo_log *scope_log(symbol_table *scope) {
+	return scope == global_scope ? &global_log : &local_log;
+}
+
+static void push_undo(undo_log *l, symbol *s) {
+	if(l->count == l->cap) {
+		l->cap = l->cap == 0 ? UNDO_LOG_INITIAL_SIZE : l->cap * 2;
+		l->syms = realloc(l->syms, l->cap * sizeof(symbol *));
+	}
+	l->syms[l->count++] = s;
+}
+
+static symbol_table *new_scope(void) {
+	symbol_table *t = free_scopes;
+	if(t != NULL) {
+		free_scopes = t->prev;
+		return t;
+	}
+	return arena_alloc(&scope_pool, sizeof(symbol_table));
+}
 
 void init_symbol_table(void) {
-	global_scope = NEW_TABLE;
+	arena_init(&scope_pool, SCOPE_POOL_CHUNK);
+	global_scope = new_scope();
 	global_scope->scope_num = scope_count;
+	global_scope->mark = 0;
+	global_scope->prev = NULL;
 	current_scope = global_scope;
 	scope_count++;
 }
 
+/* Starts another thread off in the global scope */
+void init_thread_scope(void) {
+	arena_init(&scope_pool, SCOPE_POOL_CHUNK);
+	current_scope = global_scope;
+	scope_count = global_scope->scope_num + 1;
+}
+
+/* Frees the thread's scopes, it must be back in the global scope */
+void finish_thread_scope(void) {
+	arena_release(&scope_pool);
+	free_scopes = NULL;
+	free(local_log.syms);
+	local_log = (undo_log){ 0 };
+	free(local_symbols.entries);
+	local_symbols = (symbol_hash){ 0 };
+}
+
 void enter_scope(void) {
 	symbol_table *prev_scope = current_scope;
-	current_scope->next = NEW_TABLE;
-	current_scope = current_scope->next;
+	current_scope = new_scope();
 //	printf("entering scope %d\n", scope_count);
 	current_scope->prev = prev_scope;
 	current_scope->scope_num = scope_count;
+	current_scope->mark = local_log.count;
 	scope_count++;
 }
 
+/* Pops the scope's symbols off the undo log, unshadowing whatever they were hiding */
 void exit_scope(void) {
 //	printf("exiting scope %d\n", current_scope->scope_num);
 	if(current_scope != global_scope) {
-		symbol *ptr = current_scope->head;
-
-		while(ptr != NULL) {
-			symbol *tmp = ptr->next;
-			free(ptr);
-			ptr = tmp;
+		while(local_log.count > current_scope->mark) {
+			symbol *s = local_log.syms[--local_log.count];
+			find_entry(&local_symbols, s->ident, false)->sym = s->shadow;
 		}
 
 		symbol_table *next_scope = current_scope->prev;
-		free(current_scope);
+		current_scope->prev = free_scopes;
+		free_scopes = current_scope;
 		current_scope = next_scope;
 		scope_count--;
 	} else {
@@ -52,39 +195,88 @@ void exit_scope(void) {
 	}
 }
 
-void add_symbol(node_type n, token_type t, char *id, node *params) {
-	symbol *s = calloc(1, sizeof(symbol));
+symbol *add_symbol(node_type n, token_type t, char *id, node *params, type *ty) {
+	symbol *s = new_symbol();
 	s->type = t;
 	s->ident = id;
 	s->params = params;
+	s->ty = ty;
 	s->n_type = n;
+	s->scope = current_scope->scope_num;
+	s->pos = get_token_index();
+	push_undo(scope_log(current_scope), s);
 
-	if(current_scope->sym_count == 0) {
-		current_scope->head = s;
-		current_scope->tail = s;
-	} else {
-		current_scope->tail->next = s;
-		current_scope->tail = s;
+	symbol_entry *e = find_entry(scope_hash(current_scope), id, true);
+	s->shadow = e->sym;
+	e->sym = s;
+	return s;
+}
+
+/* Which symbols in a shadow chain a search is looking for */
+typedef enum {
+	MATCH_EXACT,    /* The given node and token type */
+	MATCH_ORDINARY, /* Any ordinary identifier */
+	MATCH_TAG       /* A struct or union tag, they are in a name space of their own */
+} match_kind;
+
+static bool matches(symbol *s, match_kind m, node_type n, token_type t) {
+	bool tag = s->n_type == STRUCT_DECL_NODE || s->n_type == UNION_DECL_NODE;
+	switch(m) {
+		case MATCH_ORDINARY:
+			return !tag;
+		case MATCH_TAG:
+			return tag;
+		default:
+			return s->type == t && s->n_type == n;
 	}
-	current_scope->sym_count++;
 }
 
-/* Searches for the symbol from the current scope upwards */
-symbol *get_symbol(node_type n, token_type t, char *id) {
-	symbol_table *scope = current_scope;
-	symbol *ptr = NULL;
-	while(scope->prev != NULL) {
-		symbol *ptr = scope->head;
-		while(ptr != NULL) {
-			if(!strcmp(id, ptr->ident) && ptr->type == t && ptr->n_type == n) {
-				return ptr;
-			} else {
-				ptr = ptr->next;
-			}
+/*
+ * Function bodies may be parsed after the whole top level has been, so a
+ * global declared further on is skipped. Locals are always declared first.
+ */
+static symbol *search_shadow_chain(symbol_hash *h, node_type n, token_type t, char *id, match_kind m) {
+	symbol_entry *e = find_entry(h, id, false);
+	if(e == NULL) {
+		return NULL;
+	}
+	size_t pos = get_token_index();
+	for(symbol *s = e->sym; s != NULL; s = s->shadow) {
+		if(matches(s, m, n, t) && (h != &global_symbols || s->pos < pos)) {
+			return s;
 		}
-		scope = scope->prev;
 	}
-	return ptr;
+	return NULL;
+}
+
+/* Searches the current scope outwards. Identifiers are interned so compare by pointer. */
+static symbol *search_scopes(node_type n, token_type t, char *id, match_kind m) {
+	symbol *s = NULL;
+	if(current_scope != global_scope) {
+		s = search_shadow_chain(&local_symbols, n, t, id, m);
+	}
+	if(s == NULL) {
+		s = search_shadow_chain(&global_symbols, n, t, id, m);
+	}
+	return s;
+}
+
+symbol *get_symbol(node_type n, token_type t, char *id) {
+	return search_scopes(n, t, id, MATCH_EXACT);
+}
+
+/* The innermost declaration of an ordinary identifier */
+symbol *lookup_symbol(char *id) {
+	return search_scopes(0, 0, id, MATCH_ORDINARY);
+}
+
+/* The innermost struct or union tag, or only one declared in the current scope */
+symbol *lookup_tag(char *id, bool innermost) {
+	symbol *s = search_scopes(0, 0, id, MATCH_TAG);
+	if(s != NULL && innermost && s->scope != current_scope->scope_num) {
+		return NULL;
+	}
+	return s;
 }
 
 symbol_table *get_global_table(void) {
@@ -97,22 +289,23 @@ void print_indent(void) {
 	}
 }
 
+/* The current scope's symbols are the top of the undo log */
 void print_symbol_table(void) {
 	symbol_table *t = current_scope;
+	undo_log *l = scope_log(t);
 	printf("Scope:	%d\n", t->scope_num);
-	symbol *ptr = t->head;
-	
-	while(ptr != NULL) {
+
+	for(size_t i = t->mark; i < l->count; i++) {
+		symbol *ptr = l->syms[i];
 		printf("Node type: ");
 		print_node_type(ptr->n_type);
 		printf("\nType:	");
 		print_type_specifier(ptr->type);
 		printf("ID:	%s\n", ptr->ident);
-		ptr = ptr->next;
 	}
 }
 
 symbol *new_symbol(void) {
-	return calloc(1, sizeof(symbol));
+	return new_node_data(sizeof(symbol));
 }
 
@@ -1,39 +1,742 @@
-/* TODO: tidy these up */
-#include "../inc/lex.h"
-#include "../inc/node.h"
-#include "../inc/token.h"
-#include "../inc/stmt.h"
-#include "../inc/expr.h"
-#include "../inc/table.h"
 #include "../inc/triple.h"
-#include <stdio.h>
+#include "../inc/intern.h"
+#include "../inc/error.h"
 #include <stdlib.h>
+#include <string.h>
 
-triple *new_triple(void) {
-	return calloc(1, sizeof(triple));
+#define IR_POOL_CHUNK (64 * 1024)
+#define BUILDER_INITIAL_SIZE 256
+#define VAR_HASH_INITIAL_SIZE 64 /* Must be a power of two */
+#define GLOBAL_HASH_INITIAL_SIZE 64 /* Must be a power of two */
+#define IR_MAGIC 0x3252494d /* "MIR2" */
+
+static char *op_names[IR_OP_COUNT] = {
+	[IR_NOP] = "nop",
+	[IR_LABEL] = "label",
+	[IR_JUMP] = "jump",
+	[IR_BRANCH] = "branch",
+	[IR_BRANCHZ] = "branchz",
+	[IR_RET] = "ret",
+	[IR_PARAM] = "param",
+	[IR_GET] = "get",
+	[IR_SET] = "set",
+	[IR_ADDR] = "addr",
+	[IR_LOAD] = "load",
+	[IR_STORE] = "store",
+	[IR_ARG] = "arg",
+	[IR_CALL] = "call",
+	[IR_COPY] = "copy",
+	[IR_CONV] = "conv",
+	[IR_PHI] = "phi",
+	[IR_STRING] = "string",
+	[IR_NEG] = "neg",
+	[IR_COM] = "com",
+	[IR_ADD] = "add",
+	[IR_SUB] = "sub",
+	[IR_MUL] = "mul",
+	[IR_DIV] = "div",
+	[IR_MOD] = "mod",
+	[IR_SHL] = "shl",
+	[IR_SHR] = "shr",
+	[IR_AND] = "and",
+	[IR_OR] = "or",
+	[IR_XOR] = "xor",
+	[IR_EQ] = "eq",
+	[IR_NE] = "ne",
+	[IR_LT] = "lt",
+	[IR_LE] = "le",
+	[IR_GT] = "gt",
+	[IR_GE] = "ge"
+};
+
+/*
+ * The function being built. Its code and variables grow in buffers that
+ * are reused from one function to the next, and are copied into the
+ * module's arena once the function is finished so they end up dense.
+ *
+ * A symbol's variable is found through a hash keyed on the symbol. Entries
+ * from earlier functions are told apart by the generation they were made
+ * in, so the table never has to be cleared.
+ */
+typedef struct {
+	symbol *sym;
+	uint32_t var;
+	uint32_t gen;
+} var_entry;
+
+typedef struct {
+	symbol *sym;
+	triple *code;
+	uint32_t count;
+	uint32_t cap;
+	ir_var *vars;
+	uint32_t var_count;
+	uint32_t var_cap;
+	var_entry *entries;
+	uint32_t size;
+	uint32_t gen;
+} ir_builder;
+
+static _Thread_local ir_builder builder;
+
+operand no_operand(void) {
+	return (operand){OPERAND_NONE, 0};
+}
+
+operand triple_operand(triple_ref t) {
+	return (operand){OPERAND_TRIPLE, t};
+}
+
+operand imm_operand(uint32_t val) {
+	return (operand){OPERAND_IMM, val};
+}
+
+operand var_operand(uint32_t var) {
+	return (operand){OPERAND_VAR, var};
+}
+
+ir_module *new_ir_module(void) {
+	ir_module *m = calloc(1, sizeof(ir_module));
+	arena_init(&m->pool, IR_POOL_CHUNK);
+	return m;
+}
+
+void release_ir_module(ir_module *m) {
+	arena_release(&m->pool);
+	free(m->funcs);
+	free(m->globals);
+	free(m->global_hash);
+	free(m->strings);
+	free(m);
+}
+
+static uint32_t add_decoded_string(ir_module *m, char *bytes, uint32_t len) {
+	if(m->string_count == m->string_cap) {
+		m->string_cap = m->string_cap == 0 ? 16 : m->string_cap * 2;
+		m->strings = realloc(m->strings, m->string_cap * sizeof(ir_string));
+	}
+	m->strings[m->string_count] = (ir_string){ bytes, len };
+	return m->string_count++;
+}
+
+/* Adds a string literal from its spelling, decoding it into the module's arena */
+uint32_t add_ir_string(ir_module *m, const char *spelling, size_t len) {
+	char *bytes = arena_alloc(&m->pool, len);
+	return add_decoded_string(m, bytes, decode_string(spelling, len, bytes));
+}
+
+/* Symbols and interned identifiers are told apart by their addresses */
+static size_t hash_pointer(void *p) {
+	return (size_t)(((uintptr_t)p >> 3) * 0x9e3779b97f4a7c15ull);
+}
+
+/* The slot for an identifier, either holding its global or empty */
+static uint32_t *global_slot(ir_module *m, char *ident) {
+	size_t i = hash_pointer(ident) & (m->global_hash_size - 1);
+	while(m->global_hash[i] != 0 && m->globals[m->global_hash[i] - 1].ident != ident) {
+		i = (i + 1) & (m->global_hash_size - 1);
+	}
+	return &m->global_hash[i];
 }
 
-t_list *new_t_list(void) {
-	return calloc(1, sizeof(t_list));
+/* Only valid until the next global is added */
+ir_global *find_ir_global(ir_module *m, char *ident) {
+	if(m->global_count == 0) {
+		return NULL;
+	}
+	uint32_t *slot = global_slot(m, ident);
+	return *slot != 0 ? &m->globals[*slot - 1] : NULL;
 }
 
-void add_triple(t_list *tl, triple *t) {
-	if(tl->count == 0) {
-		tl->head = t;
-		tl->tail = t;
+/* Its identifier mustn't already have a global, load is kept at most a half */
+ir_global *add_ir_global(ir_module *m, ir_global g) {
+	if(m->global_count == m->global_cap) {
+		m->global_cap = m->global_cap == 0 ? 16 : m->global_cap * 2;
+		m->globals = realloc(m->globals, m->global_cap * sizeof(ir_global));
+	}
+	m->globals[m->global_count++] = g;
+
+	if(m->global_count * 2 > m->global_hash_size) {
+		free(m->global_hash);
+		m->global_hash_size = m->global_hash_size == 0 ? GLOBAL_HASH_INITIAL_SIZE : m->global_hash_size * 2;
+		m->global_hash = calloc(m->global_hash_size, sizeof(uint32_t));
+		for(uint32_t i = 0; i < m->global_count; i++) {
+			*global_slot(m, m->globals[i].ident) = i + 1;
+		}
 	} else {
-		tl->tail->next = t;
-		tl->tail = t;
+		*global_slot(m, g.ident) = m->global_count;
+	}
+	return &m->globals[m->global_count - 1];
+}
+
+void begin_function(symbol *s) {
+	builder.sym = s;
+	builder.count = 0;
+	builder.var_count = 0;
+	builder.gen++;
+}
+
+static uint32_t new_var(ir_var v) {
+	if(builder.var_count == builder.var_cap) {
+		builder.var_cap = builder.var_cap == 0 ? BUILDER_INITIAL_SIZE : builder.var_cap * 2;
+		builder.vars = realloc(builder.vars, builder.var_cap * sizeof(ir_var));
+	}
+	builder.vars[builder.var_count] = v;
+	return builder.var_count++;
+}
+
+/* Load is kept at most a half, temporaries aren't in it */
+static void grow_var_hash(void) {
+	free(builder.entries);
+	builder.size = builder.size == 0 ? VAR_HASH_INITIAL_SIZE : builder.size * 2;
+	builder.entries = calloc(builder.size, sizeof(var_entry));
+
+	for(uint32_t v = 0; v < builder.var_count; v++) {
+		if(builder.vars[v].sym == NULL) {
+			continue;
+		}
+		size_t i = hash_pointer(builder.vars[v].sym) & (builder.size - 1);
+		while(builder.entries[i].gen == builder.gen) {
+			i = (i + 1) & (builder.size - 1);
+		}
+		builder.entries[i] = (var_entry){builder.vars[v].sym, v, builder.gen};
 	}
-	t->id = tl->count;
-	tl->count++;
 }
 
+/* The variable for a symbol, added the first time the function uses it */
+uint32_t function_var(symbol *s, uint32_t flags) {
+	if((builder.var_count + 1) * 2 > builder.size) {
+		grow_var_hash();
+	}
+	size_t i = hash_pointer(s) & (builder.size - 1);
+	while(builder.entries[i].gen == builder.gen) {
+		if(builder.entries[i].sym == s) {
+			builder.vars[builder.entries[i].var].flags |= flags;
+			return builder.entries[i].var;
+		}
+		i = (i + 1) & (builder.size - 1);
+	}
+
+	uint32_t v = new_var((ir_var){s->ident, s, flags, s->ty != NULL ? s->ty->size : 0});
+	builder.entries[i] = (var_entry){s, v, builder.gen};
+	return v;
+}
+
+/* A variable that only the compiler uses */
+uint32_t temp_var(uint16_t size) {
+	return new_var((ir_var){NULL, NULL, 0, size});
+}
+
+/* Only valid until the next variable is added */
+ir_var *get_var(uint32_t var) {
+	return &builder.vars[var];
+}
+
+triple_ref emit(ir_op op, uint8_t size, uint8_t flags, operand a, operand b) {
+	if(builder.count == builder.cap) {
+		builder.cap = builder.cap == 0 ? BUILDER_INITIAL_SIZE : builder.cap * 2;
+		builder.code = realloc(builder.code, builder.cap * sizeof(triple));
+	}
+	triple *t = &builder.code[builder.count];
+	t->op = op;
+	t->a_kind = a.kind;
+	t->b_kind = b.kind;
+	t->size = size;
+	t->flags = flags;
+	t->a = a.val;
+	t->b = b.val;
+	return builder.count++;
+}
+
+/* Index the next triple emitted will get, for jumps forward */
+triple_ref next_triple(void) {
+	return builder.count;
+}
+
+/* Only valid until the next emit */
+triple *get_triple(triple_ref t) {
+	return &builder.code[t];
+}
+
+static void add_function(ir_module *m, ir_func *f) {
+	if(m->count == m->cap) {
+		m->cap = m->cap == 0 ? 16 : m->cap * 2;
+		m->funcs = realloc(m->funcs, m->cap * sizeof(ir_func *));
+	}
+	m->funcs[m->count++] = f;
+}
+
+ir_func *end_function(ir_module *m) {
+	ir_func *f = arena_alloc(&m->pool, sizeof(ir_func));
+	f->sym = builder.sym;
+	f->ident = builder.sym->ident;
+	f->count = builder.count;
+	f->code = arena_alloc(&m->pool, builder.count * sizeof(triple));
+	if(builder.count > 0) {
+		memcpy(f->code, builder.code, builder.count * sizeof(triple));
+	}
+	f->var_count = builder.var_count;
+	f->vars = arena_alloc(&m->pool, builder.var_count * sizeof(ir_var));
+	if(builder.var_count > 0) {
+		memcpy(f->vars, builder.vars, builder.var_count * sizeof(ir_var));
+	}
+	add_function(m, f);
+	return f;
+}
+
+static void print_operand(ir_func *f, operand_kind kind, uint32_t val) {
+	switch(kind) {
+		case OPERAND_TRIPLE:
+			printf("t%u", val);
+		break;
+		case OPERAND_IMM:
+			printf("%d", (int32_t)val);
+		break;
+		case OPERAND_VAR:
+			printf("%s.%u", f->vars[val].ident != NULL ? f->vars[val].ident : "tmp", val);
+		break;
+		default:
+		break;
+	}
+}
+
+static void print_var(ir_func *f, uint32_t v) {
+	ir_var *var = &f->vars[v];
+	printf("\tvar ");
+	print_operand(f, OPERAND_VAR, v);
+	printf(" %u", var->size);
+	if(var->flags & VAR_GLOBAL) {
+		printf(" global");
+	}
+	if(var->flags & VAR_PARAM) {
+		printf(" param");
+	}
+	if(var->flags & VAR_ADDRESSED) {
+		printf(" addressed");
+	}
+	printf("\n");
+}
+
+void print_ir_function(ir_func *f) {
+	printf("function %s\n", f->ident);
+	for(uint32_t v = 0; v < f->var_count; v++) {
+		print_var(f, v);
+	}
+	for(uint32_t i = 0; i < f->count; i++) {
+		triple *t = &f->code[i];
+		if(t->op == IR_NOP) {
+			continue;
+		}
+		if(t->op == IR_LABEL) {
+			printf("L%u:\n", i);
+			continue;
+		}
+
+		printf("%5u\t%s", i, op_names[t->op]);
+		if(t->size != 0) {
+			printf(".%u", t->size);
+		}
+		if(t->flags & IR_UNSIGNED) {
+			printf("u");
+		}
+
+		/* Jump targets are labels */
+		if(t->op == IR_JUMP) {
+			printf(" L%u", t->a);
+		} else if(t->op == IR_PHI) {
+			operand *args = &f->phi_args[t->b];
+			printf(" ");
+			print_operand(f, t->a_kind, t->a);
+			printf(" [");
+			for(uint32_t j = 1; j <= args[0].val; j++) {
+				printf(j == 1 ? "" : ", ");
+				print_operand(f, args[j].kind, args[j].val);
+			}
+			printf("]");
+		} else if(t->a_kind != OPERAND_NONE) {
+			printf(" ");
+			print_operand(f, t->a_kind, t->a);
+			if(t->op == IR_BRANCH || t->op == IR_BRANCHZ) {
+				printf(", L%u", t->b);
+			} else if(t->b_kind != OPERAND_NONE) {
+				printf(", ");
+				print_operand(f, t->b_kind, t->b);
+			}
+		}
+		printf("\n");
+	}
+}
+
+/* Characters that can't be printed as they are get escaped again */
+static void print_ir_string(ir_string *s) {
+	putchar('"');
+	for(uint32_t i = 0; i < s->len; i++) {
+		unsigned char c = s->bytes[i];
+		if(c == '"' || c == '\\') {
+			printf("\\%c", c);
+		} else if(c == '\n') {
+			printf("\\n");
+		} else if(c == '\t') {
+			printf("\\t");
+		} else if(c < ' ' || c > '~') {
+			printf("\\%03o", c);
+		} else {
+			putchar(c);
+		}
+	}
+	putchar('"');
+}
+
+static void print_global(ir_global *g) {
+	printf("global %s %u", g->ident, g->size);
+	switch(g->init) {
+		case INIT_CONSTANT:
+			printf(" = %d", (int32_t)g->val);
+		break;
+		case INIT_STRING:
+			printf(" = string %u", g->val);
+		break;
+		case INIT_CHARS:
+			printf(" = chars of string %u", g->val);
+		break;
+		default:
+		break;
+	}
+	printf("\n");
+}
+
+void print_ir_module(ir_module *m) {
+	for(uint32_t i = 0; i < m->string_count; i++) {
+		printf("string %u ", i);
+		print_ir_string(&m->strings[i]);
+		printf("\n");
+	}
+	for(uint32_t i = 0; i < m->global_count; i++) {
+		print_global(&m->globals[i]);
+	}
+	for(uint32_t i = 0; i < m->count; i++) {
+		print_ir_function(m->funcs[i]);
+	}
+}
+
+/*
+ * The module is written as a header, its string literals, its globals and
+ * then each function's name, variables, code and phi operands. Triples and phi operands are written
+ * exactly as they are held, so the file must be read back by a build for
+ * the same host.
+ */
+static void write_word(uint32_t w, FILE *out) {
+	fwrite(&w, sizeof(w), 1, out);
+}
+
+static void write_string(char *s, FILE *out) {
+	uint32_t len = s == NULL ? 0 : strlen(s);
+	write_word(len, out);
+	fwrite(s, 1, len, out);
+}
+
+void write_ir_module(ir_module *m, FILE *out) {
+	write_word(IR_MAGIC, out);
+	write_word(m->string_count, out);
+	for(uint32_t i = 0; i < m->string_count; i++) {
+		write_word(m->strings[i].len, out);
+		fwrite(m->strings[i].bytes, 1, m->strings[i].len, out);
+	}
+	write_word(m->global_count, out);
+	for(uint32_t i = 0; i < m->global_count; i++) {
+		write_string(m->globals[i].ident, out);
+		write_word(m->globals[i].size, out);
+		write_word(m->globals[i].init, out);
+		write_word(m->globals[i].val, out);
+	}
+	write_word(m->count, out);
+	for(uint32_t i = 0; i < m->count; i++) {
+		ir_func *f = m->funcs[i];
+		write_string(f->ident, out);
+		write_word(f->var_count, out);
+		for(uint32_t v = 0; v < f->var_count; v++) {
+			write_string(f->vars[v].ident, out);
+			write_word(f->vars[v].flags, out);
+			write_word(f->vars[v].size, out);
+		}
+		write_word(f->count, out);
+		fwrite(f->code, sizeof(triple), f->count, out);
+		write_word(f->phi_count, out);
+		if(f->phi_count > 0) {
+			fwrite(f->phi_args, sizeof(operand), f->phi_count, out);
+		}
+	}
+}
+
+
 /*
-triple *gen_triple_expr(node *expr) {
-	switch(node->type) {
-		case _NODE:
-				
+ * Nothing read is taken on trust, so the passes can rely on a module read
+ * back as they do on one that was built. Counts are checked against the
+ * bytes left in the file before anything is allocated for them, and the
+ * first problem found is the one reported.
+ */
+typedef struct {
+	FILE *in;
+	uint64_t left;
+	char *error;
+} ir_reader;
+
+#define KIND(k) (1u << (k))
+#define VALUE (KIND(OPERAND_TRIPLE) | KIND(OPERAND_IMM))
+
+/* The operand kinds each op takes, jump targets are also checked to be labels */
+static uint8_t operand_kinds[IR_OP_COUNT][2] = {
+	[IR_LABEL] = {KIND(OPERAND_NONE), KIND(OPERAND_NONE)},
+	[IR_JUMP] = {KIND(OPERAND_TRIPLE), KIND(OPERAND_NONE)},
+	[IR_BRANCH] = {VALUE, KIND(OPERAND_TRIPLE)},
+	[IR_BRANCHZ] = {VALUE, KIND(OPERAND_TRIPLE)},
+	[IR_RET] = {VALUE | KIND(OPERAND_NONE), KIND(OPERAND_NONE)},
+	[IR_PARAM] = {KIND(OPERAND_IMM), KIND(OPERAND_NONE)},
+	[IR_GET] = {KIND(OPERAND_VAR), KIND(OPERAND_NONE)},
+	[IR_SET] = {KIND(OPERAND_VAR), VALUE},
+	[IR_ADDR] = {KIND(OPERAND_VAR), KIND(OPERAND_NONE)},
+	[IR_LOAD] = {VALUE, KIND(OPERAND_NONE)},
+	[IR_STORE] = {VALUE, VALUE},
+	[IR_ARG] = {VALUE, KIND(OPERAND_NONE)},
+	[IR_CALL] = {VALUE | KIND(OPERAND_VAR), KIND(OPERAND_IMM)},
+	[IR_COPY] = {VALUE, KIND(OPERAND_NONE)},
+	[IR_CONV] = {VALUE, KIND(OPERAND_IMM)},
+	[IR_PHI] = {KIND(OPERAND_VAR), KIND(OPERAND_IMM)},
+	[IR_STRING] = {KIND(OPERAND_IMM), KIND(OPERAND_NONE)},
+	[IR_NEG] = {VALUE, KIND(OPERAND_NONE)},
+	[IR_COM] = {VALUE, KIND(OPERAND_NONE)},
+	[IR_ADD] = {VALUE, VALUE},
+	[IR_SUB] = {VALUE, VALUE},
+	[IR_MUL] = {VALUE, VALUE},
+	[IR_DIV] = {VALUE, VALUE},
+	[IR_MOD] = {VALUE, VALUE},
+	[IR_SHL] = {VALUE, VALUE},
+	[IR_SHR] = {VALUE, VALUE},
+	[IR_AND] = {VALUE, VALUE},
+	[IR_OR] = {VALUE, VALUE},
+	[IR_XOR] = {VALUE, VALUE},
+	[IR_EQ] = {VALUE, VALUE},
+	[IR_NE] = {VALUE, VALUE},
+	[IR_LT] = {VALUE, VALUE},
+	[IR_LE] = {VALUE, VALUE},
+	[IR_GT] = {VALUE, VALUE},
+	[IR_GE] = {VALUE, VALUE}
+};
+
+static bool fail(ir_reader *r, char *error) {
+	if(r->error == NULL) {
+		r->error = error;
+	}
+	return false;
+}
+
+/* Whether count things of at least elem bytes each can still be in the file */
+static bool has_room(ir_reader *r, uint32_t count, size_t elem) {
+	return (uint64_t)count * elem <= r->left || fail(r, "IR file is truncated");
+}
+
+static bool read_bytes(ir_reader *r, void *p, size_t elem, uint32_t count) {
+	if(!has_room(r, count, elem) || fread(p, elem, count, r->in) != count) {
+		return fail(r, "IR file is truncated");
+	}
+	r->left -= (uint64_t)count * elem;
+	return true;
+}
+
+static bool read_word(ir_reader *r, uint32_t *w) {
+	return read_bytes(r, w, sizeof(*w), 1);
+}
+
+static bool read_string(ir_reader *r, char **s) {
+	uint32_t len;
+	if(!read_word(r, &len) || !has_room(r, len, 1)) {
+		return false;
+	}
+	if(len == 0) {
+		*s = NULL;
+		return true;
+	}
+	char *buf = malloc(len);
+	bool ok = read_bytes(r, buf, 1, len);
+	*s = ok ? intern(buf, len) : NULL;
+	free(buf);
+	return ok;
+}
+
+static bool read_array(ir_reader *r, ir_module *m, void **p, size_t elem, uint32_t count) {
+	if(!has_room(r, count, elem)) {
+		return false;
+	}
+	*p = arena_alloc(&m->pool, (size_t)count * elem);
+	return read_bytes(r, *p, elem, count);
+}
+
+static bool check_operand(ir_reader *r, ir_func *f, uint8_t kinds, operand_kind kind, uint32_t val) {
+	if(kind > OPERAND_VAR || !(kinds & KIND(kind))) {
+		return fail(r, "IR triple has an operand its op doesn't take");
+	}
+	if((kind == OPERAND_TRIPLE && val >= f->count) || (kind == OPERAND_VAR && val >= f->var_count)) {
+		return fail(r, "IR operand is out of range");
+	}
+	return true;
+}
+
+static bool check_label(ir_reader *r, ir_func *f, uint32_t target) {
+	return f->code[target].op == IR_LABEL || fail(r, "IR jump target is not a label");
+}
+
+static bool check_phi(ir_reader *r, ir_func *f, triple *t) {
+	if(t->b >= f->phi_count || f->phi_args[t->b].kind != OPERAND_IMM
+			|| f->phi_args[t->b].val > f->phi_count - t->b - 1) {
+		return fail(r, "IR phi operands are out of range");
+	}
+	operand *args = &f->phi_args[t->b];
+	for(uint32_t j = 1; j <= args[0].val; j++) {
+		if(!check_operand(r, f, VALUE, args[j].kind, args[j].val)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Deleted triples keep whatever operands they had, nothing looks at them */
+static bool check_triple(ir_reader *r, ir_module *m, ir_func *f, triple *t) {
+	if(t->op >= IR_OP_COUNT) {
+		return fail(r, "IR triple has an unknown op");
+	}
+	if(t->op == IR_NOP) {
+		return true;
+	}
+	if(!check_operand(r, f, operand_kinds[t->op][0], t->a_kind, t->a)
+			|| !check_operand(r, f, operand_kinds[t->op][1], t->b_kind, t->b)) {
+		return false;
+	}
+	switch(t->op) {
+		case IR_JUMP:
+			return check_label(r, f, t->a);
+		case IR_BRANCH:
+		case IR_BRANCHZ:
+			return check_label(r, f, t->b);
+		case IR_PHI:
+			return check_phi(r, f, t);
+		case IR_STRING:
+			return t->a < m->string_count || fail(r, "IR operand is out of range");
+		default:
+			return true;
+	}
+}
+
+/* A variable takes at least its name's length, flags and size */
+#define MIN_VAR_BYTES (3 * sizeof(uint32_t))
+
+static bool read_function(ir_reader *r, ir_module *m) {
+	ir_func *f = arena_alloc(&m->pool, sizeof(ir_func));
+	if(!read_string(r, &f->ident) || !read_word(r, &f->var_count) || !has_room(r, f->var_count, MIN_VAR_BYTES)) {
+		return false;
+	}
+	if(f->ident == NULL) {
+		return fail(r, "IR function has no name");
+	}
+	f->vars = arena_alloc(&m->pool, f->var_count * sizeof(ir_var));
+	for(uint32_t v = 0; v < f->var_count; v++) {
+		uint32_t size;
+		if(!read_string(r, &f->vars[v].ident) || !read_word(r, &f->vars[v].flags) || !read_word(r, &size)) {
+			return false;
+		}
+		if(size > UINT16_MAX) {
+			return fail(r, "IR variable is too large");
+		}
+		f->vars[v].size = size;
+	}
+	if(!read_word(r, &f->count) || !read_array(r, m, (void **)&f->code, sizeof(triple), f->count)) {
+		return false;
+	}
+	if(f->count == 0) {
+		return fail(r, "IR function has no code");
+	}
+	if(!read_word(r, &f->phi_count) || !read_array(r, m, (void **)&f->phi_args, sizeof(operand), f->phi_count)) {
+		return false;
+	}
+	for(uint32_t i = 0; i < f->count; i++) {
+		if(!check_triple(r, m, f, &f->code[i])) {
+			return false;
+		}
+	}
+	add_function(m, f);
+	return true;
+}
+
+static bool read_strings(ir_reader *r, ir_module *m) {
+	uint32_t count;
+	if(!read_word(r, &count) || !has_room(r, count, sizeof(uint32_t))) {
+		return false;
+	}
+	for(uint32_t i = 0; i < count; i++) {
+		uint32_t len;
+		char *bytes;
+		if(!read_word(r, &len) || !read_array(r, m, (void **)&bytes, 1, len)) {
+			return false;
+		}
+		add_decoded_string(m, bytes, len);
+	}
+	return true;
+}
+
+/* A global takes at least its name's length, size, initializer and value */
+#define MIN_GLOBAL_BYTES (4 * sizeof(uint32_t))
+
+static bool read_globals(ir_reader *r, ir_module *m) {
+	uint32_t count;
+	if(!read_word(r, &count) || !has_room(r, count, MIN_GLOBAL_BYTES)) {
+		return false;
+	}
+	for(uint32_t i = 0; i < count; i++) {
+		ir_global g;
+		if(!read_string(r, &g.ident) || !read_word(r, &g.size) || !read_word(r, &g.init) || !read_word(r, &g.val)) {
+			return false;
+		}
+		if(g.ident == NULL) {
+			return fail(r, "IR global has no name");
+		}
+		if(g.init > INIT_CHARS || ((g.init == INIT_STRING || g.init == INIT_CHARS) && g.val >= m->string_count)) {
+			return fail(r, "IR global has an invalid initializer");
+		}
+		if(find_ir_global(m, g.ident) != NULL) {
+			return fail(r, "IR global is defined twice");
+		}
+		add_ir_global(m, g);
+	}
+	return true;
+}
+
+/* A function takes at least its name's length and its three counts */
+#define MIN_FUNCTION_BYTES (4 * sizeof(uint32_t))
+
+/* Symbols aren't written, functions and variables that are read back only have names */
+ir_module *read_ir_module(FILE *in) {
+	ir_reader r = { in, 0, NULL };
+	long size = fseek(in, 0, SEEK_END) == 0 ? ftell(in) : -1;
+	if(size < 0 || fseek(in, 0, SEEK_SET) != 0) {
+		file_error("IR file can't be read");
+		return NULL;
+	}
+	r.left = size;
+
+	uint32_t magic;
+	if(!read_word(&r, &magic) || magic != IR_MAGIC) {
+		file_error("not an IR file");
+		return NULL;
+	}
+	ir_module *m = new_ir_module();
+	uint32_t count = 0;
+	bool ok = read_strings(&r, m) && read_globals(&r, m) && read_word(&r, &count) && has_room(&r, count, MIN_FUNCTION_BYTES);
+	for(uint32_t i = 0; ok && i < count; i++) {
+		ok = read_function(&r, m);
+	}
+	if(!ok) {
+		file_error(r.error);
+		release_ir_module(m);
+		return NULL;
 	}
+	return m;
 }
-*/
@@ -0,0 +1,423 @@
+#include "../inc/type.h"
+#include "../inc/node.h"
+#include "../inc/decl.h"
+#include "../inc/fold.h"
+#include "../inc/error.h"
+#include "../inc/arena.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TYPE_TABLE_INITIAL_SIZE 256 /* Must be a power of two */
+#define TYPE_POOL_CHUNK (16 * 1024)
+#define MAX_OBJECT_SIZE UINT16_MAX
+#define ALIGN_UP(n, a) (((n) + (a) - 1) / (a) * (a))
+
+/* Enough for nearly every parameter list without allocating */
+#define LOCAL_PARAMS 16
+
+/*
+ * Open addressing table of every type made so far. Types are made while
+ * parsing function bodies on several threads, so it is locked.
+ */
+static type **table;
+static size_t table_size;
+static size_t table_count;
+static arena type_pool;
+static pthread_mutex_t type_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static type *void_type;
+static type *char_type;
+static type *int_type;
+static type *long_type;
+
+static bool is_composite(uint8_t kind) {
+	return kind == TYPE_STRUCT || kind == TYPE_UNION;
+}
+
+static bool is_complete(type *t) {
+	return (__atomic_load_n(&t->flags, __ATOMIC_ACQUIRE) & TYPE_COMPLETE) != 0;
+}
+
+static uint32_t mix(uint32_t h, uintptr_t v) {
+	return (h ^ (uint32_t)(v ^ (v >> 32))) * 16777619u;
+}
+
+/* A struct or union is identified by the declaration of its tag, or its definition if it has none */
+static uint32_t type_hash(type *t) {
+	uint32_t h = mix(2166136261u, t->kind);
+	if(is_composite(t->kind)) {
+		return mix(mix(h, (uintptr_t)t->tag), t->def);
+	}
+	h = mix(mix(h, (uintptr_t)t->base), t->count);
+	h = mix(h, t->flags & TYPE_UNPROTOTYPED);
+	if(t->kind == TYPE_FUNCTION) {
+		for(uint32_t i = 0; i < t->count; i++) {
+			h = mix(h, (uintptr_t)t->params[i]);
+		}
+	}
+	return h;
+}
+
+static bool type_equal(type *a, type *b) {
+	if(a->kind != b->kind) {
+		return false;
+	}
+	if(is_composite(a->kind)) {
+		return a->tag == b->tag && a->def == b->def;
+	}
+	if(a->base != b->base || a->count != b->count
+		|| (a->flags & TYPE_UNPROTOTYPED) != (b->flags & TYPE_UNPROTOTYPED)) {
+		return false;
+	}
+	return a->kind != TYPE_FUNCTION || a->count == 0
+		|| !memcmp(a->params, b->params, a->count * sizeof(type *));
+}
+
+static void grow_table(void) {
+	type **old = table;
+	size_t old_size = table_size;
+
+	table_size = old_size == 0 ? TYPE_TABLE_INITIAL_SIZE : old_size * 2;
+	table = calloc(table_size, sizeof(type *));
+
+	for(size_t i = 0; i < old_size; i++) {
+		if(old[i] != NULL) {
+			size_t j = old[i]->hash & (table_size - 1);
+			while(table[j] != NULL) {
+				j = (j + 1) & (table_size - 1);
+			}
+			table[j] = old[i];
+		}
+	}
+	free(old);
+}
+
+/* Returns the one copy of the type described by the key, making it if it is new */
+static type *intern_type(type *key) {
+	key->hash = type_hash(key);
+
+	pthread_mutex_lock(&type_lock);
+	/* Keep the load factor at or below one half */
+	if((table_count + 1) * 2 > table_size) {
+		grow_table();
+	}
+
+	size_t i = key->hash & (table_size - 1);
+	while(table[i] != NULL) {
+		if(table[i]->hash == key->hash && type_equal(table[i], key)) {
+			type *t = table[i];
+			pthread_mutex_unlock(&type_lock);
+			return t;
+		}
+		i = (i + 1) & (table_size - 1);
+	}
+
+	type *t = arena_alloc(&type_pool, sizeof(type));
+	*t = *key;
+	if(t->kind == TYPE_FUNCTION && t->count > 0) {
+		t->params = arena_alloc(&type_pool, t->count * sizeof(type *));
+		memcpy(t->params, key->params, t->count * sizeof(type *));
+	}
+	table[i] = t;
+	table_count++;
+	pthread_mutex_unlock(&type_lock);
+	return t;
+}
+
+static type *scalar_type(type_kind kind, uint16_t size) {
+	type key = { .kind = kind, .size = size, .align = size > 2 ? 2 : size };
+	key.flags = kind == TYPE_VOID ? 0 : TYPE_COMPLETE;
+	if(key.align == 0) {
+		key.align = 1;
+	}
+	return intern_type(&key);
+}
+
+void init_types(void) {
+	arena_init(&type_pool, TYPE_POOL_CHUNK);
+	void_type = scalar_type(TYPE_VOID, 0);
+	char_type = scalar_type(TYPE_CHAR, 1);
+	int_type = scalar_type(TYPE_INT, 2);
+	long_type = scalar_type(TYPE_LONG, 4);
+}
+
+type *basic_type(token_type t) {
+	switch(t) {
+		case VOID:
+			return void_type;
+		case CHAR:
+			return char_type;
+		case LONG:
+			return long_type;
+		default:
+			return int_type;
+	}
+}
+
+type *pointer_to(type *base) {
+	type key = { .kind = TYPE_POINTER, .flags = TYPE_COMPLETE, .size = 2, .align = 2, .base = base };
+	return intern_type(&key);
+}
+
+/* An array of unknown length is incomplete until something gives it one */
+type *array_of(type *elem, uint32_t count) {
+	type key = { .kind = TYPE_ARRAY, .align = elem->align, .base = elem, .count = count };
+	if(!is_complete(elem)) {
+		error("array has incomplete element type");
+	} else if(count != 0) {
+		uint32_t size = elem->size * count;
+		if(count > MAX_OBJECT_SIZE || size > MAX_OBJECT_SIZE) {
+			error("size of array is too large");
+		} else {
+			key.size = size;
+			key.flags = TYPE_COMPLETE;
+		}
+	}
+	return intern_type(&key);
+}
+
+/* Functions have no size, an unprototyped function takes any arguments */
+type *function_of(type *ret, type **params, uint32_t count, bool prototyped) {
+	type key = { .kind = TYPE_FUNCTION, .align = 1, .base = ret, .params = params, .count = count };
+	key.flags = prototyped ? 0 : TYPE_UNPROTOTYPED;
+	return intern_type(&key);
+}
+
+/*
+ * Members are laid out in order, each at the next offset aligned for it.
+ * Union members all start at 0. A bitfield takes a whole object of its type.
+ */
+static void complete_composite(type *t, node *decls) {
+	uint32_t count = 0;
+	for(node *d = decls; d != NULL; d = NODE(d->next)) {
+		count++;
+	}
+
+	member *members = malloc(count * sizeof(member));
+	uint32_t n = 0;
+	uint32_t size = 0;
+	uint8_t align = 1;
+	for(node *d = decls; d != NULL; d = NODE(d->next)) {
+		type *mt = declaration_type(d);
+		/* Nested definitions and unnamed bitfields declare no member */
+		if(d->declaration.declarator == 0 || NODE(d->declaration.declarator)->type == ENUM_DECL_NODE) {
+			continue;
+		}
+		node *id = declarator_identifier(NODE(d->declaration.declarator));
+		if(id == NULL) {
+			continue;
+		}
+		if(!is_complete(mt)) {
+			error("field has incomplete type");
+			continue;
+		}
+
+		uint32_t offset = t->kind == TYPE_UNION ? 0 : ALIGN_UP(size, mt->align);
+		members[n].ident = id->constant.tok_str;
+		members[n].type = mt;
+		members[n].offset = offset;
+		n++;
+		if(offset + mt->size > size) {
+			size = offset + mt->size;
+		}
+		if(mt->align > align) {
+			align = mt->align;
+		}
+	}
+
+	size = ALIGN_UP(size, align);
+	if(size > MAX_OBJECT_SIZE) {
+		error("struct is too large");
+		size = 0;
+	}
+
+	/* Another thread may have completed it with the same definition first */
+	pthread_mutex_lock(&type_lock);
+	if(!is_complete(t)) {
+		t->members = members;
+		t->count = n;
+		t->size = size;
+		t->align = align;
+		__atomic_store_n(&t->flags, TYPE_COMPLETE, __ATOMIC_RELEASE);
+		members = NULL;
+	}
+	pthread_mutex_unlock(&type_lock);
+	free(members);
+}
+
+/*
+ * A tagged struct is made incomplete when its tag is declared, so members
+ * can point to it before it is completed by its definition. The parser
+ * has already resolved the tag to the node that declared it in scope.
+ */
+static type *composite_type(node *s) {
+	type key = { .align = 1 };
+	key.kind = s->type == STRUCT_DECL_NODE ? TYPE_STRUCT : TYPE_UNION;
+	key.tag = s->comp_declarator.identifier;
+	key.def = key.tag == NULL ? REF(s) : s->comp_declarator.tag_def;
+
+	type *t = intern_type(&key);
+	if(s->comp_declarator.decl_list != 0 && !is_complete(t)) {
+		complete_composite(t, NODE(s->comp_declarator.decl_list));
+	}
+	return t;
+}
+
+/* Declarations without a type specifier are int */
+type *specifier_type(node *spec) {
+	if(spec == NULL) {
+		return int_type;
+	}
+	switch(spec->type) {
+		case STRUCT_DECL_NODE:
+		case UNION_DECL_NODE:
+			return composite_type(spec);
+
+		default:
+			return basic_type(spec->declaration_spec.s_type);
+	}
+}
+
+/* Array and function parameters are really pointers */
+type *parameter_type(node *p) {
+	type *t = declaration_type(p);
+	if(t->kind == TYPE_ARRAY) {
+		return pointer_to(t->base);
+	} else if(t->kind == TYPE_FUNCTION) {
+		return pointer_to(t);
+	}
+	return t;
+}
+
+static type *function_type(type *ret, node *params) {
+	type *local[LOCAL_PARAMS];
+	uint32_t count = 0;
+	for(node *p = params; p != NULL; p = NODE(p->next)) {
+		count++;
+	}
+
+	/* () declares nothing about the parameters, (void) declares there are none */
+	node *first = params;
+	if(count == 1 && first->declaration.declarator == 0) {
+		if(first->declaration.specifier == 0) {
+			return function_of(ret, NULL, 0, false);
+		}
+		node *spec = NODE(first->declaration.specifier);
+		if(spec->type == DECLARATION_SPEC_NODE && spec->declaration_spec.s_type == VOID) {
+			return function_of(ret, NULL, 0, true);
+		}
+	}
+
+	type **p = count <= LOCAL_PARAMS ? local : malloc(count * sizeof(type *));
+	uint32_t i = 0;
+	for(node *n = params; n != NULL; n = NODE(n->next)) {
+		p[i++] = parameter_type(n);
+	}
+	type *t = function_of(ret, p, count, true);
+	if(p != local) {
+		free(p);
+	}
+	return t;
+}
+
+/*
+ * The outermost declarator node applies to the base type first, so the
+ * type is built walking inwards until the identifier is reached.
+ */
+type *declarator_type(type *t, node *d) {
+	while(d != NULL) {
+		switch(d->type) {
+			case DECLARATOR_NODE:
+				if(d->declarator.is_pointer) {
+					t = pointer_to(t);
+				}
+				d = NODE(d->declarator.direct_declarator);
+			break;
+
+			case ARRAY_DECL_NODE: {
+				/* The length has been folded already, anything else was reported then */
+				node *len = NODE(d->direct_declarator.params);
+				uint32_t count = 0;
+				if(is_constant(len) && (len->constant.is_unsigned || len->constant.val > 0)) {
+					count = (uint32_t)len->constant.val;
+				}
+				t = array_of(t, count);
+				d = NODE(d->direct_declarator.direct);
+			}
+			break;
+
+			case FUNC_DECL_NODE:
+			case FUNC_DEF_NODE:
+				t = function_type(t, NODE(d->direct_declarator.params));
+				d = NODE(d->direct_declarator.direct);
+			break;
+
+			default:
+				return t;
+		}
+	}
+	return t;
+}
+
+type *declaration_type(node *d) {
+	type *t = specifier_type(NODE(d->declaration.specifier));
+	return declarator_type(t, NODE(d->declaration.declarator));
+}
+
+member *find_member(type *t, char *ident) {
+	for(uint32_t i = 0; i < t->count; i++) {
+		if(t->members[i].ident == ident) {
+			return &t->members[i];
+		}
+	}
+	return NULL;
+}
+
+/* Prints a type as a sentence, like print_decl */
+static void print_type_name(type *t) {
+	while(t != NULL) {
+		switch(t->kind) {
+			case TYPE_VOID:
+				printf("void");
+				return;
+			case TYPE_CHAR:
+				printf("char");
+				return;
+			case TYPE_INT:
+				printf("int");
+				return;
+			case TYPE_LONG:
+				printf("long");
+				return;
+			case TYPE_STRUCT:
+			case TYPE_UNION:
+				printf("%s %s", t->kind == TYPE_STRUCT ? "struct" : "union", t->tag != NULL ? t->tag : "<anonymous>");
+				return;
+
+			case TYPE_POINTER:
+				printf("pointer to ");
+			break;
+			case TYPE_ARRAY:
+				printf("array %u of ", t->count);
+			break;
+			case TYPE_FUNCTION:
+				printf("function (");
+				if(t->count == 0 && !(t->flags & TYPE_UNPROTOTYPED)) {
+					printf("void");
+				}
+				for(uint32_t i = 0; i < t->count; i++) {
+					print_type_name(t->params[i]);
+					printf(i + 1 < t->count ? ", " : "");
+				}
+				printf(") returning ");
+			break;
+		}
+		t = t->base;
+	}
+}
+
+void print_type(type *t) {
+	print_type_name(t);
+	printf("\n");
+}